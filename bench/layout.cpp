@@ -0,0 +1,183 @@
+// Drives the layout, focus and workspace code on the in-memory display
+// backend: no X server, so the numbers are the WM's own cost per operation,
+// plus the requests each operation would have sent. Exits non-zero when an
+// operation sends more requests than it should.
+//
+//   make bench-layout BENCH_ARGS="[windows] [iterations]"
+
+#include "nwm.hpp"
+#include "tiling.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static int failures = 0;
+
+static nwm::WindowTraits tiled_traits(Window window, int workspace) {
+    nwm::WindowTraits traits;
+    memset(&traits, 0, sizeof(traits));
+    traits.window = window;
+    traits.valid = true;
+    traits.map_state = IsViewable;
+    traits.width = 640;
+    traits.height = 480;
+    traits.saved_workspace = workspace;
+    return traits;
+}
+
+// Runs op `iterations` times and reports ns and requests per call. A limit
+// of -1 disables the request check.
+template <typename Op>
+static void measure(nwm::Base &base, const char *name, int iterations, long limit, Op op) {
+    nwm::FakeDisplay &fake = *base.fake;
+    unsigned long before = nwm::fake_display_requests(fake);
+    unsigned long configures = fake.counts[nwm::FAKE_CONFIGURE];
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        op(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    double requests = (double)(nwm::fake_display_requests(fake) - before) / iterations;
+    double configure = (double)(fake.counts[nwm::FAKE_CONFIGURE] - configures) / iterations;
+    bool ok = limit < 0 || requests <= limit;
+
+    printf("%-18s %9d ops %9.0f ns/op %10.2f Mops/s %7.2f req/op %7.2f cfg/op%s\n",
+           name, iterations, ns / iterations, iterations / ns * 1e3, requests, configure,
+           ok ? "" : "  FAIL");
+    if (!ok) failures++;
+}
+
+int main(int argc, char **argv) {
+    int windows = argc > 1 ? std::atoi(argv[1]) : 8;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    if (windows < 2) windows = 8;
+    if (iterations <= 0) iterations = 1000000;
+
+    nwm::Base base;
+    nwm::FakeDisplay fake;
+    nwm::init_headless(base, fake, 1, 1920, 1080);
+
+    // Workspaces 0 and 1 each get `windows` tiled clients.
+    for (int ws = 0; ws < 2; ++ws) {
+        for (int i = 0; i < windows; ++i) {
+            nwm::manage_window(tiled_traits(0x200000 + ws * windows + i, ws), base);
+        }
+    }
+    printf("%d windows on each of 2 workspaces\n", windows);
+
+    nwm::tile_windows(base);
+    nwm::focus_window(nwm::client_get(base, base.workspaces[0].clients[0]), base);
+
+    // A layout pass over unchanged state must not touch the server.
+    measure(base, "tile (unchanged)", iterations, 0, [&](int) {
+        nwm::tile_windows(base);
+    });
+
+    // Root properties are only rewritten when they changed.
+    nwm::ewmh_flush(base);
+    measure(base, "ewmh_flush (idle)", iterations, 0, [&](int) {
+        nwm::tile_windows(base);
+        nwm::ewmh_flush(base);
+    });
+
+    // Old border, new border, input focus.
+    measure(base, "focus_next", iterations, 3, [&](int) {
+        nwm::focus_next(nullptr, base);
+    });
+
+    // Two configures, one restack, the focused border and input focus.
+    measure(base, "swap_next", iterations / 10, 5, [&](int) {
+        nwm::swap_next(nullptr, base);
+    });
+
+    // Unmap one workspace, map the other, refocus.
+    int targets[2] = {1, 0};
+    measure(base, "switch_workspace", iterations / 10, -1, [&](int i) {
+        nwm::switch_workspace(&targets[i & 1], base);
+    });
+
+    measure(base, "toggle_bar+tile", iterations / 10, -1, [&](int) {
+        nwm::toggle_bar(nullptr, base);
+    });
+
+    // A restart hands the state to a fresh instance on the same display.
+    // Per client it selects input and sets _NET_WM_DESKTOP; beyond that one
+    // tree query, one restack, the focused border and input focus. Nothing
+    // may move.
+    nwm::snapshot_save(base);
+    nwm::Base next;
+    nwm::FakeDisplay next_fake;
+    nwm::init_headless(next, next_fake, 1, 1920, 1080);
+    next_fake.windows = fake.windows;
+    next_fake.stack = fake.stack;
+    measure(next, "restart", 1, 2 * 2 * windows + 4, [&](int) {
+        if (!nwm::snapshot_restore(next)) failures++;
+        nwm::tile_windows(next);
+    });
+    for (const auto &entry : fake.windows) {
+        const nwm::FakeWindow &a = entry.second;
+        const nwm::FakeWindow &b = next_fake.windows[entry.first];
+        if (a.mapped != b.mapped || a.x != b.x || a.y != b.y ||
+            a.width != b.width || a.height != b.height) {
+            printf("restart moved window 0x%lx  FAIL\n", entry.first);
+            failures++;
+        }
+    }
+
+    // Two monitors, showing workspaces 0 and 1. Switching the first one
+    // between 0 and 2 must not send a single request about the clients on
+    // the second.
+    nwm::Base dual;
+    nwm::FakeDisplay dual_fake;
+    nwm::init_headless(dual, dual_fake, 2, 1920, 1080);
+    for (int ws = 0; ws < 3; ++ws) {
+        for (int i = 0; i < windows; ++i) {
+            nwm::manage_window(tiled_traits(0x400000 + ws * windows + i, ws), dual);
+        }
+    }
+    nwm::tile_windows(dual);
+    int dual_targets[2] = {2, 0};
+    measure(dual, "switch (2 mon)", iterations / 10, -1, [&](int i) {
+        nwm::switch_workspace(&dual_targets[i & 1], dual);
+    });
+    dual_fake.record_ops = true;
+    nwm::switch_workspace(&dual_targets[0], dual);
+    nwm::switch_workspace(&dual_targets[1], dual);
+    for (const nwm::FakeOp &op : dual_fake.ops) {
+        nwm::ManagedWindow *w = nwm::find_window(dual, op.window);
+        if (w && w->workspace == 1) {
+            printf("switch on monitor 0 touched 0x%lx on monitor 1  FAIL\n", op.window);
+            failures++;
+            break;
+        }
+    }
+
+    // A hotplug that resizes the second monitor lays out only that one: the
+    // first monitor's clients must not see a single request.
+    int widths[2] = {1280, 1920};
+    measure(dual, "hotplug (1 of 2)", iterations / 10, -1, [&](int i) {
+        std::vector<nwm::Monitor> old = dual.monitors;
+        dual.monitors[1].width = widths[i & 1];
+        nwm::monitors_changed(dual, old);
+    });
+    dual_fake.ops.clear();
+    for (int i = 0; i < 2; ++i) {
+        std::vector<nwm::Monitor> old = dual.monitors;
+        dual.monitors[1].width = widths[i];
+        nwm::monitors_changed(dual, old);
+    }
+    for (const nwm::FakeOp &op : dual_fake.ops) {
+        nwm::ManagedWindow *w = nwm::find_window(dual, op.window);
+        if (w && w->workspace == dual.monitors[0].current_workspace) {
+            printf("resizing monitor 1 touched 0x%lx on monitor 0  FAIL\n", op.window);
+            failures++;
+            break;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
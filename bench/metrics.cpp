@@ -0,0 +1,57 @@
+// Measures the cost of one system-metrics sample and checks that the
+// sampler does not allocate in steady state.
+//
+//   make bench-metrics && ./bench/metrics [iterations]
+
+#include "sampler.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static unsigned long allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    if (iterations <= 0) iterations = 20000;
+
+    nwm::Metrics metrics;
+    nwm::SystemInfo info;
+    nwm::metrics_open(metrics);
+
+    for (int i = 0; i < 100; ++i) {
+        nwm::metrics_sample(metrics, info);
+    }
+
+    unsigned long allocations_before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        nwm::metrics_sample(metrics, info);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    unsigned long allocated = allocations - allocations_before;
+
+    nwm::metrics_close(metrics);
+
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    printf("metrics_sample: %d samples, %.0f ns/sample, %lu allocations\n",
+           iterations, ns / iterations, allocated);
+    printf("last: %s\n", info.summary);
+
+    return allocated == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#!/bin/bash
+# Runs bench/wmbench against nwm on a private Xvfb server. Needs neither a
+# GPU nor network access, and does not touch a running X session or its
+# IPC socket.
+#
+#   make bench BENCH_ARGS="-n 100 -r 20"
+
+cd "$(dirname "$0")/.."
+
+DISPLAY_NUM=${BENCH_DISPLAY:-:97}
+RUNTIME_DIR=$(mktemp -d)
+XVFB_PID=
+WM_PID=
+
+cleanup() {
+    [ -n "$WM_PID" ] && kill "$WM_PID" 2>/dev/null
+    [ -n "$XVFB_PID" ] && kill "$XVFB_PID" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$RUNTIME_DIR"
+}
+trap cleanup EXIT
+
+if ! command -v Xvfb >/dev/null; then
+    echo "bench: Xvfb not found" >&2
+    exit 1
+fi
+
+Xvfb "$DISPLAY_NUM" -screen 0 1920x1080x24 -nolisten tcp -noreset 2>"$RUNTIME_DIR/xvfb.log" &
+XVFB_PID=$!
+
+for _ in $(seq 50); do
+    [ -S "/tmp/.X11-unix/X${DISPLAY_NUM#:}" ] && break
+    sleep 0.1
+done
+
+export DISPLAY=$DISPLAY_NUM
+export XDG_RUNTIME_DIR=$RUNTIME_DIR
+unset NWM_SOCKET
+
+./nwm 2>"$RUNTIME_DIR/nwm.log" &
+WM_PID=$!
+
+for _ in $(seq 50); do
+    [ -S "$RUNTIME_DIR/nwm.sock" ] && break
+    sleep 0.1
+done
+
+if ! [ -S "$RUNTIME_DIR/nwm.sock" ]; then
+    echo "bench: nwm did not come up" >&2
+    cat "$RUNTIME_DIR/nwm.log" >&2
+    exit 1
+fi
+
+./bench/wmbench "$@"
@@ -0,0 +1,340 @@
+// Drives a running nwm with synthetic X clients and reports how long the WM
+// takes to answer each kind of request, and how many X requests it issued
+// per operation (read from the x_requests counter in the IPC tree).
+//
+//   make bench                         starts Xvfb and nwm, see bench/run.sh
+//   ./bench/wmbench [-n windows] [-r rounds]
+
+#include "ipc.hpp"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define WAIT_TIMEOUT_MS 1000
+// Time given to the WM to finish work that trails the event we wait for
+// (retiles, restacks) before its request counter is read.
+#define SETTLE_MS 50
+
+struct Phase {
+    const char *name;
+    std::vector<double> latency_us;
+    int timeouts;
+    long requests;
+};
+
+static Display *dpy;
+static Window root;
+
+static double now_us() {
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::micro>>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename Pred>
+static bool wait_event(Pred pred, int timeout_ms) {
+    double deadline = now_us() + timeout_ms * 1000.0;
+    XFlush(dpy);
+
+    for (;;) {
+        while (XPending(dpy)) {
+            XEvent e;
+            XNextEvent(dpy, &e);
+            if (pred(e)) return true;
+        }
+
+        double left = deadline - now_us();
+        if (left <= 0) return false;
+
+        struct pollfd pfd;
+        pfd.fd = ConnectionNumber(dpy);
+        pfd.events = POLLIN;
+        poll(&pfd, 1, (int)(left / 1000.0) + 1);
+    }
+}
+
+static void drain_events() {
+    XSync(dpy, False);
+    while (XPending(dpy)) {
+        XEvent e;
+        XNextEvent(dpy, &e);
+    }
+}
+
+static bool ipc_request(uint32_t type, const std::string &payload, std::string &reply) {
+    std::string path = nwm::ipc_socket_path();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return false;
+    }
+
+    nwm::IpcHeader header;
+    header.length = payload.size();
+    header.type = type;
+    std::string msg((const char*)&header, sizeof(header));
+    msg += payload;
+
+    bool ok = write(fd, msg.data(), msg.size()) == (ssize_t)msg.size();
+    size_t got = 0;
+    while (ok && got < sizeof(header)) {
+        ssize_t n = read(fd, (char*)&header + got, sizeof(header) - got);
+        if (n <= 0) ok = false;
+        else got += n;
+    }
+    if (ok) {
+        reply.assign(header.length, '\0');
+        got = 0;
+        while (ok && got < reply.size()) {
+            ssize_t n = read(fd, &reply[got], reply.size() - got);
+            if (n <= 0) ok = false;
+            else got += n;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+static long wm_requests() {
+    std::string tree;
+    if (!ipc_request(nwm::IPC_GET_TREE, "", tree)) return -1;
+    size_t pos = tree.find("\"x_requests\":");
+    if (pos == std::string::npos) return -1;
+    return strtol(tree.c_str() + pos + 13, NULL, 10);
+}
+
+static void settle() {
+    usleep(SETTLE_MS * 1000);
+    drain_events();
+}
+
+static Window create_client(int i) {
+    XSetWindowAttributes attrs;
+    attrs.background_pixel = BlackPixel(dpy, DefaultScreen(dpy));
+    attrs.event_mask = StructureNotifyMask | FocusChangeMask;
+    Window w = XCreateWindow(dpy, root, 0, 0, 300, 200, 0, CopyFromParent,
+                             InputOutput, CopyFromParent, CWBackPixel | CWEventMask, &attrs);
+
+    char name[32];
+    snprintf(name, sizeof(name), "wmbench-%d", i);
+    XStoreName(dpy, w, name);
+    XClassHint hint;
+    hint.res_name = name;
+    hint.res_class = (char*)"wmbench";
+    XSetClassHint(dpy, w, &hint);
+    return w;
+}
+
+static void set_desktop(int desktop) {
+    XEvent e;
+    memset(&e, 0, sizeof(e));
+    e.xclient.type = ClientMessage;
+    e.xclient.window = root;
+    e.xclient.message_type = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+    e.xclient.format = 32;
+    e.xclient.data.l[0] = desktop;
+    e.xclient.data.l[1] = CurrentTime;
+    XSendEvent(dpy, root, False, SubstructureRedirectMask | SubstructureNotifyMask, &e);
+}
+
+static bool is_event(const XEvent &e, int type, Window w) {
+    return e.type == type && e.xany.window == w;
+}
+
+static void record(Phase &phase, double start, bool ok) {
+    if (ok) {
+        phase.latency_us.push_back(now_us() - start);
+    } else {
+        phase.timeouts++;
+    }
+}
+
+static void phase_map(Phase &phase, std::vector<Window> &windows, int count) {
+    for (int i = 0; i < count; ++i) {
+        Window w = create_client(i);
+        windows.push_back(w);
+        XSync(dpy, False);
+
+        double start = now_us();
+        XMapWindow(dpy, w);
+        record(phase, start, wait_event([w](const XEvent &e) {
+            return is_event(e, MapNotify, w);
+        }, WAIT_TIMEOUT_MS));
+    }
+}
+
+static void phase_configure(Phase &phase, const std::vector<Window> &windows, int rounds) {
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < windows.size(); ++i) {
+            Window w = windows[i];
+            double start = now_us();
+            XMoveResizeWindow(dpy, w, 10 + r, 10 + (int)i, 200 + r, 150 + (int)i);
+            record(phase, start, wait_event([w](const XEvent &e) {
+                return is_event(e, ConfigureNotify, w);
+            }, WAIT_TIMEOUT_MS));
+        }
+    }
+}
+
+static void phase_focus(Phase &phase, const std::vector<Window> &windows, int rounds) {
+    std::string reply;
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < windows.size(); ++i) {
+            // The last mapped window holds focus after phase_map, so cycling
+            // from the first one always moves focus to a different window.
+            Window w = windows[i];
+            char cmd[64];
+            snprintf(cmd, sizeof(cmd), "focus 0x%lx", w);
+
+            double start = now_us();
+            if (!ipc_request(nwm::IPC_COMMAND, cmd, reply)) {
+                phase.timeouts++;
+                continue;
+            }
+            record(phase, start, wait_event([w](const XEvent &e) {
+                return is_event(e, FocusIn, w);
+            }, WAIT_TIMEOUT_MS));
+        }
+    }
+}
+
+static void phase_workspace(Phase &phase, const std::vector<Window> &windows, int rounds) {
+    Window probe = windows[0];
+    for (int r = 0; r < rounds; ++r) {
+        for (int desktop = 1; desktop >= 0; --desktop) {
+            int type = desktop ? UnmapNotify : MapNotify;
+            double start = now_us();
+            set_desktop(desktop);
+            record(phase, start, wait_event([probe, type](const XEvent &e) {
+                return is_event(e, type, probe);
+            }, WAIT_TIMEOUT_MS));
+        }
+    }
+}
+
+static void phase_unmap(Phase &phase, std::vector<Window> &windows) {
+    while (!windows.empty()) {
+        Window w = windows.back();
+        windows.pop_back();
+
+        double start = now_us();
+        XDestroyWindow(dpy, w);
+        if (windows.empty()) {
+            XSync(dpy, False);
+            break;
+        }
+
+        // The WM answers a closed client by retiling the remaining ones.
+        const std::vector<Window> &rest = windows;
+        record(phase, start, wait_event([&rest](const XEvent &e) {
+            return e.type == ConfigureNotify &&
+                   std::find(rest.begin(), rest.end(), e.xconfigure.window) != rest.end();
+        }, WAIT_TIMEOUT_MS));
+    }
+}
+
+static double percentile(std::vector<double> &v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+static void report(Phase &phase) {
+    size_t ops = phase.latency_us.size() + phase.timeouts;
+    double p50 = percentile(phase.latency_us, 0.50);
+    double p99 = percentile(phase.latency_us, 0.99);
+    double max = phase.latency_us.empty() ? 0 : phase.latency_us.back();
+
+    printf("%-12s %6zu %10.1f %10.1f %10.1f %9d", phase.name, ops, p50, p99, max, phase.timeouts);
+    if (phase.requests >= 0 && ops) {
+        printf(" %10.1f\n", (double)phase.requests / ops);
+    } else {
+        printf(" %10s\n", "-");
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 50;
+    int rounds = 10;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: wmbench [-n windows] [-r rounds]\n");
+            return 2;
+        }
+    }
+    if (count < 2) count = 2;
+    if (rounds < 1) rounds = 1;
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        fprintf(stderr, "wmbench: cannot open display\n");
+        return 1;
+    }
+    root = DefaultRootWindow(dpy);
+
+    if (wm_requests() < 0) {
+        fprintf(stderr, "wmbench: nwm IPC socket %s not answering\n", nwm::ipc_socket_path().c_str());
+        return 1;
+    }
+
+    Phase phases[] = {
+        { "map", {}, 0, 0 },
+        { "configure", {}, 0, 0 },
+        { "focus", {}, 0, 0 },
+        { "workspace", {}, 0, 0 },
+        { "unmap", {}, 0, 0 },
+    };
+
+    std::vector<Window> windows;
+    for (size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i) {
+        Phase &phase = phases[i];
+        long before = wm_requests();
+
+        switch (i) {
+            case 0: phase_map(phase, windows, count); break;
+            case 1: phase_configure(phase, windows, rounds); break;
+            case 2: phase_focus(phase, windows, rounds); break;
+            case 3: phase_workspace(phase, windows, rounds); break;
+            default: phase_unmap(phase, windows); break;
+        }
+
+        settle();
+        long after = wm_requests();
+        phase.requests = (before >= 0 && after >= 0) ? after - before : -1;
+    }
+
+    printf("%d windows, %d rounds; latency from client request to the WM's answer\n", count, rounds);
+    printf("%-12s %6s %10s %10s %10s %9s %10s\n",
+           "phase", "ops", "p50 us", "p99 us", "max us", "timeouts", "wm req/op");
+    for (Phase &phase : phases) {
+        report(phase);
+    }
+
+    XCloseDisplay(dpy);
+
+    for (Phase &phase : phases) {
+        if (phase.timeouts) return 1;
+    }
+    return 0;
+}
@@ -22,6 +22,7 @@ stdenv.mkDerivation (finalAttrs: {
     xorg.libXft
     xorg.libXrender
     xorg.libXrandr
+    xorg.libxcb
     freetype
     fontconfig
   ];
@@ -0,0 +1,54 @@
+#include "atoms.hpp"
+
+Atom nwm::atom_table[ATOM_COUNT];
+
+static const char *atom_names[nwm::ATOM_COUNT] = {
+    "WM_PROTOCOLS",
+    "WM_DELETE_WINDOW",
+    "MANAGER",
+    "UTF8_STRING",
+
+    "_NET_SUPPORTED",
+    "_NET_SUPPORTING_WM_CHECK",
+    "_NET_WM_NAME",
+    "_NET_ACTIVE_WINDOW",
+    "_NET_CLIENT_LIST",
+    "_NET_CLIENT_LIST_STACKING",
+    "_NET_NUMBER_OF_DESKTOPS",
+    "_NET_CURRENT_DESKTOP",
+    "_NET_WM_DESKTOP",
+
+    "_NET_WM_STATE",
+    "_NET_WM_STATE_FULLSCREEN",
+    "_NET_WM_STATE_MODAL",
+    "_NET_WM_STATE_ABOVE",
+    "_NET_WM_STATE_SKIP_TASKBAR",
+    "_NET_WM_STATE_SKIP_PAGER",
+
+    "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_WINDOW_TYPE_DIALOG",
+    "_NET_WM_WINDOW_TYPE_SPLASH",
+    "_NET_WM_WINDOW_TYPE_UTILITY",
+    "_NET_WM_WINDOW_TYPE_DOCK",
+    "_NET_WM_WINDOW_TYPE_DESKTOP",
+    "_NET_WM_WINDOW_TYPE_NOTIFICATION",
+    "_NET_WM_WINDOW_TYPE_TOOLTIP",
+    "_NET_WM_WINDOW_TYPE_COMBO",
+    "_NET_WM_WINDOW_TYPE_DND",
+    "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU",
+    "_NET_WM_WINDOW_TYPE_POPUP_MENU",
+
+    "_NET_SYSTEM_TRAY_OPCODE",
+    "_NET_SYSTEM_TRAY_ORIENTATION",
+    "_NET_SYSTEM_TRAY_VISUAL",
+    "_XEMBED",
+    "_XEMBED_INFO",
+
+    "_NWM_WORKSPACE",
+    "_NWM_FLOATING",
+    "_NWM_FULLSCREEN",
+};
+
+void nwm::atoms_init(Display *display) {
+    XInternAtoms(display, const_cast<char **>(atom_names), ATOM_COUNT, False, atom_table);
+}
@@ -0,0 +1,69 @@
+#ifndef ATOMS_HPP
+#define ATOMS_HPP
+
+#include <X11/Xlib.h>
+
+namespace nwm {
+
+enum AtomId {
+    WM_PROTOCOLS,
+    WM_DELETE_WINDOW,
+    MANAGER,
+    UTF8_STRING,
+
+    NET_SUPPORTED,
+    NET_SUPPORTING_WM_CHECK,
+    NET_WM_NAME,
+    NET_ACTIVE_WINDOW,
+    NET_CLIENT_LIST,
+    NET_CLIENT_LIST_STACKING,
+    NET_NUMBER_OF_DESKTOPS,
+    NET_CURRENT_DESKTOP,
+    NET_WM_DESKTOP,
+
+    NET_WM_STATE,
+    NET_WM_STATE_FULLSCREEN,
+    NET_WM_STATE_MODAL,
+    NET_WM_STATE_ABOVE,
+    NET_WM_STATE_SKIP_TASKBAR,
+    NET_WM_STATE_SKIP_PAGER,
+
+    NET_WM_WINDOW_TYPE,
+    NET_WM_WINDOW_TYPE_DIALOG,
+    NET_WM_WINDOW_TYPE_SPLASH,
+    NET_WM_WINDOW_TYPE_UTILITY,
+    NET_WM_WINDOW_TYPE_DOCK,
+    NET_WM_WINDOW_TYPE_DESKTOP,
+    NET_WM_WINDOW_TYPE_NOTIFICATION,
+    NET_WM_WINDOW_TYPE_TOOLTIP,
+    NET_WM_WINDOW_TYPE_COMBO,
+    NET_WM_WINDOW_TYPE_DND,
+    NET_WM_WINDOW_TYPE_DROPDOWN_MENU,
+    NET_WM_WINDOW_TYPE_POPUP_MENU,
+
+    NET_SYSTEM_TRAY_OPCODE,
+    NET_SYSTEM_TRAY_ORIENTATION,
+    NET_SYSTEM_TRAY_VISUAL,
+    XEMBED,
+    XEMBED_INFO,
+
+    NWM_WORKSPACE,
+    NWM_FLOATING,
+    NWM_FULLSCREEN,
+
+    ATOM_COUNT
+};
+
+extern Atom atom_table[ATOM_COUNT];
+
+// Interns every atom in a single round trip. Must run before anything
+// reads from the table.
+void atoms_init(Display *display);
+
+inline Atom atom(AtomId id) {
+    return atom_table[id];
+}
+
+}
+
+#endif // ATOMS_HPP
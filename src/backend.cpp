@@ -0,0 +1,211 @@
+#include "backend.hpp"
+#include "nwm.hpp"
+#include <algorithm>
+#include <cstring>
+
+static void xlib_configure(nwm::Base &base, Window window, unsigned int mask, XWindowChanges *changes) {
+    XConfigureWindow(base.display, window, mask, changes);
+}
+
+static void xlib_map(nwm::Base &base, Window window) {
+    XMapWindow(base.display, window);
+}
+
+static void xlib_unmap(nwm::Base &base, Window window) {
+    XUnmapWindow(base.display, window);
+}
+
+static void xlib_raise(nwm::Base &base, Window window) {
+    XRaiseWindow(base.display, window);
+}
+
+static void xlib_restack(nwm::Base &base, Window *windows, int count) {
+    XRestackWindows(base.display, windows, count);
+}
+
+static void xlib_set_border(nwm::Base &base, Window window, unsigned long pixel) {
+    XSetWindowBorder(base.display, window, pixel);
+}
+
+static void xlib_set_focus(nwm::Base &base, Window window) {
+    XSetInputFocus(base.display, window ? window : base.root, RevertToPointerRoot, CurrentTime);
+}
+
+static void xlib_select_input(nwm::Base &base, Window window, long mask) {
+    XSetWindowAttributes attrs;
+    attrs.event_mask = mask;
+    XChangeWindowAttributes(base.display, window, CWEventMask, &attrs);
+}
+
+static void xlib_change_property(nwm::Base &base, Window window, Atom property, Atom type,
+                                 int format, int mode, const unsigned char *data, int count) {
+    XChangeProperty(base.display, window, property, type, format, mode, data, count);
+}
+
+static void xlib_delete_property(nwm::Base &base, Window window, Atom property) {
+    XDeleteProperty(base.display, window, property);
+}
+
+static void xlib_query_tree(nwm::Base &base, std::vector<Window> &children) {
+    Window root_return, parent_return;
+    Window *list;
+    unsigned int count;
+    children.clear();
+    if (XQueryTree(base.display, base.root, &root_return, &parent_return, &list, &count)) {
+        children.assign(list, list + count);
+        if (list) XFree(list);
+    }
+}
+
+static void xlib_flush(nwm::Base &base) {
+    XFlush(base.display);
+}
+
+const nwm::DisplayBackend nwm::xlib_backend = {
+    xlib_configure,
+    xlib_map,
+    xlib_unmap,
+    xlib_raise,
+    xlib_restack,
+    xlib_set_border,
+    xlib_set_focus,
+    xlib_select_input,
+    xlib_change_property,
+    xlib_delete_property,
+    xlib_query_tree,
+    xlib_flush,
+};
+
+static nwm::FakeWindow& fake_window(nwm::FakeDisplay &fake, Window window) {
+    auto it = fake.windows.find(window);
+    if (it != fake.windows.end()) return it->second;
+
+    nwm::FakeWindow &w = fake.windows[window];
+    memset(&w, 0, sizeof(w));
+    fake.stack.push_back(window);
+    return w;
+}
+
+static void fake_record(nwm::Base &base, nwm::FakeOpKind kind, Window window) {
+    nwm::FakeDisplay &fake = *base.fake;
+    fake.counts[kind]++;
+    if (fake.record_ops) {
+        fake.ops.push_back(nwm::FakeOp{kind, window});
+    }
+}
+
+static void fake_configure(nwm::Base &base, Window window, unsigned int mask, XWindowChanges *changes) {
+    fake_record(base, nwm::FAKE_CONFIGURE, window);
+    nwm::FakeWindow &w = fake_window(*base.fake, window);
+    if (mask & CWX) w.x = changes->x;
+    if (mask & CWY) w.y = changes->y;
+    if (mask & CWWidth) w.width = changes->width;
+    if (mask & CWHeight) w.height = changes->height;
+    if (mask & CWBorderWidth) w.border_width = changes->border_width;
+}
+
+static void fake_map(nwm::Base &base, Window window) {
+    fake_record(base, nwm::FAKE_MAP, window);
+    fake_window(*base.fake, window).mapped = true;
+}
+
+static void fake_unmap(nwm::Base &base, Window window) {
+    fake_record(base, nwm::FAKE_UNMAP, window);
+    fake_window(*base.fake, window).mapped = false;
+}
+
+static void fake_raise(nwm::Base &base, Window window) {
+    fake_record(base, nwm::FAKE_RAISE, window);
+    nwm::FakeDisplay &fake = *base.fake;
+    fake_window(fake, window);
+    auto it = std::find(fake.stack.begin(), fake.stack.end(), window);
+    fake.stack.erase(it);
+    fake.stack.push_back(window);
+}
+
+static void fake_restack(nwm::Base &base, Window *windows, int count) {
+    fake_record(base, nwm::FAKE_RESTACK, count > 0 ? windows[0] : None);
+    nwm::FakeDisplay &fake = *base.fake;
+    if (count < 2) return;
+
+    for (int i = 0; i < count; ++i) fake_window(fake, windows[i]);
+    for (int i = 1; i < count; ++i) {
+        fake.stack.erase(std::find(fake.stack.begin(), fake.stack.end(), windows[i]));
+    }
+    auto top = std::find(fake.stack.begin(), fake.stack.end(), windows[0]);
+    // Bottom-to-top storage: the windows that go beneath windows[0] are
+    // inserted just before it, lowest last.
+    fake.stack.insert(top, std::reverse_iterator<Window*>(windows + count),
+                      std::reverse_iterator<Window*>(windows + 1));
+}
+
+static void fake_set_border(nwm::Base &base, Window window, unsigned long pixel) {
+    fake_record(base, nwm::FAKE_BORDER, window);
+    fake_window(*base.fake, window).border_pixel = pixel;
+}
+
+static void fake_set_focus(nwm::Base &base, Window window) {
+    fake_record(base, nwm::FAKE_FOCUS, window);
+    base.fake->focus = window;
+}
+
+static void fake_select_input(nwm::Base &base, Window window, long mask) {
+    fake_record(base, nwm::FAKE_SELECT_INPUT, window);
+    fake_window(*base.fake, window).event_mask = mask;
+}
+
+static void fake_change_property(nwm::Base &base, Window window, Atom property, Atom type,
+                                 int format, int mode, const unsigned char *data, int count) {
+    (void)property;
+    (void)type;
+    (void)format;
+    (void)mode;
+    (void)data;
+    (void)count;
+    fake_record(base, nwm::FAKE_PROPERTY, window);
+}
+
+static void fake_delete_property(nwm::Base &base, Window window, Atom property) {
+    (void)property;
+    fake_record(base, nwm::FAKE_PROPERTY, window);
+}
+
+static void fake_query_tree(nwm::Base &base, std::vector<Window> &children) {
+    fake_record(base, nwm::FAKE_QUERY_TREE, None);
+    children = base.fake->stack;
+}
+
+static void fake_flush(nwm::Base &base) {
+    fake_record(base, nwm::FAKE_FLUSH, None);
+}
+
+const nwm::DisplayBackend nwm::fake_backend = {
+    fake_configure,
+    fake_map,
+    fake_unmap,
+    fake_raise,
+    fake_restack,
+    fake_set_border,
+    fake_set_focus,
+    fake_select_input,
+    fake_change_property,
+    fake_delete_property,
+    fake_query_tree,
+    fake_flush,
+};
+
+void nwm::fake_display_reset(FakeDisplay &fake) {
+    fake.windows.clear();
+    fake.stack.clear();
+    fake.focus = None;
+    memset(fake.counts, 0, sizeof(fake.counts));
+    fake.ops.clear();
+}
+
+unsigned long nwm::fake_display_requests(const FakeDisplay &fake) {
+    unsigned long total = 0;
+    for (int i = 0; i < FAKE_OP_COUNT; ++i) {
+        if (i != FAKE_FLUSH) total += fake.counts[i];
+    }
+    return total;
+}
@@ -0,0 +1,86 @@
+#ifndef BACKEND_HPP
+#define BACKEND_HPP
+
+#include <X11/Xlib.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace nwm {
+
+struct Base;
+
+// Window operations the layout, focus and workspace code performs. The WM
+// runs on xlib_backend; fake_backend applies them to a FakeDisplay in memory
+// so that code can be driven and measured without an X server.
+struct DisplayBackend {
+    void (*configure)(Base &base, Window window, unsigned int mask, XWindowChanges *changes);
+    void (*map)(Base &base, Window window);
+    void (*unmap)(Base &base, Window window);
+    void (*raise)(Base &base, Window window);
+    // XRestackWindows semantics: windows[0] keeps its place, the rest go
+    // directly beneath it in order.
+    void (*restack)(Base &base, Window *windows, int count);
+    void (*set_border)(Base &base, Window window, unsigned long pixel);
+    // None focuses the root window.
+    void (*set_focus)(Base &base, Window window);
+    void (*select_input)(Base &base, Window window, long mask);
+    // mode is PropModeReplace or PropModeAppend.
+    void (*change_property)(Base &base, Window window, Atom property, Atom type,
+                            int format, int mode, const unsigned char *data, int count);
+    void (*delete_property)(Base &base, Window window, Atom property);
+    // The root's children, bottom to top. A round trip on the Xlib backend.
+    void (*query_tree)(Base &base, std::vector<Window> &children);
+    void (*flush)(Base &base);
+};
+
+extern const DisplayBackend xlib_backend;
+extern const DisplayBackend fake_backend;
+
+enum FakeOpKind {
+    FAKE_CONFIGURE,
+    FAKE_MAP,
+    FAKE_UNMAP,
+    FAKE_RAISE,
+    FAKE_RESTACK,
+    FAKE_BORDER,
+    FAKE_FOCUS,
+    FAKE_SELECT_INPUT,
+    FAKE_PROPERTY,
+    FAKE_QUERY_TREE,
+    FAKE_FLUSH,
+    FAKE_OP_COUNT
+};
+
+struct FakeOp {
+    FakeOpKind kind;
+    Window window;
+};
+
+struct FakeWindow {
+    bool mapped;
+    int x, y;
+    int width, height;
+    int border_width;
+    unsigned long border_pixel;
+    long event_mask;
+};
+
+struct FakeDisplay {
+    std::unordered_map<Window, FakeWindow> windows;
+    // Bottom to top.
+    std::vector<Window> stack;
+    Window focus;
+    unsigned long counts[FAKE_OP_COUNT];
+    // Every operation in order, when record_ops is set.
+    bool record_ops;
+    std::vector<FakeOp> ops;
+};
+
+void fake_display_reset(FakeDisplay &fake);
+// Sum of counts, excluding flushes: what the Xlib backend would have sent.
+unsigned long fake_display_requests(const FakeDisplay &fake);
+
+}
+
+#endif // BACKEND_HPP
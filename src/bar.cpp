@@ -1,16 +1,15 @@
 #include "bar.hpp"
-#include "nwm.hpp"
+#include "atoms.hpp"
 #include <ctime>
 #include <sstream>
 #include <iomanip>
-#include <fstream>
 #include <X11/Xlib.h>
 #include <sys/utsname.h>
-#include <sys/statvfs.h>
 #include <unistd.h>
 #include <cstring>
+#include <algorithm>
+#include <cctype>
 
-#define BAR_HEIGHT 30
 #define BAR_BG_COLOR 0x181818
 #define BAR_FG_COLOR 0xCCCCCC
 #define BAR_ACTIVE_COLOR 0x005577
@@ -24,172 +23,35 @@
 #define ITEM_SPACING 10
 #define SEGMENT_PADDING 18
 
-static unsigned long last_cpu_total = 0;
-static unsigned long last_cpu_idle = 0;
-static auto last_net_time = std::chrono::steady_clock::now();
-static unsigned long long last_rx_bytes = 0;
-static unsigned long long last_tx_bytes = 0;
-
-float nwm::get_cpu_usage() {
-    std::ifstream stat_file("/proc/stat");
-    if (!stat_file.is_open()) return 0.0f;
-
-    std::string line;
-    std::getline(stat_file, line);
-    stat_file.close();
-
-    unsigned long user, nice, system, idle, iowait, irq, softirq, steal;
-    sscanf(line.c_str(), "cpu %lu %lu %lu %lu %lu %lu %lu %lu",
-           &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
-
-    unsigned long total = user + nice + system + idle + iowait + irq + softirq + steal;
-
-    unsigned long total_diff = total - last_cpu_total;
-    unsigned long idle_diff = idle - last_cpu_idle;
-
-    last_cpu_total = total;
-    last_cpu_idle = idle;
-
-    if (total_diff == 0) return 0.0f;
-
-    float usage = 100.0f * (total_diff - idle_diff) / total_diff;
-    return usage;
-}
-
-float nwm::get_memory_usage() {
-    std::ifstream meminfo("/proc/meminfo");
-    if (!meminfo.is_open()) return 0.0f;
-
-    unsigned long mem_total = 0, mem_free = 0, buffers = 0, cached = 0;
-    std::string line;
-
-    while (std::getline(meminfo, line)) {
-        if (line.find("MemTotal:") == 0) {
-            sscanf(line.c_str(), "MemTotal: %lu kB", &mem_total);
-        } else if (line.find("MemFree:") == 0) {
-            sscanf(line.c_str(), "MemFree: %lu kB", &mem_free);
-        } else if (line.find("Buffers:") == 0) {
-            sscanf(line.c_str(), "Buffers: %lu kB", &buffers);
-        } else if (line.find("Cached:") == 0) {
-            sscanf(line.c_str(), "Cached: %lu kB", &cached);
-        }
-    }
-    meminfo.close();
-
-    if (mem_total == 0) return 0.0f;
-
-    unsigned long mem_used = mem_total - mem_free - buffers - cached;
-    return 100.0f * mem_used / mem_total;
-}
-
-float nwm::get_disk_usage(const char* path) {
-    struct statvfs stat;
-    if (statvfs(path, &stat) != 0) return 0.0f;
-
-    unsigned long total = stat.f_blocks * stat.f_frsize;
-    unsigned long available = stat.f_bavail * stat.f_frsize;
-    unsigned long used = total - available;
-
-    if (total == 0) return 0.0f;
-    return 100.0f * used / total;
-}
-
-void nwm::get_network_stats(std::string& rx, std::string& tx) {
-    std::ifstream net_dev("/proc/net/dev");
-    if (!net_dev.is_open()) {
-        rx = "0 KB/s";
-        tx = "0 KB/s";
-        return;
-    }
-
-    unsigned long long total_rx = 0, total_tx = 0;
-    std::string line;
-
-    std::getline(net_dev, line);
-    std::getline(net_dev, line);
-
-    while (std::getline(net_dev, line)) {
-        if (line.find("lo:") != std::string::npos) continue;
-
-        size_t colon = line.find(':');
-        if (colon == std::string::npos) continue;
-
-        unsigned long long rx_bytes, tx_bytes;
-        const char* data = line.c_str() + colon + 1;
-        sscanf(data, "%llu %*u %*u %*u %*u %*u %*u %*u %llu", &rx_bytes, &tx_bytes);
-
-        total_rx += rx_bytes;
-        total_tx += tx_bytes;
-    }
-    net_dev.close();
-
-    auto now = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_net_time).count();
-
-    if (duration > 0 && last_rx_bytes > 0) {
-        double rx_rate = (total_rx - last_rx_bytes) / (duration / 1000.0);
-        double tx_rate = (total_tx - last_tx_bytes) / (duration / 1000.0);
-
-        auto format_rate = [](double rate) -> std::string {
-            std::ostringstream oss;
-            if (rate < 1024) {
-                oss << std::fixed << std::setprecision(0) << rate << " B/s";
-            } else if (rate < 1024 * 1024) {
-                oss << std::fixed << std::setprecision(1) << rate / 1024 << " KB/s";
-            } else {
-                oss << std::fixed << std::setprecision(1) << rate / (1024 * 1024) << " MB/s";
-            }
-            return oss.str();
-        };
-
-        rx = format_rate(rx_rate);
-        tx = format_rate(tx_rate);
-    } else {
-        rx = "0 B/s";
-        tx = "0 B/s";
-    }
-
-    last_rx_bytes = total_rx;
-    last_tx_bytes = total_tx;
-    last_net_time = now;
+// The monitor this bar covers, or nullptr before the WM has published it.
+static const nwm::BarFeedMonitor* bar_monitor(const nwm::BarBase &base) {
+    if (base.monitor < 0 || base.monitor >= (int)base.state.monitor_count) return nullptr;
+    return &base.state.monitors[base.monitor];
 }
 
-void nwm::get_battery_info(std::string& status, int& percent) {
-    std::ifstream capacity_file("/sys/class/power_supply/BAT0/capacity");
-    std::ifstream status_file("/sys/class/power_supply/BAT0/status");
+static void bar_place(nwm::BarBase &base) {
+    const nwm::BarFeedMonitor *mon = bar_monitor(base);
+    int x = mon ? mon->x : 0;
+    int y = mon ? mon->y : 0;
+    int width = mon ? (int)mon->width : DisplayWidth(base.display, base.screen);
+    int height = mon ? (int)mon->height : DisplayHeight(base.display, base.screen);
 
-    percent = -1;
-    status = "N/A";
-
-    if (capacity_file.is_open()) {
-        capacity_file >> percent;
-        capacity_file.close();
-    }
-
-    if (status_file.is_open()) {
-        status_file >> status;
-        status_file.close();
-    }
+    base.bar.x = x;
+    base.bar.width = width;
+    base.bar.y = base.state.bar_position == 1 ? y + height - base.bar.height : y;
 }
 
-void nwm::bar_init(Base &base) {
+void nwm::bar_init(BarBase &base) {
     base.bar.height = BAR_HEIGHT;
-    base.bar.width = WIDTH(base.display, base.screen);
-    base.bar.x = 0;
     base.bar.hover_segment = -1;
     base.bar.systray_width = 0;
-
-    if (base.bar_position == 1) {
-        base.bar.y = HEIGHT(base.display, base.screen) - BAR_HEIGHT;
-    } else {
-        base.bar.y = 0;
-    }
+    bar_place(base);
 
     XSetWindowAttributes attrs;
     attrs.background_pixel = BAR_BG_COLOR;
     attrs.override_redirect = True;
     attrs.event_mask = ExposureMask | ButtonPressMask | ButtonReleaseMask |
-                       PointerMotionMask | Button4 | Button5;
+                       PointerMotionMask | LeaveWindowMask;
 
     base.bar.window = XCreateWindow(
         base.display, base.root,
@@ -203,11 +65,29 @@ void nwm::bar_init(Base &base) {
         &attrs
     );
 
-    XMapWindow(base.display, base.bar.window);
-    XRaiseWindow(base.display, base.bar.window);
+    if (base.state.bar_visible) {
+        XMapWindow(base.display, base.bar.window);
+        XRaiseWindow(base.display, base.bar.window);
+    }
+
+    base.bar.buffer = XCreatePixmap(base.display, base.bar.window,
+                                    base.bar.width, base.bar.height,
+                                    DefaultDepth(base.display, base.screen));
+    XGCValues gcv;
+    gcv.graphics_exposures = False;
+    base.bar.gc = XCreateGC(base.display, base.bar.buffer, GCGraphicsExposures, &gcv);
+    XSetForeground(base.display, base.bar.gc, BAR_BG_COLOR);
+    XFillRectangle(base.display, base.bar.buffer, base.bar.gc,
+                   0, 0, base.bar.width, base.bar.height);
+
+    for (int i = 0; i < BAR_REGION_COUNT; ++i) {
+        base.bar.regions[i].x = 0;
+        base.bar.regions[i].width = 0;
+        base.bar.regions[i].dirty = true;
+    }
 
     base.bar.xft_draw = XftDrawCreate(
-        base.display, base.bar.window,
+        base.display, base.bar.buffer,
         DefaultVisual(base.display, base.screen),
         DefaultColormap(base.display, base.screen)
     );
@@ -233,11 +113,16 @@ void nwm::bar_init(Base &base) {
     create_color(BAR_CRITICAL_COLOR, base.bar.xft_critical);
     create_color(BAR_HOVER_COLOR, base.bar.xft_hover);
 
-    base.bar.sys_info.last_update = std::chrono::steady_clock::now();
-    bar_update_system_info(base);
+    base.bar.text_cache.font = nullptr;
+
+    memset(&base.bar.sys_info, 0, sizeof(base.bar.sys_info));
+    base.bar.sys_info.battery_percent = -1;
+    sampler_start(base.bar.sampler);
 }
 
-void nwm::bar_cleanup(Base &base) {
+void nwm::bar_cleanup(BarBase &base) {
+    sampler_stop(base.bar.sampler);
+
     if (base.bar.xft_draw) {
         XftDrawDestroy(base.bar.xft_draw);
         base.bar.xft_draw = nullptr;
@@ -257,28 +142,22 @@ void nwm::bar_cleanup(Base &base) {
     free_color(base.bar.xft_critical);
     free_color(base.bar.xft_hover);
 
+    if (base.bar.gc) {
+        XFreeGC(base.display, base.bar.gc);
+        base.bar.gc = nullptr;
+    }
+
+    if (base.bar.buffer) {
+        XFreePixmap(base.display, base.bar.buffer);
+        base.bar.buffer = 0;
+    }
+
     if (base.bar.window) {
         XDestroyWindow(base.display, base.bar.window);
         base.bar.window = 0;
     }
 }
 
-void nwm::bar_update_system_info(Base &base) {
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-        now - base.bar.sys_info.last_update).count();
-
-    if (elapsed < 2) return;
-
-    base.bar.sys_info.cpu_usage = get_cpu_usage();
-    base.bar.sys_info.memory_usage = get_memory_usage();
-    base.bar.sys_info.disk_usage = get_disk_usage("/");
-    get_network_stats(base.bar.sys_info.network_rx, base.bar.sys_info.network_tx);
-    get_battery_info(base.bar.sys_info.battery_status, base.bar.sys_info.battery_percent);
-
-    base.bar.sys_info.last_update = now;
-}
-
 void draw_rounded_rect(Display* display, Drawable drawable, GC gc,
                        int x, int y, int width, int height, int radius) {
     XFillArc(display, drawable, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64);
@@ -291,83 +170,113 @@ void draw_rounded_rect(Display* display, Drawable drawable, GC gc,
     XFillRectangle(display, drawable, gc, x + width - radius, y + radius, radius, height - radius * 2);
 }
 
-void nwm::bar_draw(Base &base) {
-    XClearWindow(base.display, base.bar.window);
-    base.bar.segments.clear();
+struct DamageSpan {
+    int x0, x1;
+};
+
+// Stores the region's new extent and content, marking it dirty if either
+// changed. The returned span covers both the old and the new extent so that
+// stale pixels are cleared when a region shrinks or moves.
+static DamageSpan update_region(nwm::BarRegion &region, int x, int width,
+                                const std::string &content) {
+    DamageSpan damage = { x, x + width };
+
+    if (region.x != x || region.width != width || region.content != content) {
+        region.dirty = true;
+    }
+    if (region.dirty && region.width > 0) {
+        damage.x0 = std::min(damage.x0, region.x);
+        damage.x1 = std::max(damage.x1, region.x + region.width);
+    }
+
+    region.x = x;
+    region.width = width;
+    region.content = content;
+    return damage;
+}
+
+// If old and new differ only in digits at the same positions, returns the
+// first and last changed character. Digits sit in fixed-width cells, so
+// only those cells need repainting.
+static bool digits_changed(const std::string &old_text, const std::string &new_text,
+                           int &first, int &last) {
+    if (old_text.size() != new_text.size()) return false;
+
+    first = -1;
+    last = -1;
+    for (size_t i = 0; i < new_text.size(); ++i) {
+        if (old_text[i] == new_text[i]) continue;
+        if (!isdigit((unsigned char)old_text[i]) || !isdigit((unsigned char)new_text[i])) {
+            return false;
+        }
+        if (first < 0) first = i;
+        last = i;
+    }
+    return first >= 0;
+}
 
+struct WorkspaceButton {
+    std::string label;
+    const nwm::TextRun *run;
+    int x, width;
+    bool active, has_windows, hover;
+};
+
+void nwm::bar_draw(BarBase &base) {
     if (!base.xft_font || !base.bar.xft_draw) return;
 
-    int x_offset = PADDING;
+    StatusBar &bar = base.bar;
     int y_offset = BAR_HEIGHT / 2 + 6;
+    int btn_height = BAR_HEIGHT - 8;
+    int btn_y = 4;
 
-    GC gc = XCreateGC(base.display, base.bar.window, 0, nullptr);
-
-    for (size_t i = 0; i < base.workspaces.size(); ++i) {
-        std::string ws_label = base.widget[i % base.widget.size()];
-
-        XGlyphInfo extents;
-        XftTextExtentsUtf8(base.display, base.xft_font,
-                          (XftChar8*)ws_label.c_str(), ws_label.length(),
-                          &extents);
-
-        int btn_width = extents.width + 16;
-        int btn_height = BAR_HEIGHT - 8;
-        int btn_x = x_offset;
-        int btn_y = 4;
-
-        bool is_active = (i == base.current_workspace);
-        bool has_windows = !base.workspaces[i].windows.empty();
-        bool is_hover = (base.bar.hover_segment >= 0 &&
-                        base.bar.segments.size() > (size_t)base.bar.hover_segment &&
-                        base.bar.segments[base.bar.hover_segment].workspace_index == (int)i);
-
-        if (is_hover && !is_active) {
-            XSetForeground(base.display, gc, BAR_HOVER_COLOR);
-            draw_rounded_rect(base.display, base.bar.window, gc,
-                            btn_x, btn_y, btn_width, btn_height, 4);
-        } else if (is_active) {
-            XSetForeground(base.display, gc, 0x444444);
-            draw_rounded_rect(base.display, base.bar.window, gc,
-                            btn_x, btn_y, btn_width, btn_height, 4);
-        } else if (has_windows) {
-            XSetForeground(base.display, gc, 0x2A2A2A);
-            draw_rounded_rect(base.display, base.bar.window, gc,
-                            btn_x, btn_y, btn_width, btn_height, 4);
-        }
+    text_cache_trim(bar.text_cache);
 
-        XftColor *color = is_active ? &base.bar.xft_active :
-                         (has_windows ? &base.bar.xft_fg : &base.bar.xft_inactive);
+    // Lay out every region and derive its content key. Nothing is drawn yet.
+    const BarFeedMonitor *mon = bar_monitor(base);
+    uint32_t shown = mon ? mon->workspace : base.state.current_workspace;
 
-        XftDrawStringUtf8(base.bar.xft_draw, color, base.xft_font,
-                         btn_x + 8, y_offset,
-                         (XftChar8*)ws_label.c_str(), ws_label.length());
+    std::vector<WorkspaceButton> buttons;
+    buttons.reserve(base.state.workspace_count);
+    std::string ws_content;
 
+    int x_offset = PADDING;
+    for (size_t i = 0; i < base.state.workspace_count; ++i) {
+        WorkspaceButton btn;
+        btn.label.assign(base.state.labels[i], strnlen(base.state.labels[i], BAR_FEED_LABEL_MAX));
+        btn.x = x_offset;
+        btn.run = &text_run(bar.text_cache, base.display, base.xft_font, btn.label);
+        btn.width = btn.run->width + 16;
+        btn.active = (i == shown);
+        btn.has_windows = (base.state.occupied >> i) & 1;
+        btn.hover = (bar.hover_segment == (int)i);
+        buttons.push_back(btn);
+
+        ws_content += btn.label;
+        ws_content += (char)('0' + (btn.active << 2 | btn.has_windows << 1 | btn.hover));
+
+        x_offset += btn.width + ITEM_SPACING;
+    }
+    int ws_end = buttons.empty() ? PADDING : buttons.back().x + buttons.back().width;
+
+    bar.segments.clear();
+    for (size_t i = 0; i < buttons.size(); ++i) {
         BarSegment seg;
-        seg.x = btn_x;
+        seg.x = buttons[i].x;
         seg.y = btn_y;
-        seg.width = btn_width;
+        seg.width = buttons[i].width;
         seg.height = btn_height;
         seg.workspace_index = i;
         seg.type = BarSegment::WORKSPACE;
-        base.bar.segments.push_back(seg);
-
-        x_offset += btn_width + ITEM_SPACING;
+        bar.segments.push_back(seg);
     }
 
     x_offset += SEGMENT_PADDING;
 
-    Monitor *mon = get_current_monitor(base);
     std::string layout_mode = (mon && mon->horizontal_mode) ? "[SCROLL]" : "[TILE]";
-
-    XftDrawStringUtf8(base.bar.xft_draw, &base.bar.xft_accent, base.xft_font,
-                     x_offset, y_offset,
-                     (XftChar8*)layout_mode.c_str(), layout_mode.length());
-
-    XGlyphInfo layout_ext;
-    XftTextExtentsUtf8(base.display, base.xft_font,
-                      (XftChar8*)layout_mode.c_str(), layout_mode.length(),
-                      &layout_ext);
-    x_offset += layout_ext.width + SEGMENT_PADDING;
+    int layout_x = x_offset;
+    const TextRun &layout_run = text_run(bar.text_cache, base.display, base.xft_font, layout_mode);
+    int layout_width = layout_run.width;
 
     time_t now = time(nullptr);
     tm* local = localtime(&now);
@@ -376,75 +285,213 @@ void nwm::bar_draw(Base &base) {
                 << "  " << std::put_time(local, "%a %b %d");
     std::string time_str = time_stream.str();
 
-    XGlyphInfo time_extents;
-    XftTextExtentsUtf8(base.display, base.xft_font,
-                      (XftChar8*)time_str.c_str(), time_str.length(),
-                      &time_extents);
+    const TextRun &time_run = text_run(bar.text_cache, base.display, base.xft_font, time_str);
+    int time_width = time_run.width;
+    int time_x = (bar.width - time_width) / 2;
 
-    int time_x = (base.bar.width - time_extents.width) / 2;
-    XftDrawStringUtf8(base.bar.xft_draw, &base.bar.xft_fg, base.xft_font,
-                     time_x, y_offset,
-                     (XftChar8*)time_str.c_str(), time_str.length());
+    std::string sys_str = bar.sys_info.summary;
 
-    std::ostringstream sys_stream;
-    sys_stream << std::fixed << std::setprecision(0);
+    int sys_width = text_cells(bar.text_cache, base.display, base.xft_font, sys_str,
+                               bar.sys_glyphs, bar.sys_bounds);
+    int sys_x = bar.width - sys_width - PADDING - bar.systray_width;
 
-    sys_stream << "CPU " << base.bar.sys_info.cpu_usage << "%";
+    XftColor* sys_color = &bar.xft_fg;
+    if (bar.sys_info.level == 2) {
+        sys_color = &bar.xft_critical;
+    } else if (bar.sys_info.level == 1) {
+        sys_color = &bar.xft_warning;
+    }
+    char sys_level = (char)('0' + bar.sys_info.level);
+
+    DamageSpan damage[BAR_REGION_COUNT];
+    damage[BAR_REGION_WORKSPACES] = update_region(bar.regions[BAR_REGION_WORKSPACES],
+                                                  PADDING, ws_end - PADDING, ws_content);
+    damage[BAR_REGION_LAYOUT] = update_region(bar.regions[BAR_REGION_LAYOUT],
+                                              layout_x, layout_width, layout_mode);
+    damage[BAR_REGION_TIME] = update_region(bar.regions[BAR_REGION_TIME],
+                                            time_x, time_width, time_str);
+
+    BarRegion &sys_region = bar.regions[BAR_REGION_SYSINFO];
+    std::string sys_content = sys_str + sys_level;
+    int first_cell, last_cell;
+    bool partial[BAR_REGION_COUNT] = {};
+    partial[BAR_REGION_SYSINFO] = !sys_region.dirty && sys_region.x == sys_x &&
+                                  sys_region.width == sys_width &&
+                                  digits_changed(sys_region.content, sys_content,
+                                                 first_cell, last_cell);
+    damage[BAR_REGION_SYSINFO] = update_region(sys_region, sys_x, sys_width, sys_content);
+    if (partial[BAR_REGION_SYSINFO]) {
+        damage[BAR_REGION_SYSINFO].x0 = sys_x + bar.sys_bounds[first_cell];
+        damage[BAR_REGION_SYSINFO].x1 = sys_x + bar.sys_bounds[last_cell + 1];
+    }
 
-    sys_stream << "  RAM " << base.bar.sys_info.memory_usage << "%";
+    // Clearing a damaged span wipes anything under it, so a clean region that
+    // overlaps one (the clock on a narrow screen, say) has to be redrawn too,
+    // in full.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < BAR_REGION_COUNT; ++i) {
+            if (!bar.regions[i].dirty) continue;
+            for (int j = 0; j < BAR_REGION_COUNT; ++j) {
+                BarRegion &other = bar.regions[j];
+                if (j == i || (other.dirty && !partial[j])) continue;
+                if (damage[i].x0 < other.x + other.width && other.x < damage[i].x1) {
+                    if (other.dirty) {
+                        damage[j].x0 = std::min(damage[j].x0, other.x);
+                        damage[j].x1 = std::max(damage[j].x1, other.x + other.width);
+                    }
+                    other.dirty = true;
+                    partial[j] = false;
+                    changed = true;
+                }
+            }
+        }
+    }
 
-    sys_stream << "  DISK " << base.bar.sys_info.disk_usage << "%";
+    bool any_dirty = false;
+    XSetForeground(base.display, bar.gc, BAR_BG_COLOR);
+    for (int i = 0; i < BAR_REGION_COUNT; ++i) {
+        if (!bar.regions[i].dirty) continue;
+        any_dirty = true;
+        XFillRectangle(base.display, bar.buffer, bar.gc,
+                       damage[i].x0, 0, damage[i].x1 - damage[i].x0, bar.height);
+    }
 
-    sys_stream << "  DOWN " << base.bar.sys_info.network_rx
-               << " UP " << base.bar.sys_info.network_tx;
+    if (!any_dirty) return;
+
+    if (bar.regions[BAR_REGION_WORKSPACES].dirty) {
+        for (const WorkspaceButton &btn : buttons) {
+            if (btn.hover && !btn.active) {
+                XSetForeground(base.display, bar.gc, BAR_HOVER_COLOR);
+                draw_rounded_rect(base.display, bar.buffer, bar.gc,
+                                btn.x, btn_y, btn.width, btn_height, 4);
+            } else if (btn.active) {
+                XSetForeground(base.display, bar.gc, 0x444444);
+                draw_rounded_rect(base.display, bar.buffer, bar.gc,
+                                btn.x, btn_y, btn.width, btn_height, 4);
+            } else if (btn.has_windows) {
+                XSetForeground(base.display, bar.gc, 0x2A2A2A);
+                draw_rounded_rect(base.display, bar.buffer, bar.gc,
+                                btn.x, btn_y, btn.width, btn_height, 4);
+            }
+
+            XftColor *color = btn.active ? &bar.xft_active :
+                             (btn.has_windows ? &bar.xft_fg : &bar.xft_inactive);
 
-    if (base.bar.sys_info.battery_percent >= 0) {
-        std::string bat_icon = base.bar.sys_info.battery_status == "Charging" ? "CHG" : "BAT";
-        sys_stream << "  " << bat_icon << " " << base.bar.sys_info.battery_percent << "%";
+            text_draw(bar.text_cache, bar.xft_draw, color, *btn.run, btn.x + 8, y_offset);
+        }
     }
 
-    std::string sys_str = sys_stream.str();
+    if (bar.regions[BAR_REGION_LAYOUT].dirty) {
+        text_draw(bar.text_cache, bar.xft_draw, &bar.xft_accent, layout_run, layout_x, y_offset);
+    }
 
-    XGlyphInfo sys_extents;
-    XftTextExtentsUtf8(base.display, base.xft_font,
-                      (XftChar8*)sys_str.c_str(), sys_str.length(),
-                      &sys_extents);
+    if (bar.regions[BAR_REGION_TIME].dirty) {
+        text_draw(bar.text_cache, bar.xft_draw, &bar.xft_fg, time_run, time_x, y_offset);
+    }
+
+    if (bar.regions[BAR_REGION_SYSINFO].dirty) {
+        if (partial[BAR_REGION_SYSINFO]) {
+            // Antialiased glyphs must not be blended twice, so neighbours
+            // that overhang the changed cells are clipped away.
+            XRectangle clip;
+            clip.x = damage[BAR_REGION_SYSINFO].x0;
+            clip.y = 0;
+            clip.width = damage[BAR_REGION_SYSINFO].x1 - damage[BAR_REGION_SYSINFO].x0;
+            clip.height = bar.height;
+            XftDrawSetClipRectangles(bar.xft_draw, 0, 0, &clip, 1);
+        }
 
-    int sys_x = base.bar.width - sys_extents.width - PADDING - base.bar.systray_width;
+        text_draw_glyphs(bar.text_cache, bar.xft_draw, sys_color, bar.sys_glyphs, sys_x, y_offset);
 
-    XftColor* sys_color = &base.bar.xft_fg;
-    if (base.bar.sys_info.cpu_usage > 90 || base.bar.sys_info.memory_usage > 90) {
-        sys_color = &base.bar.xft_critical;
-    } else if (base.bar.sys_info.cpu_usage > 75 || base.bar.sys_info.memory_usage > 75) {
-        sys_color = &base.bar.xft_warning;
+        if (partial[BAR_REGION_SYSINFO]) {
+            XftDrawSetClip(bar.xft_draw, nullptr);
+        }
+    }
+
+    for (int i = 0; i < BAR_REGION_COUNT; ++i) {
+        if (!bar.regions[i].dirty) continue;
+        XCopyArea(base.display, bar.buffer, bar.window, bar.gc,
+                  damage[i].x0, 0, damage[i].x1 - damage[i].x0, bar.height,
+                  damage[i].x0, 0);
+        bar.regions[i].dirty = false;
     }
 
-    XftDrawStringUtf8(base.bar.xft_draw, sys_color, base.xft_font,
-                     sys_x, y_offset,
-                     (XftChar8*)sys_str.c_str(), sys_str.length());
+    XFlush(base.display);
+}
+
+void nwm::bar_expose(BarBase &base, int x, int y, int width, int height) {
+    if (!base.bar.buffer) return;
+    XCopyArea(base.display, base.bar.buffer, base.bar.window, base.bar.gc,
+              x, y, width, height, x, y);
+}
 
-    XFreeGC(base.display, gc);
+// Asks the WM to switch workspace the EWMH way, exactly as a pager would,
+// naming this bar's monitor in l[2] so the workspace opens there.
+static void request_workspace(nwm::BarBase &base, int workspace) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = base.root;
+    ev.xclient.message_type = atom(nwm::NET_CURRENT_DESKTOP);
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = workspace;
+    ev.xclient.data.l[1] = CurrentTime;
+    ev.xclient.data.l[2] = base.monitor + 1;
+    XSendEvent(base.display, base.root, False,
+               SubstructureNotifyMask | SubstructureRedirectMask, &ev);
     XFlush(base.display);
 }
 
-void nwm::bar_update_workspaces(Base &base) {
+void nwm::bar_update_state(BarBase &base) {
+    uint64_t count;
+    while (read(base.wake_fd, &count, sizeof(count)) == sizeof(count));
+
+    BarFeedState previous = base.state;
+    if (!bar_feed_read(base.feed, base.state)) return;
+
+    // A monitor that changes size gets a fresh bar from the WM; only the
+    // top/bottom position is followed here.
+    if (base.state.bar_position != previous.bar_position) {
+        bar_place(base);
+        XMoveWindow(base.display, base.bar.window, base.bar.x, base.bar.y);
+        systray_update(base);
+    }
+
+    if (base.state.bar_visible != previous.bar_visible) {
+        if (base.state.bar_visible) {
+            XMapRaised(base.display, base.bar.window);
+            if (base.systray.window) XMapRaised(base.display, base.systray.window);
+        } else {
+            XUnmapWindow(base.display, base.bar.window);
+            if (base.systray.window) XUnmapWindow(base.display, base.systray.window);
+        }
+    }
+
     bar_draw(base);
 }
 
-void nwm::bar_update_time(Base &base) {
-    bar_update_system_info(base);
+void nwm::bar_update_time(BarBase &base) {
     bar_draw(base);
 }
 
-void nwm::bar_handle_click(Base &base, int x, int y, int button) {
+void nwm::bar_update_system_info(BarBase &base) {
+    if (sampler_take(base.bar.sampler, base.bar.sys_info)) {
+        bar_draw(base);
+    }
+}
+
+void nwm::bar_handle_click(BarBase &base, int x, int y, int button) {
     if (button != Button1) return;
 
     for (const auto& seg : base.bar.segments) {
         if (x >= seg.x && x < seg.x + seg.width &&
             y >= seg.y && y < seg.y + seg.height) {
             if (seg.type == BarSegment::WORKSPACE && seg.workspace_index >= 0) {
-                if (seg.workspace_index != (int)base.current_workspace) {
-                    switch_workspace((void*)&seg.workspace_index, base);
+                if (seg.workspace_index != (int)base.state.current_workspace ||
+                    base.monitor != (int)base.state.current_monitor) {
+                    request_workspace(base, seg.workspace_index);
                 }
                 break;
             }
@@ -452,7 +499,7 @@ void nwm::bar_handle_click(Base &base, int x, int y, int button) {
     }
 }
 
-void nwm::bar_handle_motion(Base &base, int x, int y) {
+void nwm::bar_handle_motion(BarBase &base, int x, int y) {
     int old_hover = base.bar.hover_segment;
     base.bar.hover_segment = -1;
 
@@ -472,16 +519,21 @@ void nwm::bar_handle_motion(Base &base, int x, int y) {
     }
 }
 
-void nwm::bar_handle_scroll(Base &base, int direction) {
-    int next_ws = base.current_workspace;
+void nwm::bar_handle_scroll(BarBase &base, int direction) {
+    const BarFeedMonitor *mon = bar_monitor(base);
+    int count = base.state.workspace_count;
+    int current = mon ? mon->workspace : base.state.current_workspace;
+    if (count == 0) return;
+
+    int next_ws = current;
 
     if (direction > 0) {
-        next_ws = (base.current_workspace + 1) % NUM_WORKSPACES;
+        next_ws = (current + 1) % count;
     } else {
-        next_ws = (base.current_workspace - 1 + NUM_WORKSPACES) % NUM_WORKSPACES;
+        next_ws = (current - 1 + count) % count;
     }
 
-    if (next_ws != (int)base.current_workspace) {
-        switch_workspace((void*)&next_ws, base);
+    if (next_ws != current) {
+        request_workspace(base, next_ws);
     }
 }
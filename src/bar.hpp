@@ -5,33 +5,41 @@
 #include <X11/Xft/Xft.h>
 #include <string>
 #include <vector>
-#include <chrono>
+#include "sampler.hpp"
+#include "text.hpp"
+#include "systray.hpp"
+#include "barfeed.hpp"
 
 namespace nwm {
 
-struct Base;
-
-struct SystemInfo {
-    float cpu_usage;
-    float memory_usage;
-    float disk_usage;
-    std::string network_rx;
-    std::string network_tx;
-    std::string battery_status;
-    int battery_percent;
-    std::chrono::steady_clock::time_point last_update;
-};
-
 struct BarSegment {
     int x, y, width, height;
     int workspace_index;
     enum Type { WORKSPACE, LAYOUT, SYSTEM_INFO, TIME, SEPARATOR } type;
 };
 
+enum BarRegionId {
+    BAR_REGION_WORKSPACES,
+    BAR_REGION_LAYOUT,
+    BAR_REGION_TIME,
+    BAR_REGION_SYSINFO,
+    BAR_REGION_COUNT
+};
+
+// What a region of the bar last showed. A region is repainted only when its
+// content or extent changes, or when it is explicitly marked dirty.
+struct BarRegion {
+    int x, width;
+    std::string content;
+    bool dirty;
+};
+
 struct StatusBar {
     Window window;
     int x, y;
     int width, height;
+    Pixmap buffer;
+    GC gc;
     XftDraw* xft_draw;
     XftColor xft_fg;
     XftColor xft_bg;
@@ -42,27 +50,48 @@ struct StatusBar {
     XftColor xft_critical;
     XftColor xft_hover;
     
+    BarRegion regions[BAR_REGION_COUNT];
+    TextCache text_cache;
+    std::vector<XftGlyphFontSpec> sys_glyphs;
+    std::vector<int> sys_bounds;
     std::vector<BarSegment> segments;
     int hover_segment;
     SystemInfo sys_info;
+    Sampler sampler;
     int systray_width;
 };
 
-void bar_init(Base &base);
-void bar_cleanup(Base &base);
-void bar_draw(Base &base);
-void bar_update_workspaces(Base &base);
-void bar_update_time(Base &base);
-void bar_update_system_info(Base &base);
-void bar_handle_click(Base &base, int x, int y, int button);
-void bar_handle_motion(Base &base, int x, int y);
-void bar_handle_scroll(Base &base, int direction);
+// Everything the nwm-bar process owns. WM state arrives read-only through
+// `feed`; `state` is the last copy taken from it.
+struct BarBase {
+    Display *display;
+    int screen;
+    Window root;
+    XftFont *xft_font;
+    bool running;
+
+    StatusBar bar;
+    SystemTray systray;
+
+    BarFeed *feed;
+    BarFeedState state;
+    int monitor;                // index into state.monitors this bar covers
+    int wake_fd;
+    int epoll_fd;
+    int timer_fd;
+    int signal_fd;
+};
 
-float get_cpu_usage();
-float get_memory_usage();
-float get_disk_usage(const char* path);
-void get_network_stats(std::string& rx, std::string& tx);
-void get_battery_info(std::string& status, int& percent);
+void bar_init(BarBase &base);
+void bar_cleanup(BarBase &base);
+void bar_draw(BarBase &base);
+void bar_expose(BarBase &base, int x, int y, int width, int height);
+void bar_update_state(BarBase &base);
+void bar_update_time(BarBase &base);
+void bar_update_system_info(BarBase &base);
+void bar_handle_click(BarBase &base, int x, int y, int button);
+void bar_handle_motion(BarBase &base, int x, int y);
+void bar_handle_scroll(BarBase &base, int direction);
 
 }
 
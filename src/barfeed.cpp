@@ -0,0 +1,87 @@
+#include "barfeed.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+
+#define BAR_FEED_READ_RETRIES 64
+
+static_assert(sizeof(nwm::BarFeedState) % sizeof(uint32_t) == 0,
+              "BarFeedState must be a whole number of words");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "shared atomics must have the plain layout");
+
+nwm::BarFeed* nwm::bar_feed_create(int &fd) {
+    fd = memfd_create("nwm-bar-feed", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("memfd_create");
+        return nullptr;
+    }
+
+    if (ftruncate(fd, sizeof(BarFeed)) < 0) {
+        perror("ftruncate");
+        close(fd);
+        fd = -1;
+        return nullptr;
+    }
+
+    BarFeed *feed = bar_feed_attach(fd);
+    if (!feed) {
+        close(fd);
+        fd = -1;
+        return nullptr;
+    }
+
+    feed->magic = BAR_FEED_MAGIC;
+    return feed;
+}
+
+nwm::BarFeed* nwm::bar_feed_attach(int fd) {
+    void *mem = mmap(nullptr, sizeof(BarFeed), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return nullptr;
+    }
+    return static_cast<BarFeed*>(mem);
+}
+
+void nwm::bar_feed_release(BarFeed *feed) {
+    if (feed) {
+        munmap(feed, sizeof(BarFeed));
+    }
+}
+
+void nwm::bar_feed_write(BarFeed *feed, const BarFeedState &state) {
+    uint32_t words[BAR_FEED_WORDS];
+    memcpy(words, &state, sizeof(words));
+
+    uint32_t seq = feed->seq.load(std::memory_order_relaxed);
+    feed->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < BAR_FEED_WORDS; ++i) {
+        feed->state[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    feed->seq.store(seq + 2, std::memory_order_release);
+}
+
+bool nwm::bar_feed_read(const BarFeed *feed, BarFeedState &state) {
+    uint32_t words[BAR_FEED_WORDS];
+
+    for (int attempt = 0; attempt < BAR_FEED_READ_RETRIES; ++attempt) {
+        uint32_t before = feed->seq.load(std::memory_order_acquire);
+        if (before & 1) continue;
+
+        for (size_t i = 0; i < BAR_FEED_WORDS; ++i) {
+            words[i] = feed->state[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (feed->seq.load(std::memory_order_relaxed) == before) {
+            memcpy(&state, words, sizeof(words));
+            return true;
+        }
+    }
+    return false;
+}
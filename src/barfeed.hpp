@@ -0,0 +1,62 @@
+#ifndef BARFEED_HPP
+#define BARFEED_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace nwm {
+
+#define BAR_HEIGHT 30
+#define BAR_FEED_MAGIC 0x6e776d62
+#define BAR_FEED_MAX_WORKSPACES 32
+#define BAR_FEED_LABEL_MAX 16
+#define BAR_FEED_MAX_MONITORS 8
+
+// One monitor and the workspace it shows; nwm runs one bar per monitor.
+struct BarFeedMonitor {
+    int32_t x, y;
+    uint32_t width, height;
+    uint32_t workspace;
+    uint32_t horizontal_mode;
+};
+
+// The part of WM state the bar renders. Plain 32-bit words only, so it can
+// be copied through the feed one atomic word at a time.
+struct BarFeedState {
+    uint32_t workspace_count;
+    uint32_t current_workspace;
+    uint32_t occupied;          // bit i set when workspace i has clients
+    uint32_t current_monitor;
+    uint32_t monitor_count;
+    uint32_t bar_visible;
+    uint32_t bar_position;      // 0 top, 1 bottom
+    uint32_t focused_window;
+    char labels[BAR_FEED_MAX_WORKSPACES][BAR_FEED_LABEL_MAX];
+    BarFeedMonitor monitors[BAR_FEED_MAX_MONITORS];
+};
+
+#define BAR_FEED_WORDS (sizeof(BarFeedState) / sizeof(uint32_t))
+
+// Shared memory between nwm and nwm-bar. The WM is the only writer of
+// `state` and publishes it under a seqlock. Each bar writes back the ids of
+// its own windows, in its monitor's slot, so the WM can leave them alone.
+struct BarFeed {
+    uint32_t magic;
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> state[BAR_FEED_WORDS];
+    std::atomic<uint32_t> bar_window[BAR_FEED_MAX_MONITORS];
+    std::atomic<uint32_t> tray_window;
+};
+
+// Creates an anonymous shared mapping; fd is the memfd to hand to the bar.
+BarFeed* bar_feed_create(int &fd);
+BarFeed* bar_feed_attach(int fd);
+void bar_feed_release(BarFeed *feed);
+
+void bar_feed_write(BarFeed *feed, const BarFeedState &state);
+// Returns false if the WM was mid-write for too long to get a stable copy.
+bool bar_feed_read(const BarFeed *feed, BarFeedState &state);
+
+}
+
+#endif // BARFEED_HPP
@@ -0,0 +1,328 @@
+#include "barlink.hpp"
+#include "nwm.hpp"
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+// A bar that dies sooner than this after starting is most likely broken
+// (missing font, no display), so it is not restarted in a loop.
+#define BAR_RESPAWN_MIN_UPTIME 5
+// How long a bar gets to exit on SIGTERM before it is killed.
+#define BAR_EXIT_TIMEOUT_MS 2000
+
+static std::string sibling_binary(const char *name) {
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) return std::string();
+    exe[len] = '\0';
+
+    char *slash = strrchr(exe, '/');
+    if (!slash) return std::string();
+    slash[1] = '\0';
+    return std::string(exe) + name;
+}
+
+static void clear_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0) fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC);
+}
+
+static void bar_link_spawn(nwm::Base &base, size_t index) {
+    nwm::BarLink &link = base.bar_link;
+    nwm::BarInstance &bar = link.bars[index];
+
+    std::string path = sibling_binary("nwm-bar");
+    char feed_arg[16], wake_arg[16], monitor_arg[16];
+    snprintf(feed_arg, sizeof(feed_arg), "%d", link.feed_fd);
+    snprintf(wake_arg, sizeof(wake_arg), "%d", bar.wake_fd);
+    snprintf(monitor_arg, sizeof(monitor_arg), "%zu", index);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork nwm-bar");
+        return;
+    }
+
+    if (pid == 0) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+        clear_cloexec(link.feed_fd);
+        clear_cloexec(bar.wake_fd);
+
+        if (!path.empty()) {
+            execl(path.c_str(), "nwm-bar", "--feed", feed_arg, "--wake", wake_arg,
+                  "--monitor", monitor_arg, "--font", link.font.c_str(), (char*)NULL);
+        }
+        execlp("nwm-bar", "nwm-bar", "--feed", feed_arg, "--wake", wake_arg,
+               "--monitor", monitor_arg, "--font", link.font.c_str(), (char*)NULL);
+        perror("execlp nwm-bar");
+        _exit(1);
+    }
+
+    bar.pid = pid;
+    bar.started = std::chrono::steady_clock::now();
+}
+
+// Stops the bar without waiting for it: the signalfd reaps it like any
+// other child. Its replacement gets a fresh eventfd so that the old bar,
+// while it lingers, cannot swallow the new one's wakeups.
+static void bar_link_kill(nwm::Base &base, size_t index) {
+    nwm::BarInstance &bar = base.bar_link.bars[index];
+    if (bar.pid > 0) {
+        kill(bar.pid, SIGTERM);
+        nwm::BarExit dying;
+        dying.pid = bar.pid;
+        dying.killed = false;
+        dying.kill_at = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(BAR_EXIT_TIMEOUT_MS);
+        base.bar_link.exiting.push_back(dying);
+        bar.pid = -1;
+    }
+    if (bar.wake_fd >= 0) {
+        close(bar.wake_fd);
+        bar.wake_fd = -1;
+    }
+    base.bar_link.feed->bar_window[index].store(None);
+    if (index == 0) base.bar_link.feed->tray_window.store(None);
+}
+
+// Starts the bar for monitor index, sized to that monitor.
+static void bar_link_launch(nwm::Base &base, size_t index) {
+    nwm::BarInstance &bar = base.bar_link.bars[index];
+    const nwm::Monitor &mon = base.monitors[index];
+    bar.x = mon.x;
+    bar.y = mon.y;
+    bar.width = mon.width;
+    bar.height = mon.height;
+
+    if (bar.wake_fd < 0) {
+        bar.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (bar.wake_fd < 0) {
+            perror("eventfd");
+            return;
+        }
+    }
+    bar_link_spawn(base, index);
+}
+
+void nwm::bar_link_start(Base &base, const char *font) {
+    BarLink &link = base.bar_link;
+    link.bars.clear();
+    link.font = font;
+    memset(&link.published, 0, sizeof(link.published));
+
+    link.feed = bar_feed_create(link.feed_fd);
+    if (!link.feed) {
+        std::cerr << "Error: Failed to create bar feed, running without a bar\n";
+        return;
+    }
+
+    bar_link_sync(base);
+}
+
+void nwm::bar_link_sync(Base &base) {
+    BarLink &link = base.bar_link;
+    if (!link.feed) return;
+
+    size_t count = std::min(base.monitors.size(), (size_t)BAR_FEED_MAX_MONITORS);
+    while (link.bars.size() > count) {
+        bar_link_kill(base, link.bars.size() - 1);
+        link.bars.pop_back();
+    }
+
+    // A bar reads the feed as soon as it starts, so it must already hold
+    // the monitors as they are now.
+    link.published.workspace_count = ~0u;
+    bar_link_publish(base);
+
+    for (size_t i = 0; i < count; ++i) {
+        const Monitor &mon = base.monitors[i];
+        if (i < link.bars.size()) {
+            const BarInstance &bar = link.bars[i];
+            if (bar.pid > 0 && bar.x == mon.x && bar.y == mon.y &&
+                bar.width == mon.width && bar.height == mon.height) {
+                continue;
+            }
+            bar_link_kill(base, i);
+        } else {
+            BarInstance bar;
+            bar.pid = -1;
+            bar.wake_fd = -1;
+            link.bars.push_back(bar);
+        }
+        bar_link_launch(base, i);
+    }
+}
+
+void nwm::bar_link_set_font(Base &base, const std::string &font) {
+    BarLink &link = base.bar_link;
+    if (font == link.font) return;
+    link.font = font;
+    if (!link.feed) return;
+
+    // As in bar_link_sync: publish first, then swap each bar for one with
+    // the new font without waiting for the old one to exit.
+    link.published.workspace_count = ~0u;
+    bar_link_publish(base);
+    for (size_t i = 0; i < link.bars.size(); ++i) {
+        bar_link_kill(base, i);
+        bar_link_launch(base, i);
+    }
+}
+
+void nwm::bar_link_stop(Base &base) {
+    BarLink &link = base.bar_link;
+
+    for (BarInstance &bar : link.bars) {
+        if (bar.pid > 0) {
+            kill(bar.pid, SIGTERM);
+            waitpid(bar.pid, NULL, 0);
+            bar.pid = -1;
+        }
+        if (bar.wake_fd >= 0) {
+            close(bar.wake_fd);
+            bar.wake_fd = -1;
+        }
+    }
+    link.bars.clear();
+
+    for (const BarExit &dying : link.exiting) {
+        kill(dying.pid, SIGKILL);
+        waitpid(dying.pid, NULL, 0);
+    }
+    link.exiting.clear();
+
+    if (link.feed) {
+        bar_feed_release(link.feed);
+        link.feed = nullptr;
+    }
+
+    if (link.feed_fd >= 0) {
+        close(link.feed_fd);
+        link.feed_fd = -1;
+    }
+}
+
+void nwm::bar_link_publish(Base &base) {
+    BarLink &link = base.bar_link;
+    if (!link.feed || base.batch_depth > 0) return;
+
+    BarFeedState state;
+    memset(&state, 0, sizeof(state));
+
+    size_t count = base.workspaces.size();
+    if (count > BAR_FEED_MAX_WORKSPACES) count = BAR_FEED_MAX_WORKSPACES;
+
+    state.workspace_count = count;
+    state.current_workspace = base.current_workspace;
+    for (size_t i = 0; i < count; ++i) {
+        if (!base.workspaces[i].clients.empty()) {
+            state.occupied |= 1u << i;
+        }
+        if (!base.widget.empty()) {
+            const std::string &label = base.widget[i % base.widget.size()];
+            strncpy(state.labels[i], label.c_str(), BAR_FEED_LABEL_MAX - 1);
+        }
+    }
+
+    size_t monitor_count = std::min(base.monitors.size(), (size_t)BAR_FEED_MAX_MONITORS);
+    state.current_monitor = base.current_monitor;
+    state.monitor_count = monitor_count;
+    for (size_t i = 0; i < monitor_count; ++i) {
+        const Monitor &mon = base.monitors[i];
+        BarFeedMonitor &m = state.monitors[i];
+        m.x = mon.x;
+        m.y = mon.y;
+        m.width = mon.width;
+        m.height = mon.height;
+        m.workspace = mon.current_workspace;
+        m.horizontal_mode = mon.horizontal_mode ? 1 : 0;
+    }
+    state.bar_visible = base.bar_visible ? 1 : 0;
+    state.bar_position = base.bar_position;
+    state.focused_window = base.focused_window ? base.focused_window->window : None;
+
+    if (memcmp(&state, &link.published, sizeof(state)) == 0) return;
+
+    link.published = state;
+    bar_feed_write(link.feed, state);
+
+    uint64_t one = 1;
+    for (const BarInstance &bar : link.bars) {
+        if (bar.wake_fd < 0) continue;
+        if (write(bar.wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            perror("bar wake");
+        }
+    }
+}
+
+int nwm::bar_link_service(Base &base) {
+    BarLink &link = base.bar_link;
+    auto now = std::chrono::steady_clock::now();
+    int timeout = -1;
+
+    for (BarExit &dying : link.exiting) {
+        if (dying.killed) continue;
+        if (now >= dying.kill_at) {
+            kill(dying.pid, SIGKILL);
+            dying.killed = true;
+            continue;
+        }
+        int ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+            dying.kill_at - now).count() + 1;
+        if (timeout < 0 || ms < timeout) timeout = ms;
+    }
+    return timeout;
+}
+
+void nwm::bar_link_child_exited(Base &base, pid_t pid) {
+    BarLink &link = base.bar_link;
+
+    for (size_t i = 0; i < link.exiting.size(); ++i) {
+        if (link.exiting[i].pid == pid) {
+            link.exiting.erase(link.exiting.begin() + i);
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < link.bars.size(); ++i) {
+        BarInstance &bar = link.bars[i];
+        if (pid != bar.pid) continue;
+
+        bar.pid = -1;
+        if (!link.feed || !base.running) return;
+
+        auto uptime = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - bar.started).count();
+        if (uptime < BAR_RESPAWN_MIN_UPTIME) {
+            std::cerr << "nwm-bar exited after " << uptime << "s, not restarting it\n";
+            return;
+        }
+
+        bar_link_kill(base, i);
+        bar_link_launch(base, i);
+        return;
+    }
+}
+
+bool nwm::bar_link_owns(const Base &base, Window window) {
+    const BarFeed *feed = base.bar_link.feed;
+    if (!feed || window == None) return false;
+    if (window == feed->tray_window.load(std::memory_order_relaxed)) return true;
+    for (size_t i = 0; i < base.bar_link.bars.size(); ++i) {
+        if (window == feed->bar_window[i].load(std::memory_order_relaxed)) return true;
+    }
+    return false;
+}
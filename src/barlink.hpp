@@ -0,0 +1,67 @@
+#ifndef BARLINK_HPP
+#define BARLINK_HPP
+
+#include <X11/Xlib.h>
+#include <sys/types.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "barfeed.hpp"
+
+namespace nwm {
+
+struct Base;
+
+// One nwm-bar process, drawn across the monitor it was started for, and the
+// eventfd used to wake it after a publish.
+struct BarInstance {
+    pid_t pid;
+    int wake_fd;
+    int x, y;
+    int width, height;
+    std::chrono::steady_clock::time_point started;
+};
+
+// A bar sent SIGTERM and not yet reaped. It gets SIGKILL if it is still
+// around at kill_at, since a stopped or wedged bar never reads the signal.
+struct BarExit {
+    pid_t pid;
+    bool killed;
+    std::chrono::steady_clock::time_point kill_at;
+};
+
+// The WM's side of nwm-bar: one bar per monitor, all reading the same
+// shared state feed.
+struct BarLink {
+    std::vector<BarInstance> bars;
+    std::vector<BarExit> exiting;
+    BarFeed *feed;
+    int feed_fd;
+    BarFeedState published;
+    std::string font;
+};
+
+void bar_link_start(Base &base, const char *font);
+void bar_link_stop(Base &base);
+// Keeps one bar per monitor: starts bars for new monitors, stops those of
+// removed ones and restarts any whose monitor changed size or position.
+void bar_link_sync(Base &base);
+// Sends SIGKILL to bars that have not exited some time after SIGTERM. Returns the epoll
+// timeout in milliseconds until the next one is due, or -1 if none is.
+int bar_link_service(Base &base);
+// Restarts the bar with another font; the font is a command line argument
+// of nwm-bar, everything else reaches it through the feed. Called from a
+// config reload, so it never waits for the old bar to exit.
+void bar_link_set_font(Base &base, const std::string &font);
+// Copies the current workspace/layout/focus state into the feed and wakes
+// the bar, if anything it displays changed.
+void bar_link_publish(Base &base);
+// Called for every reaped child. Forgets a bar that was told to exit, or restarts the bar
+// that exited unless it is dying straight after launch.
+void bar_link_child_exited(Base &base, pid_t pid);
+// True for the bar and tray windows, which the WM must not track or restack.
+bool bar_link_owns(const Base &base, Window window);
+
+}
+
+#endif // BARLINK_HPP
@@ -75,8 +75,8 @@ static struct {
     { MODKEY | ShiftMask, XK_h,               swap_prev,      NULL },
     { MODKEY | ShiftMask, XK_l,               swap_next,      NULL },
 
-    { MODKEY,             XK_h,               resize_master,  (void*)-RESIZE_STEP },
-    { MODKEY,             XK_l,               resize_master,  (void*)RESIZE_STEP },
+    { MODKEY,             XK_h,               resize_master,  (void*)-1 },
+    { MODKEY,             XK_l,               resize_master,  (void*)1 },
 
     { MODKEY,             XK_Left,            scroll_left,    NULL },
     { MODKEY,             XK_Right,           scroll_right,   NULL },
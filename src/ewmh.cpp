@@ -0,0 +1,126 @@
+#include "ewmh.hpp"
+#include "nwm.hpp"
+#include "atoms.hpp"
+#include <X11/Xatom.h>
+#include <algorithm>
+
+void nwm::ewmh_init(Base &base) {
+    Ewmh &ewmh = base.ewmh;
+    ewmh.client_list.clear();
+    ewmh.appended.clear();
+    ewmh.stacking.clear();
+    // Whatever a previous WM instance left on the root is replaced on the
+    // first flush.
+    ewmh.rewrite = true;
+    ewmh.stacking_dirty = true;
+    ewmh.active = ~(Window)0;
+    ewmh.desktop = -1;
+}
+
+void nwm::ewmh_client_added(Base &base, Window window, int workspace) {
+    Ewmh &ewmh = base.ewmh;
+    ewmh.client_list.push_back(window);
+    if (!ewmh.rewrite) {
+        ewmh.appended.push_back(window);
+    }
+    ewmh.stacking_dirty = true;
+    ewmh_set_desktop(base, window, workspace);
+}
+
+void nwm::ewmh_client_removed(Base &base, Window window) {
+    Ewmh &ewmh = base.ewmh;
+    auto it = std::find(ewmh.client_list.begin(), ewmh.client_list.end(), window);
+    if (it == ewmh.client_list.end()) return;
+
+    ewmh.client_list.erase(it);
+    ewmh.appended.clear();
+    ewmh.rewrite = true;
+    ewmh.stacking_dirty = true;
+}
+
+void nwm::ewmh_client_withdrawn(Base &base, Window window) {
+    base.backend->delete_property(base, window, atom(NET_WM_DESKTOP));
+}
+
+void nwm::ewmh_set_desktop(Base &base, Window window, int workspace) {
+    long desktop = workspace;
+    base.backend->change_property(base, window, atom(NET_WM_DESKTOP), XA_CARDINAL, 32,
+                                  PropModeReplace, (unsigned char*)&desktop, 1);
+}
+
+void nwm::ewmh_restacked(Base &base) {
+    base.ewmh.stacking_dirty = true;
+}
+
+// Bottom to top, mirroring how the layout stacks windows: hidden workspaces,
+// then per monitor the tiled windows in order and the floating and
+// fullscreen ones, with the focused one last.
+static void compute_stacking(nwm::Base &base, std::vector<Window> &out) {
+    out.clear();
+
+    for (size_t i = 0; i < base.workspaces.size(); ++i) {
+        if (nwm::workspace_monitor(base, i)) continue;
+        for (nwm::ClientHandle h : base.workspaces[i].clients) {
+            out.push_back(nwm::client_get(base, h)->window);
+        }
+    }
+
+    nwm::ManagedWindow *focused = base.focused_window;
+    for (const nwm::Monitor &mon : base.monitors) {
+        const nwm::Workspace &ws = base.workspaces[mon.current_workspace];
+        for (nwm::ClientHandle h : ws.clients) {
+            nwm::ManagedWindow *w = nwm::client_get(base, h);
+            if (!w->is_floating && !w->is_fullscreen) out.push_back(w->window);
+        }
+        for (nwm::ClientHandle h : ws.clients) {
+            nwm::ManagedWindow *w = nwm::client_get(base, h);
+            if ((w->is_floating || w->is_fullscreen) && w != focused) out.push_back(w->window);
+        }
+    }
+    if (focused && (focused->is_floating || focused->is_fullscreen)) {
+        out.push_back(focused->window);
+    }
+}
+
+void nwm::ewmh_flush(Base &base) {
+    Ewmh &ewmh = base.ewmh;
+    const DisplayBackend &x = *base.backend;
+
+    if (ewmh.rewrite) {
+        x.change_property(base, base.root, atom(NET_CLIENT_LIST), XA_WINDOW, 32, PropModeReplace,
+                          (unsigned char*)ewmh.client_list.data(), ewmh.client_list.size());
+        ewmh.rewrite = false;
+        ewmh.appended.clear();
+    } else if (!ewmh.appended.empty()) {
+        x.change_property(base, base.root, atom(NET_CLIENT_LIST), XA_WINDOW, 32, PropModeAppend,
+                          (unsigned char*)ewmh.appended.data(), ewmh.appended.size());
+        ewmh.appended.clear();
+    }
+
+    if (ewmh.stacking_dirty) {
+        ewmh.stacking_dirty = false;
+        std::vector<Window> stacking;
+        stacking.reserve(ewmh.client_list.size());
+        compute_stacking(base, stacking);
+        if (stacking != ewmh.stacking) {
+            ewmh.stacking.swap(stacking);
+            x.change_property(base, base.root, atom(NET_CLIENT_LIST_STACKING), XA_WINDOW, 32,
+                              PropModeReplace, (unsigned char*)ewmh.stacking.data(),
+                              ewmh.stacking.size());
+        }
+    }
+
+    Window active = base.focused_window ? base.focused_window->window : None;
+    if (active != ewmh.active) {
+        ewmh.active = active;
+        x.change_property(base, base.root, atom(NET_ACTIVE_WINDOW), XA_WINDOW, 32,
+                          PropModeReplace, (unsigned char*)&active, 1);
+    }
+
+    long desktop = base.current_workspace;
+    if (desktop != ewmh.desktop) {
+        ewmh.desktop = desktop;
+        x.change_property(base, base.root, atom(NET_CURRENT_DESKTOP), XA_CARDINAL, 32,
+                          PropModeReplace, (unsigned char*)&desktop, 1);
+    }
+}
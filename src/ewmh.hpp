@@ -0,0 +1,41 @@
+#ifndef EWMH_HPP
+#define EWMH_HPP
+
+#include <X11/Xlib.h>
+#include <vector>
+
+namespace nwm {
+
+struct Base;
+
+// The root window properties pagers and switchers read: _NET_CLIENT_LIST,
+// _NET_CLIENT_LIST_STACKING, _NET_ACTIVE_WINDOW and _NET_CURRENT_DESKTOP.
+// Changes are noted as they happen and written once per event loop
+// iteration by ewmh_flush.
+struct Ewmh {
+    // Managed windows in mapping order, as last written or queued.
+    std::vector<Window> client_list;
+    // Windows to PropModeAppend to _NET_CLIENT_LIST on the next flush.
+    std::vector<Window> appended;
+    // Set on unmanage: the next flush rewrites the whole list instead.
+    bool rewrite;
+    bool stacking_dirty;
+    std::vector<Window> stacking;
+    Window active;
+    long desktop;
+};
+
+void ewmh_init(Base &base);
+void ewmh_client_added(Base &base, Window window, int workspace);
+void ewmh_client_removed(Base &base, Window window);
+// Drops _NET_WM_DESKTOP from a client that withdrew but still exists.
+void ewmh_client_withdrawn(Base &base, Window window);
+// Sets _NET_WM_DESKTOP on a window moved to another workspace.
+void ewmh_set_desktop(Base &base, Window window, int workspace);
+// Stacking or visibility may have changed.
+void ewmh_restacked(Base &base);
+void ewmh_flush(Base &base);
+
+}
+
+#endif // EWMH_HPP
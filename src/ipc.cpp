@@ -0,0 +1,544 @@
+#include "ipc.hpp"
+#include "nwm.hpp"
+#include "tiling.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static void epoll_set(nwm::Base &base, int fd, int op, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(base.epoll_fd, op, fd, &ev) < 0) {
+        perror("epoll_ctl ipc");
+    }
+}
+
+void nwm::ipc_init(Base &base) {
+    IpcServer &ipc = base.ipc;
+    ipc.listen_fd = -1;
+    ipc.pending = false;
+    ipc.reported_focus = 0;
+    ipc.events_sent = 0;
+    ipc.events_dropped = 0;
+    ipc.path = ipc_default_socket_path();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (ipc.path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Warning: IPC socket path too long: " << ipc.path << "\n";
+        ipc.path.clear();
+        return;
+    }
+    memcpy(addr.sun_path, ipc.path.c_str(), ipc.path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("ipc socket");
+        ipc.path.clear();
+        return;
+    }
+
+    // A leftover socket from a crashed instance refuses connections and can
+    // be replaced; one that still answers belongs to a running WM.
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        std::cerr << "Warning: " << ipc.path << " is in use, IPC disabled\n";
+        close(fd);
+        ipc.path.clear();
+        return;
+    }
+    close(fd);
+    unlink(ipc.path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("ipc bind");
+        if (fd >= 0) close(fd);
+        ipc.path.clear();
+        return;
+    }
+
+    ipc.listen_fd = fd;
+    setenv("NWM_SOCKET", ipc.path.c_str(), 1);
+}
+
+static void ipc_drop(nwm::Base &base, int fd) {
+    epoll_ctl(base.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    base.ipc.clients.erase(fd);
+}
+
+void nwm::ipc_cleanup(Base &base) {
+    IpcServer &ipc = base.ipc;
+    while (!ipc.clients.empty()) {
+        ipc_drop(base, ipc.clients.begin()->first);
+    }
+    if (ipc.listen_fd >= 0) {
+        close(ipc.listen_fd);
+        ipc.listen_fd = -1;
+        unlink(ipc.path.c_str());
+    }
+}
+
+bool nwm::ipc_owns(const Base &base, int fd) {
+    return fd == base.ipc.listen_fd || base.ipc.clients.count(fd);
+}
+
+static void json_string(std::string &out, const std::string &s) {
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+static void json_field(std::string &out, const char *key, long value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%s\":%ld", key, value);
+    out += buf;
+}
+
+static void json_field(std::string &out, const char *key, bool value) {
+    out += '"';
+    out += key;
+    out += value ? "\":true" : "\":false";
+}
+
+std::string nwm::ipc_tree_json(Base &base) {
+    std::string out;
+    out.reserve(1024);
+
+    out += '{';
+    json_field(out, "current_workspace", (long)base.current_workspace);
+    out += ',';
+    json_field(out, "current_monitor", (long)base.current_monitor);
+    out += ',';
+    json_field(out, "focused", (long)(base.focused_window ? base.focused_window->window : None));
+    out += ',';
+    json_field(out, "bar_visible", base.bar_visible);
+    out += ',';
+    json_field(out, "gaps_enabled", base.gaps_enabled);
+    out += ',';
+    // Requests this connection has issued so far, for benchmarks that diff
+    // it around an operation.
+    json_field(out, "x_requests", (long)(XNextRequest(base.display) - 1));
+
+    long subscribers = 0;
+    for (const auto &entry : base.ipc.clients) {
+        if (entry.second.event_mask) subscribers++;
+    }
+    out += ",\"ipc\":{";
+    json_field(out, "subscribers", subscribers);
+    out += ',';
+    json_field(out, "events_sent", (long)base.ipc.events_sent);
+    out += ',';
+    json_field(out, "events_dropped", (long)base.ipc.events_dropped);
+    out += '}';
+
+    out += ",\"monitors\":[";
+    for (size_t i = 0; i < base.monitors.size(); ++i) {
+        const Monitor &m = base.monitors[i];
+        if (i) out += ',';
+        out += '{';
+        json_field(out, "id", (long)m.id);
+        out += ',';
+        json_field(out, "x", (long)m.x);
+        out += ',';
+        json_field(out, "y", (long)m.y);
+        out += ',';
+        json_field(out, "width", (long)m.width);
+        out += ',';
+        json_field(out, "height", (long)m.height);
+        out += ',';
+        json_field(out, "workspace", (long)m.current_workspace);
+        out += ',';
+        json_field(out, "horizontal_mode", m.horizontal_mode);
+        out += ',';
+        json_field(out, "scroll_visible", (long)m.scroll_windows_visible);
+        out += '}';
+    }
+
+    out += "],\"workspaces\":[";
+    for (size_t i = 0; i < base.workspaces.size(); ++i) {
+        const Workspace &ws = base.workspaces[i];
+        if (i) out += ',';
+        out += '{';
+        json_field(out, "index", (long)i);
+        out += ",\"label\":";
+        json_string(out, base.widget.empty() ? std::to_string(i + 1)
+                                             : base.widget[i % base.widget.size()]);
+        out += ',';
+        json_field(out, "focused", (long)(ws.focused_window ? ws.focused_window->window : None));
+        out += ',';
+        json_field(out, "scroll_offset", (long)ws.scroll_offset);
+        out += ",\"clients\":[";
+        for (size_t j = 0; j < ws.clients.size(); ++j) {
+            const ManagedWindow *w = client_get(base, ws.clients[j]);
+            if (!w) continue;
+            if (j) out += ',';
+            out += '{';
+            json_field(out, "window", (long)w->window);
+            out += ',';
+            json_field(out, "monitor", (long)w->monitor);
+            out += ',';
+            json_field(out, "x", (long)w->x);
+            out += ',';
+            json_field(out, "y", (long)w->y);
+            out += ',';
+            json_field(out, "width", (long)w->width);
+            out += ',';
+            json_field(out, "height", (long)w->height);
+            out += ',';
+            json_field(out, "floating", w->is_floating);
+            out += ',';
+            json_field(out, "fullscreen", w->is_fullscreen);
+            out += ',';
+            json_field(out, "focused", w->is_focused);
+            out += '}';
+        }
+        out += "]}";
+    }
+    out += "]}";
+
+    return out;
+}
+
+static bool parse_int(const std::string &s, long &value) {
+    if (s.empty()) return false;
+    char *end;
+    errno = 0;
+    value = strtol(s.c_str(), &end, 0);
+    return errno == 0 && *end == '\0';
+}
+
+static void focus_client(nwm::Base &base, nwm::ManagedWindow *w) {
+    if (w->workspace != (int)base.current_workspace) {
+        int ws = w->workspace;
+        nwm::switch_workspace(&ws, base);
+    }
+    nwm::focus_window(w, base);
+}
+
+static bool run_command(nwm::Base &base, const std::string &line, std::string &error) {
+    using namespace nwm;
+
+    std::istringstream in(line);
+    std::string cmd, arg, extra;
+    if (!(in >> cmd)) return true;
+    in >> arg;
+    if (in >> extra) {
+        error = "trailing argument '" + extra + "' to " + cmd;
+        return false;
+    }
+
+    long n = 0;
+    if (cmd == "focus") {
+        if (arg == "next") {
+            focus_next(nullptr, base);
+        } else if (arg == "prev") {
+            focus_prev(nullptr, base);
+        } else if (parse_int(arg, n)) {
+            ManagedWindow *w = find_window(base, (Window)n);
+            if (!w) {
+                error = "no managed window " + arg;
+                return false;
+            }
+            focus_client(base, w);
+        } else {
+            error = "focus expects next, prev or a window id";
+            return false;
+        }
+    } else if (cmd == "swap") {
+        if (arg == "next") {
+            swap_next(nullptr, base);
+        } else if (arg == "prev") {
+            swap_prev(nullptr, base);
+        } else {
+            error = "swap expects next or prev";
+            return false;
+        }
+    } else if (cmd == "workspace" || cmd == "move_to_workspace" || cmd == "set_scroll_visible") {
+        if (!parse_int(arg, n)) {
+            error = cmd + " expects a number";
+            return false;
+        }
+        int value = (int)n;
+        if (cmd == "workspace") {
+            switch_workspace(&value, base);
+        } else if (cmd == "move_to_workspace") {
+            move_to_workspace(&value, base);
+        } else {
+            set_scroll_visible(&value, base);
+        }
+    } else if (cmd == "toggle_layout" && arg.empty()) {
+        toggle_layout(nullptr, base);
+    } else {
+        error = "unknown command '" + line + "'";
+        return false;
+    }
+
+    return true;
+}
+
+bool nwm::ipc_run_batch(Base &base, const std::string &batch, std::string &error) {
+    bool ok = true;
+
+    base.batch_depth++;
+    size_t start = 0;
+    while (ok && start <= batch.size()) {
+        size_t end = batch.find_first_of(";\n", start);
+        if (end == std::string::npos) end = batch.size();
+        ok = run_command(base, batch.substr(start, end - start), error);
+        start = end + 1;
+    }
+    base.batch_depth--;
+
+    if (base.batch_depth == 0) {
+        if (base.layout_pending) {
+            base.layout_pending = false;
+            tile_windows(base);
+        }
+        bar_link_publish(base);
+        // EWMH properties go out in the same flush as the batch's requests.
+        ewmh_flush(base);
+        XFlush(base.display);
+    }
+
+    return ok;
+}
+
+static void ipc_reply(nwm::IpcClient &client, uint32_t type, const std::string &payload) {
+    nwm::IpcHeader header;
+    header.length = payload.size();
+    header.type = type;
+    client.out.append((const char*)&header, sizeof(header));
+    client.out += payload;
+}
+
+static bool parse_event_mask(const std::string &names, uint32_t &mask, std::string &error) {
+    mask = 0;
+    size_t start = 0;
+    while (start < names.size()) {
+        size_t end = names.find_first_of(" ,\n", start);
+        if (end == std::string::npos) end = names.size();
+        std::string name = names.substr(start, end - start);
+        start = end + 1;
+        if (name.empty()) continue;
+
+        uint32_t kind = 0;
+        while (kind < nwm::IPC_EVENT_COUNT && name != nwm::ipc_event_names[kind]) kind++;
+        if (kind == nwm::IPC_EVENT_COUNT) {
+            error = "unknown event '" + name + "'";
+            return false;
+        }
+        mask |= 1u << kind;
+    }
+    if (!mask) mask = (1u << nwm::IPC_EVENT_COUNT) - 1;
+    return true;
+}
+
+static void ipc_dispatch(nwm::Base &base, nwm::IpcClient &client, uint32_t type,
+                         const std::string &payload) {
+    using namespace nwm;
+
+    switch (type) {
+        case IPC_COMMAND: {
+            std::string error;
+            std::string reply;
+            trace_command(base, payload);
+            if (ipc_run_batch(base, payload, error)) {
+                reply = "{\"success\":true}";
+            } else {
+                reply = "{\"success\":false,\"error\":";
+                json_string(reply, error);
+                reply += '}';
+            }
+            ipc_reply(client, type, reply);
+            break;
+        }
+        case IPC_GET_TREE:
+            ipc_reply(client, type, ipc_tree_json(base));
+            break;
+        case IPC_GET_PROFILE:
+            ipc_reply(client, type, profile_json(base));
+            break;
+        case IPC_SUBSCRIBE: {
+            std::string error;
+            uint32_t mask;
+            if (parse_event_mask(payload, mask, error)) {
+                client.event_mask = mask;
+                ipc_reply(client, type, "{\"success\":true}");
+            } else {
+                std::string reply = "{\"success\":false,\"error\":";
+                json_string(reply, error);
+                reply += '}';
+                ipc_reply(client, type, reply);
+            }
+            break;
+        }
+        default:
+            ipc_reply(client, type, "{\"success\":false,\"error\":\"unknown message type\"}");
+            break;
+    }
+}
+
+// Writes as much pending output as the socket takes and asks epoll for
+// EPOLLOUT only while something is left over. Returns false on a dead peer.
+static bool ipc_flush(nwm::Base &base, nwm::IpcClient &client) {
+    size_t sent = 0;
+    while (sent < client.out.size()) {
+        ssize_t n = write(client.fd, client.out.data() + sent, client.out.size() - sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            return false;
+        }
+        sent += n;
+    }
+    client.out.erase(0, sent);
+
+    bool want_write = !client.out.empty();
+    if (want_write != client.want_write) {
+        client.want_write = want_write;
+        epoll_set(base, client.fd, EPOLL_CTL_MOD, want_write ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+    return true;
+}
+
+static void ipc_accept(nwm::Base &base) {
+    for (;;) {
+        int fd = accept4(base.ipc.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR) perror("ipc accept");
+            if (errno == EINTR) continue;
+            return;
+        }
+        nwm::IpcClient &client = base.ipc.clients[fd];
+        client.fd = fd;
+        client.want_write = false;
+        client.event_mask = 0;
+        client.dropped = 0;
+        epoll_set(base, fd, EPOLL_CTL_ADD, EPOLLIN);
+    }
+}
+
+void nwm::ipc_handle(Base &base, int fd, uint32_t events) {
+    if (fd == base.ipc.listen_fd) {
+        ipc_accept(base);
+        return;
+    }
+
+    auto it = base.ipc.clients.find(fd);
+    if (it == base.ipc.clients.end()) return;
+    IpcClient &client = it->second;
+
+    // Reading stops once a full maximal message is buffered; the rest stays
+    // in the socket and epoll, being level-triggered, reports it again after
+    // this batch is parsed.
+    const size_t in_limit = sizeof(IpcHeader) + IPC_MAX_PAYLOAD;
+    bool eof = false;
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        char buf[4096];
+        while (client.in.size() < in_limit) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n > 0) {
+                client.in.append(buf, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 || errno != EAGAIN) eof = true;
+            break;
+        }
+    }
+
+    size_t offset = 0;
+    while (client.in.size() - offset >= sizeof(IpcHeader)) {
+        IpcHeader header;
+        memcpy(&header, client.in.data() + offset, sizeof(header));
+        if (header.length > IPC_MAX_PAYLOAD) {
+            ipc_drop(base, fd);
+            return;
+        }
+        if (client.in.size() - offset - sizeof(header) < header.length) break;
+
+        std::string payload = client.in.substr(offset + sizeof(header), header.length);
+        offset += sizeof(header) + header.length;
+        ipc_dispatch(base, client, header.type, payload);
+    }
+    client.in.erase(0, offset);
+
+    if (!ipc_flush(base, client) || eof) {
+        ipc_drop(base, fd);
+    }
+}
+
+void nwm::ipc_emit(Base &base, IpcEventKind kind, uint32_t window,
+                   int workspace, int monitor, int value) {
+    IpcServer &ipc = base.ipc;
+    const size_t size = sizeof(IpcHeader) + sizeof(IpcEvent);
+
+    for (auto &entry : ipc.clients) {
+        IpcClient &client = entry.second;
+        if (!(client.event_mask & (1u << kind))) continue;
+
+        if (client.out.size() + size > IPC_SUBSCRIBER_BUFFER) {
+            client.dropped++;
+            ipc.events_dropped++;
+            continue;
+        }
+
+        IpcHeader header;
+        header.length = sizeof(IpcEvent);
+        header.type = IPC_EVENT_FLAG | kind;
+
+        IpcEvent event;
+        event.kind = kind;
+        event.dropped = client.dropped;
+        event.window = window;
+        event.workspace = workspace;
+        event.monitor = monitor;
+        event.value = value;
+
+        client.out.append((const char*)&header, sizeof(header));
+        client.out.append((const char*)&event, sizeof(event));
+        client.dropped = 0;
+        ipc.events_sent++;
+        ipc.pending = true;
+    }
+}
+
+void nwm::ipc_flush_pending(Base &base) {
+    IpcServer &ipc = base.ipc;
+    if (!ipc.pending) return;
+    ipc.pending = false;
+
+    std::vector<int> dead;
+    for (auto &entry : ipc.clients) {
+        IpcClient &client = entry.second;
+        // Clients already waiting on EPOLLOUT are drained by ipc_handle.
+        if (client.out.empty() || client.want_write) continue;
+        if (!ipc_flush(base, client)) dead.push_back(entry.first);
+    }
+    for (int fd : dead) {
+        ipc_drop(base, fd);
+    }
+}
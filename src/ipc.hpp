@@ -0,0 +1,118 @@
+#ifndef IPC_HPP
+#define IPC_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Every message in either direction is an IpcHeader followed by `length`
+// bytes of payload. Both ends are on the same host, so the header is in
+// native byte order.
+#define IPC_SOCKET_NAME "nwm.sock"
+#define IPC_MAX_PAYLOAD (64 * 1024)
+// Events queued for a subscriber that is not reading are discarded beyond
+// this many bytes; the next delivered event reports how many were lost.
+#define IPC_SUBSCRIBER_BUFFER (16 * 1024)
+// Set in IpcHeader::type for event messages, which carry an IpcEvent.
+#define IPC_EVENT_FLAG 0x80000000u
+
+namespace nwm {
+
+struct Base;
+
+enum IpcType : uint32_t {
+    // Payload: commands separated by newlines or ';'. The whole batch is
+    // applied with one layout pass and one flush. Reply: JSON status.
+    IPC_COMMAND = 0,
+    // Empty payload. Reply: JSON tree of monitors, workspaces and clients.
+    IPC_GET_TREE = 1,
+    // Payload: space/comma separated event names, empty for all of them.
+    // Reply: JSON status, followed by a stream of event messages.
+    IPC_SUBSCRIBE = 2,
+    // Empty payload. Reply: JSON per-event latency histograms and request
+    // counts, or an error when built without NWM_PROFILE.
+    IPC_GET_PROFILE = 3,
+};
+
+enum IpcEventKind : uint32_t {
+    IPC_EVENT_WORKSPACE = 0,  // workspace: new current workspace
+    IPC_EVENT_FOCUS,          // window: focused window or None
+    IPC_EVENT_MANAGE,         // window, workspace
+    IPC_EVENT_UNMANAGE,       // window, workspace
+    IPC_EVENT_LAYOUT,         // value: 1 for scroll mode, 0 for master-stack
+    IPC_EVENT_MONITOR,        // monitor: current monitor, value: monitor count
+    IPC_EVENT_COUNT
+};
+
+// Names used by IPC_SUBSCRIBE and nwm-msg, indexed by IpcEventKind. This and
+// the socket path helpers live in ipc_common.cpp, linked into nwm, nwm-msg
+// and wmbench, so both ends of the socket share one copy.
+extern const char *const ipc_event_names[IPC_EVENT_COUNT];
+
+struct IpcEvent {
+    uint32_t kind;
+    // Events dropped for this subscriber since the previous delivered one.
+    uint32_t dropped;
+    uint32_t window;
+    int32_t workspace;
+    int32_t monitor;
+    int32_t value;
+};
+
+struct IpcHeader {
+    uint32_t length;
+    uint32_t type;
+};
+
+struct IpcClient {
+    int fd;
+    std::string in;
+    std::string out;
+    bool want_write;
+    // Bit per IpcEventKind; zero for plain request/reply clients.
+    uint32_t event_mask;
+    uint32_t dropped;
+};
+
+struct IpcServer {
+    int listen_fd;
+    std::string path;
+    std::unordered_map<int, IpcClient> clients;
+    // Clients with output queued since the last ipc_flush_pending.
+    bool pending;
+    // Last window announced with IPC_EVENT_FOCUS.
+    uint32_t reported_focus;
+    unsigned long events_sent;
+    unsigned long events_dropped;
+};
+
+// $XDG_RUNTIME_DIR/nwm.sock, or /tmp/nwm-UID.sock; where nwm listens.
+std::string ipc_default_socket_path();
+// $NWM_SOCKET if set, else the default; where clients connect.
+std::string ipc_socket_path();
+
+// Binds the socket and exports its path as NWM_SOCKET for spawned programs.
+// The WM keeps running without IPC if this fails.
+void ipc_init(Base &base);
+void ipc_cleanup(Base &base);
+// True for the listening socket and every connected client.
+bool ipc_owns(const Base &base, int fd);
+void ipc_handle(Base &base, int fd, uint32_t events);
+// Queues an event for every subscriber interested in `kind`. Never blocks:
+// a subscriber whose buffer is full loses the event instead.
+void ipc_emit(Base &base, IpcEventKind kind, uint32_t window,
+              int workspace, int monitor, int value);
+// Writes queued event output; called once per event loop iteration so a
+// burst of events costs one write per subscriber.
+void ipc_flush_pending(Base &base);
+
+// Runs a newline/';' separated command batch. Layout and flushes requested by
+// the individual actions are deferred to a single pass at the end. Returns
+// false and fills `error` at the first command that fails to parse; commands
+// before it stay applied.
+bool ipc_run_batch(Base &base, const std::string &batch, std::string &error);
+std::string ipc_tree_json(Base &base);
+
+}
+
+#endif // IPC_HPP
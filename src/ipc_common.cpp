@@ -0,0 +1,24 @@
+#include "ipc.hpp"
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+
+const char *const nwm::ipc_event_names[nwm::IPC_EVENT_COUNT] = {
+    "workspace", "focus", "manage", "unmanage", "layout", "monitor",
+};
+
+std::string nwm::ipc_default_socket_path() {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir && *dir) {
+        return std::string(dir) + "/" IPC_SOCKET_NAME;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/nwm-%u.sock", (unsigned)getuid());
+    return path;
+}
+
+std::string nwm::ipc_socket_path() {
+    const char *env = getenv("NWM_SOCKET");
+    if (env && *env) return env;
+    return ipc_default_socket_path();
+}
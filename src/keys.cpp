@@ -0,0 +1,129 @@
+#include "keys.hpp"
+#include "nwm.hpp"
+#include <algorithm>
+
+static const unsigned int MOD_MASKS = ShiftMask | ControlMask | Mod1Mask | Mod2Mask |
+                                      Mod3Mask | Mod4Mask | Mod5Mask;
+
+static uint32_t slot_index(const nwm::KeyTable &table, uint32_t key) {
+    return (key * 0x9E3779B1u >> 16) & table.mask;
+}
+
+// Smallest power of two keeping the table at most half full.
+static size_t key_table_capacity(size_t bindings) {
+    size_t capacity = 8;
+    while (capacity < bindings * 2) capacity *= 2;
+    return capacity;
+}
+
+static unsigned int find_numlock_mask(Display *display) {
+    unsigned int mask = 0;
+    XModifierKeymap *modmap = XGetModifierMapping(display);
+    if (!modmap) return mask;
+
+    KeyCode numlock = XKeysymToKeycode(display, XK_Num_Lock);
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < modmap->max_keypermod; ++j) {
+            if (numlock && modmap->modifiermap[i * modmap->max_keypermod + j] == numlock) {
+                mask = 1u << i;
+            }
+        }
+    }
+    XFreeModifiermap(modmap);
+    return mask;
+}
+
+unsigned int nwm::key_clean_mods(const KeyTable &table, unsigned int state) {
+    return state & ~(LockMask | table.numlock_mask) & MOD_MASKS;
+}
+
+unsigned int nwm::key_apply_modkey(const Base &base, unsigned int mod) {
+    unsigned int compiled = base.default_settings.modkey;
+    if (!(mod & compiled)) return mod;
+    return (mod & ~compiled) | base.settings.modkey;
+}
+
+void nwm::key_table_reset(Base &base, size_t bindings) {
+    KeyTable &table = base.key_table;
+    size_t capacity = key_table_capacity(bindings + base.settings.bindings.size());
+    table.slots.assign(capacity, KeyBinding{0, nullptr, nullptr});
+    table.mask = capacity - 1;
+    table.count = 0;
+    table.numlock_mask = find_numlock_mask(base.display);
+}
+
+// Returns the slot holding key, or the empty slot it belongs in. The table
+// is never full, so the walk ends within one pass.
+static nwm::KeyBinding* probe(nwm::KeyTable &table, uint32_t key) {
+    uint32_t i = slot_index(table, key);
+    for (size_t n = 0; n < table.slots.size(); ++n, i = (i + 1) & table.mask) {
+        nwm::KeyBinding &slot = table.slots[i];
+        if (slot.key == key || slot.key == 0) return &slot;
+    }
+    return nullptr;
+}
+
+static void grow(nwm::KeyTable &table) {
+    std::vector<nwm::KeyBinding> old;
+    old.swap(table.slots);
+    table.slots.assign(std::max<size_t>(old.size() * 2, 8), nwm::KeyBinding{0, nullptr, nullptr});
+    table.mask = table.slots.size() - 1;
+    for (const nwm::KeyBinding &b : old) {
+        if (b.key) *probe(table, b.key) = b;
+    }
+}
+
+void nwm::key_table_insert(Base &base, KeyCode code, unsigned int mod,
+                           void (*func)(void*, Base&), const void *arg) {
+    KeyTable &table = base.key_table;
+    uint32_t key = ((uint32_t)code << 16) | key_clean_mods(table, mod);
+
+    if ((table.count + 1) * 2 > table.slots.size()) {
+        grow(table);
+    }
+
+    KeyBinding *slot = probe(table, key);
+    if (slot->key == key) return;
+    slot->key = key;
+    slot->func = func;
+    slot->arg = arg;
+    table.count++;
+}
+
+void nwm::key_table_insert_settings(Base &base, KeyCode code, KeySym sym) {
+    for (const SettingsBinding &b : base.settings.bindings) {
+        if (b.keysym == sym) {
+            key_table_insert(base, code, b.mod, b.func, b.arg_ptr);
+        }
+    }
+}
+
+void nwm::key_table_grab(Base &base) {
+    const KeyTable &table = base.key_table;
+    XUngrabKey(base.display, AnyKey, AnyModifier, base.root);
+
+    // Without a NumLock modifier, two grabs per binding suffice.
+    unsigned int locks[] = {0, LockMask, table.numlock_mask, table.numlock_mask | LockMask};
+    int lock_count = table.numlock_mask ? 4 : 2;
+
+    for (const KeyBinding &slot : table.slots) {
+        if (!slot.key || !slot.func) continue;
+        for (int i = 0; i < lock_count; ++i) {
+            XGrabKey(base.display, slot.key >> 16, (slot.key & 0xFFFF) | locks[i],
+                     base.root, False, GrabModeAsync, GrabModeAsync);
+        }
+    }
+}
+
+const nwm::KeyBinding* nwm::key_table_find(const KeyTable &table, KeyCode code, unsigned int state) {
+    if (table.slots.empty()) return nullptr;
+
+    uint32_t key = ((uint32_t)code << 16) | key_clean_mods(table, state);
+    uint32_t i = slot_index(table, key);
+    for (size_t n = 0; n < table.slots.size(); ++n, i = (i + 1) & table.mask) {
+        const KeyBinding &slot = table.slots[i];
+        if (slot.key == key) return &slot;
+        if (slot.key == 0) return nullptr;
+    }
+    return nullptr;
+}
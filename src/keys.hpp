@@ -0,0 +1,84 @@
+#ifndef KEYS_HPP
+#define KEYS_HPP
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nwm {
+
+struct Base;
+
+// One resolved binding: (keycode << 16 | cleaned modifiers) and its action.
+// key 0 marks an empty slot; keycode 0 never occurs.
+struct KeyBinding {
+    uint32_t key;
+    void (*func)(void*, Base&);
+    const void *arg;
+};
+
+// Open-addressed table from (keycode, modifiers) to binding, rebuilt from
+// keys[] at startup and whenever the keyboard mapping changes. It doubles
+// whenever it would become more than half full.
+struct KeyTable {
+    std::vector<KeyBinding> slots;
+    uint32_t mask;
+    size_t count;
+    // The modifier NumLock is on, found from the modifier mapping.
+    unsigned int numlock_mask;
+};
+
+// Strips NumLock, CapsLock and pointer button state.
+unsigned int key_clean_mods(const KeyTable &table, unsigned int state);
+// Moves a keys[] modifier mask from the compiled MODKEY to the configured
+// modkey.
+unsigned int key_apply_modkey(const Base &base, unsigned int mod);
+// Empties the table, sized for `bindings` entries of keys[] plus those of
+// the config file. A keysym on several keycodes may still make it grow.
+void key_table_reset(Base &base, size_t bindings);
+// Keeps the first binding for a (keycode, modifiers) pair, as the linear
+// walk over keys[] did.
+void key_table_insert(Base &base, KeyCode code, unsigned int mod,
+                      void (*func)(void*, Base&), const void *arg);
+// Inserts the config file's bindings for a keycode ahead of keys[], so they
+// take precedence.
+void key_table_insert_settings(Base &base, KeyCode code, KeySym sym);
+// Replaces all key grabs on the root with the table's bindings. Keys the
+// config file unbinds have no action and are not grabbed.
+void key_table_grab(Base &base);
+const KeyBinding* key_table_find(const KeyTable &table, KeyCode code, unsigned int state);
+
+// Resolves every binding against the current keyboard mapping, with one
+// XGetKeyboardMapping for the whole keycode range. A keysym bound on several
+// keycodes is bound on all of them, matching XLookupKeysym(e, 0).
+template <typename Binding, size_t N>
+void key_table_build(Base &base, Display *display, const Binding (&bindings)[N]) {
+    static_assert(N > 0, "keys[] must not be empty");
+
+    key_table_reset(base, N);
+
+    int min_code, max_code, per_code;
+    XDisplayKeycodes(display, &min_code, &max_code);
+    KeySym *map = XGetKeyboardMapping(display, min_code, max_code - min_code + 1, &per_code);
+    if (!map) return;
+
+    for (int code = min_code; code <= max_code; ++code) {
+        KeySym sym = map[(code - min_code) * per_code];
+        if (sym == NoSymbol) continue;
+        key_table_insert_settings(base, code, sym);
+        for (const Binding &b : bindings) {
+            if (b.keysym == sym) {
+                key_table_insert(base, code, key_apply_modkey(base, b.mod), b.func, b.arg);
+            }
+        }
+    }
+    XFree(map);
+
+    key_table_grab(base);
+}
+
+}
+
+#endif // KEYS_HPP
@@ -0,0 +1,34 @@
+#include "nwm.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    const char *record = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            return nwm::trace_replay(argv[i + 1]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record = argv[++i];
+        } else {
+            std::cerr << "usage: nwm [--record TRACE | --replay TRACE]\n";
+            return 2;
+        }
+    }
+
+    nwm::Base wm;
+    wm.replaying = false;
+    nwm::init(wm);
+    if (record && !nwm::trace_start(wm, record)) {
+        std::cerr << "Warning: not recording a trace\n";
+    }
+    nwm::run(wm);
+    nwm::cleanup(wm);
+    if (wm.restart == true) {
+        nwm::snapshot_save(wm);
+        execv(*argv, argv);
+        perror("Failed to execv");
+    }
+    return 0;
+}
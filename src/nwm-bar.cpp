@@ -0,0 +1,292 @@
+#include "bar.hpp"
+#include "systray.hpp"
+#include "barfeed.hpp"
+#include "atoms.hpp"
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+#include <iostream>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#define BAR_UPDATE_INTERVAL 10
+
+static int bar_error_handler(Display *dpy, XErrorEvent *error) {
+    // Tray icons may disappear at any moment; their BadWindow errors are
+    // expected and not worth reporting.
+    if (error->error_code == BadWindow) return 0;
+
+    char error_text[1024];
+    XGetErrorText(dpy, error->error_code, error_text, sizeof(error_text));
+    std::cerr << "nwm-bar: X Error: " << error_text
+              << " Request code: " << (int)error->request_code
+              << " Resource ID: " << error->resourceid << std::endl;
+    return 0;
+}
+
+static void usage() {
+    std::cerr << "usage: nwm-bar --feed FD --wake FD [--monitor N] [--font FONT]\n"
+              << "nwm-bar is started by nwm and is not meant to be run directly.\n";
+}
+
+static void epoll_watch(nwm::BarBase &base, int fd) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(base.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+    }
+}
+
+static void dispatch_event(XEvent &e, nwm::BarBase &base) {
+    using namespace nwm;
+
+    switch (e.type) {
+        case Expose:
+            if (e.xexpose.window == base.bar.window) {
+                bar_expose(base, e.xexpose.x, e.xexpose.y, e.xexpose.width, e.xexpose.height);
+            }
+            break;
+        case ButtonPress:
+            if (e.xbutton.window == base.bar.window) {
+                if (e.xbutton.button == Button1) {
+                    bar_handle_click(base, e.xbutton.x, e.xbutton.y, e.xbutton.button);
+                } else if (e.xbutton.button == Button4) {
+                    bar_handle_scroll(base, -1);
+                } else if (e.xbutton.button == Button5) {
+                    bar_handle_scroll(base, 1);
+                }
+            }
+            break;
+        case MotionNotify:
+            if (e.xmotion.window == base.bar.window) {
+                bar_handle_motion(base, e.xmotion.x, e.xmotion.y);
+            }
+            break;
+        case LeaveNotify:
+            if (e.xcrossing.window == base.bar.window) {
+                bar_handle_motion(base, -1, -1);
+            }
+            break;
+        case ClientMessage:
+            systray_handle_client_message(base, &e.xclient);
+            break;
+        case DestroyNotify:
+            systray_handle_destroy(base, e.xdestroywindow.window);
+            break;
+        case ConfigureRequest:
+            systray_handle_configure_request(base, &e.xconfigurerequest);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool init(nwm::BarBase &base, int feed_fd, const char *font) {
+    using namespace nwm;
+
+    base.epoll_fd = -1;
+    base.timer_fd = -1;
+    base.running = false;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    base.signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    base.feed = bar_feed_attach(feed_fd);
+    close(feed_fd);
+    if (!base.feed || base.feed->magic != BAR_FEED_MAGIC) {
+        std::cerr << "nwm-bar: invalid state feed\n";
+        return false;
+    }
+    memset(&base.state, 0, sizeof(base.state));
+    bar_feed_read(base.feed, base.state);
+
+    base.display = XOpenDisplay(NULL);
+    if (!base.display) {
+        std::cerr << "nwm-bar: cannot open display\n";
+        return false;
+    }
+
+    XSetErrorHandler(bar_error_handler);
+    atoms_init(base.display);
+
+    base.screen = DefaultScreen(base.display);
+    base.root = RootWindow(base.display, base.screen);
+
+    base.xft_font = XftFontOpenName(base.display, base.screen, font);
+    if (!base.xft_font) {
+        base.xft_font = XftFontOpenName(base.display, base.screen, "monospace:size=10");
+    }
+    if (!base.xft_font) {
+        base.xft_font = XftFontOpenName(base.display, base.screen, "fixed");
+    }
+    if (!base.xft_font) {
+        std::cerr << "nwm-bar: failed to load any Xft font\n";
+        XCloseDisplay(base.display);
+        base.display = nullptr;
+        return false;
+    }
+
+    // The sampler thread must inherit the blocked signal mask.
+    bar_init(base);
+    systray_init(base);
+
+    if (base.monitor < BAR_FEED_MAX_MONITORS) {
+        base.feed->bar_window[base.monitor].store(base.bar.window);
+    }
+    if (base.systray.window) {
+        base.feed->tray_window.store(base.systray.window);
+    }
+
+    bar_draw(base);
+    return true;
+}
+
+static void cleanup(nwm::BarBase &base) {
+    using namespace nwm;
+
+    if (base.display) {
+        systray_cleanup(base);
+        bar_cleanup(base);
+
+        if (base.xft_font) {
+            XftFontClose(base.display, base.xft_font);
+            base.xft_font = nullptr;
+        }
+
+        XCloseDisplay(base.display);
+        base.display = nullptr;
+    }
+
+    if (base.feed) {
+        bar_feed_release(base.feed);
+        base.feed = nullptr;
+    }
+
+    if (base.timer_fd >= 0) close(base.timer_fd);
+    if (base.signal_fd >= 0) close(base.signal_fd);
+    if (base.epoll_fd >= 0) close(base.epoll_fd);
+    if (base.wake_fd >= 0) close(base.wake_fd);
+}
+
+static void run(nwm::BarBase &base) {
+    using namespace nwm;
+
+    base.running = true;
+
+    base.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (base.epoll_fd < 0) {
+        perror("epoll_create1");
+        return;
+    }
+
+    base.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (base.timer_fd >= 0) {
+        struct itimerspec its;
+        its.it_value.tv_sec = BAR_UPDATE_INTERVAL;
+        its.it_value.tv_nsec = 0;
+        its.it_interval.tv_sec = BAR_UPDATE_INTERVAL;
+        its.it_interval.tv_nsec = 0;
+        timerfd_settime(base.timer_fd, 0, &its, NULL);
+        epoll_watch(base, base.timer_fd);
+    }
+
+    int x_fd = ConnectionNumber(base.display);
+    epoll_watch(base, x_fd);
+    epoll_watch(base, base.wake_fd);
+    if (base.signal_fd >= 0) epoll_watch(base, base.signal_fd);
+    if (base.bar.sampler.event_fd >= 0) epoll_watch(base, base.bar.sampler.event_fd);
+
+    struct epoll_event events[8];
+
+    while (base.running) {
+        while (base.running && XPending(base.display)) {
+            XEvent e;
+            XNextEvent(base.display, &e);
+            dispatch_event(e, base);
+        }
+
+        if (!base.running) break;
+        XFlush(base.display);
+
+        int n = epoll_wait(base.epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+
+            if (fd == base.wake_fd) {
+                bar_update_state(base);
+            } else if (fd == base.timer_fd) {
+                uint64_t expirations;
+                if (read(base.timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    base.bar.systray_width = systray_get_width(base);
+                    bar_update_time(base);
+                }
+            } else if (fd == base.bar.sampler.event_fd) {
+                bar_update_system_info(base);
+            } else if (fd == base.signal_fd) {
+                base.running = false;
+            } else if (fd == x_fd && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                base.running = false;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int feed_fd = -1;
+    int wake_fd = -1;
+    int monitor = 0;
+    const char *font = "monospace:size=10";
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--feed") && i + 1 < argc) {
+            feed_fd = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--wake") && i + 1 < argc) {
+            wake_fd = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--monitor") && i + 1 < argc) {
+            monitor = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--font") && i + 1 < argc) {
+            font = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (feed_fd < 0 || wake_fd < 0 || monitor < 0 || monitor >= BAR_FEED_MAX_MONITORS) {
+        usage();
+        return 1;
+    }
+
+    nwm::BarBase bar;
+    bar.display = nullptr;
+    bar.xft_font = nullptr;
+    bar.feed = nullptr;
+    bar.wake_fd = wake_fd;
+    bar.monitor = monitor;
+    bar.signal_fd = -1;
+
+    if (init(bar, feed_fd, font)) {
+        run(bar);
+    }
+    cleanup(bar);
+    return 0;
+}
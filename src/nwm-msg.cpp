@@ -0,0 +1,162 @@
+#include "ipc.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static void usage() {
+    std::cerr << "usage: nwm-msg [-s SOCKET] COMMAND [; COMMAND ...]\n"
+              << "       nwm-msg [-s SOCKET] -t tree\n"
+              << "       nwm-msg [-s SOCKET] -t subscribe [EVENT ...]\n"
+              << "       nwm-msg [-s SOCKET] -t profile\n"
+              << "Commands: focus next|prev|WINDOW, workspace N, move_to_workspace N,\n"
+              << "          swap next|prev, set_scroll_visible N, toggle_layout\n"
+              << "Events:";
+    for (uint32_t i = 0; i < nwm::IPC_EVENT_COUNT; ++i) {
+        std::cerr << (i ? ", " : " ") << nwm::ipc_event_names[i];
+    }
+    std::cerr << " (default: all)\n"
+              << "Pass - as the command to read a batch from stdin.\n";
+}
+
+static bool write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string path = nwm::ipc_socket_path();
+    uint32_t type = nwm::IPC_COMMAND;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            std::string t = argv[++i];
+            if (t == "command") {
+                type = nwm::IPC_COMMAND;
+            } else if (t == "tree") {
+                type = nwm::IPC_GET_TREE;
+            } else if (t == "profile") {
+                type = nwm::IPC_GET_PROFILE;
+            } else if (t == "subscribe") {
+                type = nwm::IPC_SUBSCRIBE;
+            } else {
+                usage();
+                return 2;
+            }
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::string payload;
+    if (i < argc && strcmp(argv[i], "-") == 0) {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+            payload.append(buf, n);
+        }
+    } else {
+        for (; i < argc; ++i) {
+            if (!payload.empty()) payload += ' ';
+            payload += argv[i];
+        }
+    }
+
+    if (type == nwm::IPC_COMMAND && payload.empty()) {
+        usage();
+        return 2;
+    }
+    if (payload.size() > IPC_MAX_PAYLOAD) {
+        std::cerr << "nwm-msg: message too long\n";
+        return 2;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "nwm-msg: socket path too long\n";
+        return 1;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror(("nwm-msg: " + path).c_str());
+        return 1;
+    }
+
+    nwm::IpcHeader header;
+    header.length = payload.size();
+    header.type = type;
+    if (!write_all(fd, (const char*)&header, sizeof(header)) ||
+        !write_all(fd, payload.data(), payload.size())) {
+        perror("nwm-msg: write");
+        return 1;
+    }
+
+    if (!read_all(fd, (char*)&header, sizeof(header)) || header.length > IPC_MAX_PAYLOAD * 64) {
+        std::cerr << "nwm-msg: no reply\n";
+        return 1;
+    }
+    std::string reply(header.length, '\0');
+    if (!read_all(fd, &reply[0], reply.size())) {
+        std::cerr << "nwm-msg: short reply\n";
+        return 1;
+    }
+
+    bool ok = reply.find("\"success\":false") == std::string::npos;
+    if (type != nwm::IPC_SUBSCRIBE || !ok) {
+        close(fd);
+        std::cout << reply << "\n";
+        return ok ? 0 : 1;
+    }
+
+    for (;;) {
+        if (!read_all(fd, (char*)&header, sizeof(header)) || header.length > IPC_MAX_PAYLOAD) break;
+        std::string payload(header.length, '\0');
+        if (!read_all(fd, &payload[0], payload.size())) break;
+        if (!(header.type & IPC_EVENT_FLAG) || payload.size() < sizeof(nwm::IpcEvent)) continue;
+
+        nwm::IpcEvent event;
+        memcpy(&event, payload.data(), sizeof(event));
+        if (event.kind >= nwm::IPC_EVENT_COUNT) continue;
+
+        printf("%s window=0x%x workspace=%d monitor=%d value=%d",
+               nwm::ipc_event_names[event.kind], event.window, event.workspace,
+               event.monitor, event.value);
+        if (event.dropped) printf(" dropped=%u", event.dropped);
+        printf("\n");
+        fflush(stdout);
+    }
+    close(fd);
+    return 0;
+}
@@ -1,26 +1,31 @@
 #include "nwm.hpp"
 #include "config.hpp"
-#include "bar.hpp"
 #include "tiling.hpp"
-#include "systray.hpp"
+#include "atoms.hpp"
+#include "traits.hpp"
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 #include <X11/cursorfont.h>
-#include <X11/Xft/Xft.h>
 #include <X11/extensions/Xrandr.h>
 #include <iostream>
 #include <algorithm>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <csignal>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
 #include <vector>
 #include <string>
 
+
 int x_error_handler(Display *dpy, XErrorEvent *error) {
     char error_text[1024];
     XGetErrorText(dpy, error->error_code, error_text, sizeof(error_text));
@@ -30,44 +35,64 @@ int x_error_handler(Display *dpy, XErrorEvent *error) {
     return 0;
 }
 
+// Focus can move as a side effect of switching workspaces or closing
+// windows, so every such path reports it here rather than in focus_window.
+static void report_focus(nwm::Base &base) {
+    uint32_t window = base.focused_window ? base.focused_window->window : None;
+    if (window == base.ipc.reported_focus) return;
+    base.ipc.reported_focus = window;
+    nwm::ipc_emit(base, nwm::IPC_EVENT_FOCUS, window, base.current_workspace,
+                  base.current_monitor, 0);
+}
+
+static uint64_t mode_frame_ns(XRRScreenResources *sr, RRMode mode) {
+    for (int i = 0; i < sr->nmode; i++) {
+        const XRRModeInfo &m = sr->modes[i];
+        if (m.id != mode) continue;
+        if (!m.dotClock || !m.hTotal || !m.vTotal) break;
+
+        double vtotal = m.vTotal;
+        if (m.modeFlags & RR_DoubleScan) vtotal *= 2;
+        if (m.modeFlags & RR_Interlace) vtotal /= 2;
+        return (uint64_t)(1e9 * m.hTotal * vtotal / m.dotClock);
+    }
+    return DEFAULT_FRAME_NS;
+}
+
+// A single monitor covering the whole screen, for when XRandR is missing or
+// reports no active CRTC.
+static nwm::Monitor fallback_monitor(const nwm::Base &base) {
+    nwm::Monitor mon;
+    mon.id = 0;
+    mon.x = 0;
+    mon.y = 0;
+    mon.width = WIDTH(base.display, base.screen);
+    mon.height = HEIGHT(base.display, base.screen);
+    mon.current_workspace = 0;
+    mon.master_factor = 0.5f;
+    mon.horizontal_mode = false;
+    mon.scroll_windows_visible = base.settings.scroll_windows_visible;
+    mon.crtc = 0;
+    mon.frame_ns = DEFAULT_FRAME_NS;
+    return mon;
+}
+
 void nwm::monitors_init(Base &base) {
     base.monitors.clear();
     base.current_monitor = 0;
 
     int event_base, error_base;
     if (!XRRQueryExtension(base.display, &event_base, &error_base)) {
-        Monitor mon;
-        mon.id = 0;
-        mon.x = 0;
-        mon.y = 0;
-        mon.width = WIDTH(base.display, base.screen);
-        mon.height = HEIGHT(base.display, base.screen);
-        mon.current_workspace = 0;
-        mon.master_factor = 0.5f;
-        mon.horizontal_mode = false;
-        mon.scroll_windows_visible = SCROLL_WINDOWS_VISIBLE;
-        mon.crtc = 0;
-        base.monitors.push_back(mon);
+        base.monitors.push_back(fallback_monitor(base));
         return;
     }
 
     base.xrandr_event_base = event_base;
     XRRSelectInput(base.display, base.root, RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask);
 
-    XRRScreenResources *sr = XRRGetScreenResources(base.display, base.root);
+    XRRScreenResources *sr = XRRGetScreenResourcesCurrent(base.display, base.root);
     if (!sr) {
-        Monitor mon;
-        mon.id = 0;
-        mon.x = 0;
-        mon.y = 0;
-        mon.width = WIDTH(base.display, base.screen);
-        mon.height = HEIGHT(base.display, base.screen);
-        mon.current_workspace = 0;
-        mon.master_factor = 0.5f;
-        mon.horizontal_mode = false;
-        mon.scroll_windows_visible = SCROLL_WINDOWS_VISIBLE;
-        mon.crtc = 0;
-        base.monitors.push_back(mon);
+        base.monitors.push_back(fallback_monitor(base));
         return;
     }
 
@@ -85,8 +110,9 @@ void nwm::monitors_init(Base &base) {
             mon.current_workspace = mon.id % NUM_WORKSPACES;
             mon.master_factor = 0.5f;
             mon.horizontal_mode = false;
-            mon.scroll_windows_visible = SCROLL_WINDOWS_VISIBLE;
+            mon.scroll_windows_visible = base.settings.scroll_windows_visible;
             mon.crtc = sr->crtcs[i];
+            mon.frame_ns = mode_frame_ns(sr, ci->mode);
             base.monitors.push_back(mon);
         }
 
@@ -96,51 +122,58 @@ void nwm::monitors_init(Base &base) {
     XRRFreeScreenResources(sr);
 
     if (base.monitors.empty()) {
-        Monitor mon;
-        mon.id = 0;
-        mon.x = 0;
-        mon.y = 0;
-        mon.width = WIDTH(base.display, base.screen);
-        mon.height = HEIGHT(base.display, base.screen);
-        mon.current_workspace = 0;
-        mon.master_factor = 0.5f;
-        mon.horizontal_mode = false;
-        mon.scroll_windows_visible = SCROLL_WINDOWS_VISIBLE;
-        mon.crtc = 0;
-        base.monitors.push_back(mon);
+        base.monitors.push_back(fallback_monitor(base));
+    }
+}
+
+static const nwm::Monitor* find_crtc(const std::vector<nwm::Monitor> &monitors, RRCrtc crtc) {
+    for (const auto &mon : monitors) {
+        if (mon.crtc == crtc) return &mon;
     }
+    return nullptr;
 }
 
+// Only the CRTCs named by RRCrtcChangeNotify events are queried; the others
+// keep what is already known about them. Without any such event (a bare
+// RRScreenChangeNotify) every CRTC is read again. Either way the resources
+// come from XRRGetScreenResourcesCurrent, which does not reprobe outputs.
 void nwm::monitors_update(Base &base) {
     std::vector<Monitor> old_monitors = base.monitors;
-    base.monitors.clear();
+    std::vector<RRCrtc> changed;
+    changed.swap(base.monitors_changed_crtcs);
+    bool requery = changed.empty();
 
-    XRRScreenResources *sr = XRRGetScreenResources(base.display, base.root);
+    XRRScreenResources *sr = XRRGetScreenResourcesCurrent(base.display, base.root);
     if (!sr) return;
 
+    base.monitors.clear();
     for (int i = 0; i < sr->ncrtc; i++) {
-        XRRCrtcInfo *ci = XRRGetCrtcInfo(base.display, sr, sr->crtcs[i]);
+        RRCrtc crtc = sr->crtcs[i];
+        const Monitor *old_mon = find_crtc(old_monitors, crtc);
+
+        if (!requery && std::find(changed.begin(), changed.end(), crtc) == changed.end()) {
+            // Untouched: still active if it was, still off if it was not.
+            if (old_mon) {
+                base.monitors.push_back(*old_mon);
+                base.monitors.back().id = base.monitors.size() - 1;
+            }
+            continue;
+        }
+
+        XRRCrtcInfo *ci = XRRGetCrtcInfo(base.display, sr, crtc);
         if (!ci) continue;
 
         if (ci->width > 0 && ci->height > 0 && ci->noutput > 0) {
             Monitor mon;
 
-            bool found = false;
-            for (const auto &old_mon : old_monitors) {
-                if (old_mon.crtc == sr->crtcs[i]) {
-                    mon.current_workspace = old_mon.current_workspace;
-                    mon.master_factor = old_mon.master_factor;
-                    mon.horizontal_mode = old_mon.horizontal_mode;
-                    mon.scroll_windows_visible = old_mon.scroll_windows_visible;
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {
-                mon.current_workspace = base.monitors.size() % NUM_WORKSPACES;
+            if (old_mon) {
+                mon = *old_mon;
+            } else {
+                // monitors_changed picks a workspace nobody else shows.
+                mon.current_workspace = -1;
                 mon.master_factor = 0.5f;
                 mon.horizontal_mode = false;
+                mon.scroll_windows_visible = base.settings.scroll_windows_visible;
             }
 
             mon.id = base.monitors.size();
@@ -148,7 +181,8 @@ void nwm::monitors_update(Base &base) {
             mon.y = ci->y;
             mon.width = ci->width;
             mon.height = ci->height;
-            mon.crtc = sr->crtcs[i];
+            mon.crtc = crtc;
+            mon.frame_ns = mode_frame_ns(sr, ci->mode);
             base.monitors.push_back(mon);
         }
 
@@ -158,37 +192,101 @@ void nwm::monitors_update(Base &base) {
     XRRFreeScreenResources(sr);
 
     if (base.monitors.empty()) {
-        Monitor mon;
-        mon.id = 0;
-        mon.x = 0;
-        mon.y = 0;
-        mon.width = WIDTH(base.display, base.screen);
-        mon.height = HEIGHT(base.display, base.screen);
-        mon.current_workspace = 0;
-        mon.master_factor = 0.5f;
-        mon.horizontal_mode = false;
-        mon.crtc = 0;
+        Monitor mon = fallback_monitor(base);
+        if (!old_monitors.empty()) mon.current_workspace = old_monitors[0].current_workspace;
         base.monitors.push_back(mon);
     }
 
+    monitors_changed(base, old_monitors);
+}
+
+static bool workspace_shown(const std::vector<nwm::Monitor> &monitors, int workspace) {
+    for (const auto &mon : monitors) {
+        if (mon.current_workspace == workspace) return true;
+    }
+    return false;
+}
+
+void nwm::monitors_changed(Base &base, const std::vector<Monitor> &old_monitors) {
     if (base.current_monitor >= (int)base.monitors.size()) {
         base.current_monitor = base.monitors.size() - 1;
     }
 
-    for (auto &ws : base.workspaces) {
-        for (auto &w : ws.windows) {
-            Monitor *mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
-            if (mon) {
-                w.monitor = mon->id;
+    // Two monitors never show the same workspace; a new monitor or a
+    // duplicate gets the lowest one nobody shows.
+    for (size_t i = 0; i < base.monitors.size(); ++i) {
+        Monitor &mon = base.monitors[i];
+        bool duplicate = mon.current_workspace < 0;
+        for (size_t j = 0; j < i; ++j) {
+            if (base.monitors[j].current_workspace == mon.current_workspace) duplicate = true;
+        }
+        if (!duplicate) continue;
+        mon.current_workspace = -1;
+        for (int ws = 0; ws < NUM_WORKSPACES; ++ws) {
+            if (!workspace_shown(base.monitors, ws)) {
+                mon.current_workspace = ws;
+                break;
             }
         }
+        if (mon.current_workspace < 0) mon.current_workspace = 0;
     }
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
+    for (int ws = 0; ws < NUM_WORKSPACES; ++ws) {
+        if (!workspace_shown(old_monitors, ws) || workspace_shown(base.monitors, ws)) continue;
+        for (ClientHandle h : base.workspaces[ws].clients) {
+            hide_window(client_get(base, h), base);
+        }
+    }
+
+    // Monitor ids follow CRTC order and shift when one goes away; clients
+    // keep pointing at the same output. Only monitors that are new, moved,
+    // resized or show another workspace are laid out again.
+    std::vector<int> renumber(old_monitors.size(), -1);
+    std::vector<bool> settled(base.monitors.size(), false);
+    for (size_t i = 0; i < old_monitors.size(); ++i) {
+        const Monitor &old_mon = old_monitors[i];
+        for (size_t j = 0; j < base.monitors.size(); ++j) {
+            const Monitor &mon = base.monitors[j];
+            bool same = old_mon.crtc ? old_mon.crtc == mon.crtc : old_mon.id == mon.id;
+            if (!same) continue;
+            renumber[i] = j;
+            settled[j] = old_mon.x == mon.x && old_mon.y == mon.y &&
+                         old_mon.width == mon.width && old_mon.height == mon.height &&
+                         old_mon.current_workspace == mon.current_workspace;
+            break;
+        }
+    }
+    for (auto &slot : base.client_store.slots) {
+        if (!slot.live) continue;
+        ManagedWindow &w = slot.client;
+        if (w.monitor >= 0 && w.monitor < (int)renumber.size() && renumber[w.monitor] >= 0) {
+            w.monitor = renumber[w.monitor];
+        } else {
+            w.monitor = 0;
+        }
+    }
+
+    for (size_t j = 0; j < base.monitors.size(); ++j) {
+        if (!settled[j]) tile_monitor(base, base.monitors[j]);
+    }
+
+    for (int ws = 0; ws < NUM_WORKSPACES; ++ws) {
+        if (workspace_shown(old_monitors, ws) || !workspace_shown(base.monitors, ws)) continue;
+        for (ClientHandle h : base.workspaces[ws].clients) {
+            base.backend->map(base, client_get(base, h)->window);
+        }
+    }
+
+    Monitor *mon = get_current_monitor(base);
+    if (mon) {
+        base.current_workspace = mon->current_workspace;
+        base.horizontal_mode = mon->horizontal_mode;
     }
+    base.focused_window = get_current_workspace(base).focused_window;
+    flush(base);
+
+    ipc_emit(base, IPC_EVENT_MONITOR, None, base.current_workspace,
+             base.current_monitor, base.monitors.size());
 }
 
 nwm::Monitor* nwm::get_monitor_at_point(Base &base, int x, int y) {
@@ -208,25 +306,49 @@ nwm::Monitor* nwm::get_current_monitor(Base &base) {
     return base.monitors.empty() ? nullptr : &base.monitors[0];
 }
 
+nwm::Monitor* nwm::workspace_monitor(Base &base, int workspace) {
+    for (auto &mon : base.monitors) {
+        if (mon.current_workspace == workspace) return &mon;
+    }
+    return nullptr;
+}
+
+void nwm::select_monitor(Base &base, int id) {
+    if (id < 0 || id >= (int)base.monitors.size() || id == base.current_monitor) return;
+
+    ManagedWindow *prev = base.focused_window;
+    if (prev) {
+        if (!prev->is_floating && !prev->is_fullscreen) {
+            base.backend->set_border(base, prev->window, base.border_color);
+        }
+        prev->is_focused = false;
+    }
+
+    Monitor &mon = base.monitors[id];
+    base.current_monitor = id;
+    base.current_workspace = mon.current_workspace;
+    base.horizontal_mode = mon.horizontal_mode;
+    focus_window(get_current_workspace(base).focused_window, base);
+    bar_link_publish(base);
+
+    // Every caller (pointer crossings, clicks, drops, bar clicks) changes
+    // the current workspace along with the monitor, so the event goes here.
+    ipc_emit(base, IPC_EVENT_MONITOR, None, base.current_workspace,
+             base.current_monitor, base.monitors.size());
+}
+
 void nwm::focus_monitor(void *arg, Base &base) {
     if (!arg) return;
     int target_mon = *(int*)arg;
 
     if (target_mon >= 0 && target_mon < (int)base.monitors.size()) {
-        base.current_monitor = target_mon;
-
-        Window root_return, child_return;
-        int root_x, root_y, win_x, win_y;
-        unsigned int mask;
-        XQueryPointer(base.display, base.root, &root_return, &child_return,
-                     &root_x, &root_y, &win_x, &win_y, &mask);
+        select_monitor(base, target_mon);
 
         Monitor *mon = &base.monitors[target_mon];
         XWarpPointer(base.display, None, base.root, 0, 0, 0, 0,
                     mon->x + mon->width / 2, mon->y + mon->height / 2);
 
-        base.current_workspace = mon->current_workspace;
-        bar_update_workspaces(base);
+        report_focus(base);
     }
 }
 
@@ -243,294 +365,132 @@ void nwm::set_scroll_visible(void *arg, Base &base) {
     mon->scroll_windows_visible = visible;
 
     if (mon->horizontal_mode) {
-        tile_horizontal(base);
+        tile_current(base);
     }
 
-    bar_draw(base);
+    bar_link_publish(base);
 }
 
-bool should_float(Display *display, Window window) {
-    XWindowAttributes attr;
-    if (!XGetWindowAttributes(display, window, &attr)) {
-        return false;
-    }
-
-    Atom actual_type;
-    int actual_format;
-    unsigned long nitems, bytes_after;
-    unsigned char *prop = nullptr;
-
-    Atom window_type_atom = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
-    if (XGetWindowProperty(display, window, window_type_atom, 0, 1,
-                          False, XA_ATOM, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        Atom type = *(Atom*)prop;
-        XFree(prop);
-
-        Atom dialog = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DIALOG", False);
-        Atom splash = XInternAtom(display, "_NET_WM_WINDOW_TYPE_SPLASH", False);
-        Atom utility = XInternAtom(display, "_NET_WM_WINDOW_TYPE_UTILITY", False);
-
-        if (type == dialog || type == splash || type == utility) {
-            return true;
-        }
-    }
-
-    Atom state_atom = XInternAtom(display, "_NET_WM_STATE", False);
-    if (XGetWindowProperty(display, window, state_atom, 0, 32,
-                          False, XA_ATOM, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        Atom *states = (Atom*)prop;
-        Atom modal = XInternAtom(display, "_NET_WM_STATE_MODAL", False);
-        Atom above = XInternAtom(display, "_NET_WM_STATE_ABOVE", False);
-
-        for (unsigned long i = 0; i < nitems; i++) {
-            if (states[i] == modal || states[i] == above) {
-                XFree(prop);
-                return true;
-            }
-        }
-        XFree(prop);
-    }
-
-    Window transient_for;
-    if (XGetTransientForHint(display, window, &transient_for)) {
-        if (transient_for != None && transient_for != window) {
-            return true;
-        }
-    }
+static void track_overlay(nwm::Base &base, Window window, int width, int height,
+                          bool override_redirect, bool special, bool mapped) {
+    if (bar_link_owns(base, window)) return;
 
-    XSizeHints hints;
-    long supplied;
-    if (XGetWMNormalHints(display, window, &hints, &supplied)) {
-        if ((hints.flags & PMaxSize) && (hints.flags & PMinSize)) {
-            if (hints.max_width == hints.min_width &&
-                hints.max_height == hints.min_height &&
-                hints.max_width < 800 && hints.max_height < 600) {
-                return true;
-            }
-        }
+    auto it = base.overlays.find(window);
+    if (it == base.overlays.end()) {
+        nwm::OverlayWindow ow;
+        ow.window = window;
+        ow.order = base.overlay_order++;
+        it = base.overlays.emplace(window, ow).first;
     }
 
-    return false;
+    it->second.width = width;
+    it->second.height = height;
+    it->second.override_redirect = override_redirect;
+    it->second.special = special;
+    it->second.mapped = mapped;
 }
 
-bool should_ignore_window(Display *display, Window window) {
-    XWindowAttributes attr;
-    if (!XGetWindowAttributes(display, window, &attr)) {
-        return true;
-    }
-
-    if (attr.override_redirect) {
-        return true;
-    }
-
-    if (attr.c_class == InputOnly) {
-        return true;
-    }
-
-    Atom actual_type;
-    int actual_format;
-    unsigned long nitems, bytes_after;
-    unsigned char *prop = nullptr;
-
-    Atom window_type_atom = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
-    if (XGetWindowProperty(display, window, window_type_atom, 0, (~0L),
-                          False, XA_ATOM, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        Atom *types = (Atom*)prop;
-
-        Atom dock = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DOCK", False);
-        Atom desktop = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DESKTOP", False);
-        Atom notification = XInternAtom(display, "_NET_WM_WINDOW_TYPE_NOTIFICATION", False);
-        Atom tooltip = XInternAtom(display, "_NET_WM_WINDOW_TYPE_TOOLTIP", False);
-        Atom combo = XInternAtom(display, "_NET_WM_WINDOW_TYPE_COMBO", False);
-        Atom dnd = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DND", False);
-        Atom dropdown = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", False);
-        Atom popup = XInternAtom(display, "_NET_WM_WINDOW_TYPE_POPUP_MENU", False);
-
-        for (unsigned long i = 0; i < nitems; i++) {
-            if (types[i] == dock || types[i] == desktop || types[i] == notification ||
-                types[i] == tooltip || types[i] == combo || types[i] == dnd ||
-                types[i] == dropdown || types[i] == popup) {
-                XFree(prop);
-                return true;
-            }
-        }
-        XFree(prop);
-    }
-
-    Atom state_atom = XInternAtom(display, "_NET_WM_STATE", False);
-    if (XGetWindowProperty(display, window, state_atom, 0, (~0L),
-                          False, XA_ATOM, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        Atom *states = (Atom*)prop;
-        Atom skip_taskbar = XInternAtom(display, "_NET_WM_STATE_SKIP_TASKBAR", False);
-        Atom skip_pager = XInternAtom(display, "_NET_WM_STATE_SKIP_PAGER", False);
-
-        bool has_skip_taskbar = false;
-        bool has_skip_pager = false;
-
-        for (unsigned long i = 0; i < nitems; i++) {
-            if (states[i] == skip_taskbar) has_skip_taskbar = true;
-            if (states[i] == skip_pager) has_skip_pager = true;
-        }
+// Raises the given overlays above everything else while keeping their
+// relative order: one XRaiseWindow plus one XRestackWindows, no replies.
+static void raise_overlay_block(nwm::Base &base, std::vector<const nwm::OverlayWindow*> &list) {
+    if (list.empty()) return;
 
-        XFree(prop);
+    std::sort(list.begin(), list.end(), [](const nwm::OverlayWindow *a, const nwm::OverlayWindow *b) {
+        return a->order > b->order;
+    });
 
-        if (has_skip_taskbar && has_skip_pager) {
-            return true;
-        }
+    std::vector<Window> stack;
+    stack.reserve(list.size());
+    for (auto *ow : list) {
+        stack.push_back(ow->window);
     }
 
-    XClassHint class_hint;
-    if (XGetClassHint(display, window, &class_hint)) {
-        bool ignore = false;
-        if (class_hint.res_class) {
-            std::string class_name(class_hint.res_class);
-            if (class_name == "Dunst" ||
-                class_name == "Xfce4-notifyd" ||
-                class_name == "Notify-osd" ||
-                class_name == "notification" ||
-                class_name == "Notification") {
-                ignore = true;
-            }
-            XFree(class_hint.res_class);
-        }
-        if (class_hint.res_name) {
-            XFree(class_hint.res_name);
-        }
-        if (ignore) return true;
+    base.backend->raise(base, stack[0]);
+    if (stack.size() > 1) {
+        base.backend->restack(base, stack.data(), stack.size());
     }
-
-    return false;
 }
 
-void nwm::raise_override_redirect_windows(Display *display) {
-    Window root = DefaultRootWindow(display);
-    Window root_return, parent_return;
-    Window *children;
-    unsigned int nchildren;
+void nwm::raise_override_redirect_windows(Base &base, bool large_only) {
+    if (base.overlays.empty()) return;
 
-    if (!XQueryTree(display, root, &root_return, &parent_return, &children, &nchildren)) {
-        return;
-    }
+    int min_width = WIDTH(base.display, base.screen) / 4;
+    int min_height = HEIGHT(base.display, base.screen) / 4;
 
-    for (unsigned int i = 0; i < nchildren; ++i) {
-        XWindowAttributes attr;
-        if (XGetWindowAttributes(display, children[i], &attr)) {
-            if (attr.override_redirect && attr.map_state == IsViewable) {
-                XRaiseWindow(display, children[i]);
-            }
-        }
+    std::vector<const OverlayWindow*> list;
+    for (const auto &entry : base.overlays) {
+        const OverlayWindow &ow = entry.second;
+        if (!ow.override_redirect || !ow.mapped) continue;
+        if (bar_link_owns(base, ow.window)) continue;
+        if (large_only && !(ow.width > min_width && ow.height > min_height)) continue;
+        list.push_back(&ow);
     }
 
-    if (children) {
-        XFree(children);
-    }
+    raise_overlay_block(base, list);
 }
 
-void nwm::handle_special_window_map(Display *display, Window window) {
-    XWindowAttributes attr;
-    if (!XGetWindowAttributes(display, window, &attr)) {
+void nwm::handle_special_window_map(Base &base, const WindowTraits &traits) {
+    if (!traits.valid) {
         return;
     }
 
-    if (attr.override_redirect) {
-        XRaiseWindow(display, window);
+    if (traits.override_redirect) {
+        base.backend->raise(base, traits.window);
         return;
     }
 
-    Atom actual_type;
-    int actual_format;
-    unsigned long nitems, bytes_after;
-    unsigned char *prop = nullptr;
-
-    Atom window_type_atom = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
-    if (XGetWindowProperty(display, window, window_type_atom, 0, (~0L),
-                          False, XA_ATOM, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        Atom *types = (Atom*)prop;
-
-        Atom notification = XInternAtom(display, "_NET_WM_WINDOW_TYPE_NOTIFICATION", False);
-        Atom tooltip = XInternAtom(display, "_NET_WM_WINDOW_TYPE_TOOLTIP", False);
-        Atom dropdown = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", False);
-        Atom popup = XInternAtom(display, "_NET_WM_WINDOW_TYPE_POPUP_MENU", False);
-        Atom combo = XInternAtom(display, "_NET_WM_WINDOW_TYPE_COMBO", False);
-
-        for (unsigned long i = 0; i < nitems; i++) {
-            if (types[i] == notification || types[i] == tooltip ||
-                types[i] == dropdown || types[i] == popup || types[i] == combo) {
-                XFree(prop);
-                XRaiseWindow(display, window);
-                return;
-            }
-        }
-        XFree(prop);
+    if (traits.special) {
+        track_overlay(base, traits.window, traits.width, traits.height, false, true, true);
+        base.backend->raise(base, traits.window);
     }
 }
 
-void nwm::raise_special_windows(Display *display) {
-    Window root = DefaultRootWindow(display);
-    Window root_return, parent_return;
-    Window *children;
-    unsigned int nchildren;
-
-    if (!XQueryTree(display, root, &root_return, &parent_return, &children, &nchildren)) {
-        return;
+void nwm::raise_special_windows(Base &base) {
+    std::vector<const OverlayWindow*> list;
+    for (const auto &entry : base.overlays) {
+        const OverlayWindow &ow = entry.second;
+        if (bar_link_owns(base, ow.window)) continue;
+        if (ow.mapped && (ow.override_redirect || ow.special)) {
+            list.push_back(&ow);
+        }
     }
 
-    std::vector<Window> special_windows;
-
-    for (unsigned int i = 0; i < nchildren; ++i) {
-        XWindowAttributes attr;
-        if (!XGetWindowAttributes(display, children[i], &attr)) {
-            continue;
-        }
+    raise_overlay_block(base, list);
+}
 
-        if (attr.map_state != IsViewable) {
-            continue;
-        }
+void nwm::handle_create_notify(XCreateWindowEvent *e, Base &base) {
+    if (e->parent != base.root || !e->override_redirect) return;
+    track_overlay(base, e->window, e->width, e->height, true, false, false);
+}
 
-        if (attr.override_redirect) {
-            special_windows.push_back(children[i]);
-            continue;
-        }
+void nwm::handle_map_notify(XMapEvent *e, Base &base) {
+    if (e->event != base.root) return;
 
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *prop = nullptr;
-
-        Atom window_type_atom = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
-        if (XGetWindowProperty(display, children[i], window_type_atom, 0, (~0L),
-                              False, XA_ATOM, &actual_type, &actual_format,
-                              &nitems, &bytes_after, &prop) == Success && prop) {
-            Atom *types = (Atom*)prop;
-
-            Atom notification = XInternAtom(display, "_NET_WM_WINDOW_TYPE_NOTIFICATION", False);
-            Atom dropdown = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", False);
-            Atom popup = XInternAtom(display, "_NET_WM_WINDOW_TYPE_POPUP_MENU", False);
-            Atom combo = XInternAtom(display, "_NET_WM_WINDOW_TYPE_COMBO", False);
-            Atom tooltip = XInternAtom(display, "_NET_WM_WINDOW_TYPE_TOOLTIP", False);
-
-            for (unsigned long j = 0; j < nitems; j++) {
-                if (types[j] == notification || types[j] == dropdown ||
-                    types[j] == popup || types[j] == combo || types[j] == tooltip) {
-                    special_windows.push_back(children[i]);
-                    break;
-                }
-            }
-            XFree(prop);
+    auto it = base.overlays.find(e->window);
+    if (it != base.overlays.end()) {
+        it->second.mapped = true;
+    } else if (e->override_redirect) {
+        XWindowAttributes attr;
+        if (XGetWindowAttributes(base.display, e->window, &attr)) {
+            track_overlay(base, e->window, attr.width, attr.height, true, false, true);
         }
     }
+}
 
-    for (Window w : special_windows) {
-        XRaiseWindow(display, w);
+void nwm::handle_configure_notify(XConfigureEvent *e, Base &base) {
+    if (e->event != base.root) return;
+
+    auto it = base.overlays.find(e->window);
+    if (it != base.overlays.end()) {
+        it->second.width = e->width;
+        it->second.height = e->height;
+        it->second.override_redirect = e->override_redirect;
     }
+}
 
-    if (children) {
-        XFree(children);
+void nwm::handle_reparent_notify(XReparentEvent *e, Base &base) {
+    if (e->parent != base.root) {
+        base.overlays.erase(e->window);
     }
 }
 
@@ -545,69 +505,123 @@ void nwm::workspace_init(Base &base) {
     base.overview_mode = false;
     base.dragging = false;
     base.drag_window = None;
+    base.drag_client = NO_CLIENT;
     base.drag_start_x = 0;
     base.drag_start_y = 0;
+    base.drag_pending = false;
+    base.drag_applied_ns = 0;
 }
 
 nwm::Workspace& nwm::get_current_workspace(Base &base) {
     return base.workspaces[base.current_workspace];
 }
 
+nwm::ClientHandle nwm::client_create(Base &base, const ManagedWindow &window) {
+    auto &store = base.client_store;
+    uint16_t slot;
+
+    if (!store.free_slots.empty()) {
+        slot = store.free_slots.back();
+        store.free_slots.pop_back();
+    } else {
+        if (store.slots.size() > 0xFFFF) return NO_CLIENT;
+        slot = store.slots.size();
+        store.slots.push_back(ClientSlot());
+        store.slots.back().generation = 0;
+    }
+
+    ClientSlot &s = store.slots[slot];
+    s.generation++;
+    if (s.generation == 0) s.generation = 1;
+    s.live = true;
+    s.client = window;
+    s.client.handle = ((ClientHandle)s.generation << 16) | slot;
+
+    base.window_index[window.window] = s.client.handle;
+    return s.client.handle;
+}
+
+void nwm::client_destroy(Base &base, ClientHandle handle) {
+    ManagedWindow *w = client_get(base, handle);
+    if (!w) return;
+
+    base.window_index.erase(w->window);
+
+    uint16_t slot = handle & 0xFFFF;
+    base.client_store.slots[slot].live = false;
+    base.client_store.free_slots.push_back(slot);
+}
+
+nwm::ManagedWindow* nwm::client_get(Base &base, ClientHandle handle) {
+    uint16_t slot = handle & 0xFFFF;
+    uint16_t generation = handle >> 16;
+    auto &slots = base.client_store.slots;
+
+    if (slot >= slots.size()) return nullptr;
+    ClientSlot &s = slots[slot];
+    if (!s.live || s.generation != generation) return nullptr;
+    return &s.client;
+}
+
+nwm::ManagedWindow* nwm::find_window(Base &base, Window window) {
+    auto it = base.window_index.find(window);
+    if (it == base.window_index.end()) return nullptr;
+    return client_get(base, it->second);
+}
+
+int nwm::workspace_position(const Workspace &ws, ClientHandle handle) {
+    auto it = std::find(ws.clients.begin(), ws.clients.end(), handle);
+    if (it == ws.clients.end()) return -1;
+    return it - ws.clients.begin();
+}
+
 void nwm::toggle_scroll_maximize(void *arg, Base &base) {
     (void)arg;
     if (!base.horizontal_mode) return;
     auto &current_ws = get_current_workspace(base);
     current_ws.scroll_maximized = !current_ws.scroll_maximized;
     current_ws.scroll_offset = 0;
-    tile_horizontal(base);
+    tile_current(base);
 }
 
 void nwm::toggle_fullscreen(void *arg, Base &base) {
     (void)arg;
     if (!base.focused_window) return;
 
-    auto &current_ws = get_current_workspace(base);
-    for (auto &w : current_ws.windows) {
-        if (w.window == base.focused_window->window) {
-            w.is_fullscreen = !w.is_fullscreen;
+    ManagedWindow &w = *base.focused_window;
+    w.is_fullscreen = !w.is_fullscreen;
 
-            if (w.is_fullscreen) {
-                w.pre_fs_x = w.x;
-                w.pre_fs_y = w.y;
-                w.pre_fs_width = w.width;
-                w.pre_fs_height = w.height;
-                w.pre_fs_floating = w.is_floating;
+    if (w.is_fullscreen) {
+        w.pre_fs_x = w.x;
+        w.pre_fs_y = w.y;
+        w.pre_fs_width = w.width;
+        w.pre_fs_height = w.height;
+        w.pre_fs_floating = w.is_floating;
 
-                Monitor *mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
-                if (!mon) mon = get_current_monitor(base);
-                if (!mon) return;
+        Monitor *mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
+        if (!mon) mon = get_current_monitor(base);
+        if (!mon) return;
 
-                XSetWindowBorderWidth(base.display, w.window, 0);
-                XMoveResizeWindow(base.display, w.window, mon->x, mon->y, mon->width, mon->height);
-                XRaiseWindow(base.display, w.window);
+        commit_geometry(base, &w, mon->x, mon->y, mon->width, mon->height, 0);
+        base.backend->raise(base, w.window);
 
-                Atom wm_state = XInternAtom(base.display, "_NET_WM_STATE", False);
-                Atom fullscreen = XInternAtom(base.display, "_NET_WM_STATE_FULLSCREEN", False);
-                XChangeProperty(base.display, w.window, wm_state, XA_ATOM, 32,
-                              PropModeReplace, (unsigned char*)&fullscreen, 1);
-            } else {
-                w.is_floating = w.pre_fs_floating;
-                XSetWindowBorderWidth(base.display, w.window, base.border_width);
+        Atom wm_state = atom(NET_WM_STATE);
+        Atom fullscreen = atom(NET_WM_STATE_FULLSCREEN);
+        base.backend->change_property(base, w.window, wm_state, XA_ATOM, 32, PropModeReplace,
+                                      (unsigned char*)&fullscreen, 1);
+    } else {
+        w.is_floating = w.pre_fs_floating;
+        if (w.is_floating) {
+            commit_geometry(base, &w, w.x, w.y, w.width, w.height, base.border_width);
+        }
 
-                Atom wm_state = XInternAtom(base.display, "_NET_WM_STATE", False);
-                XDeleteProperty(base.display, w.window, wm_state);
+        Atom wm_state = atom(NET_WM_STATE);
+        base.backend->delete_property(base, w.window, wm_state);
 
-                if (base.horizontal_mode) {
-                    tile_horizontal(base);
-                } else {
-                    tile_windows(base);
-                }
-            }
-            break;
-        }
+        tile_current(base);
     }
 
-    XFlush(base.display);
+    flush(base);
 }
 
 void nwm::switch_workspace(void *arg, Base &base) {
@@ -617,37 +631,68 @@ void nwm::switch_workspace(void *arg, Base &base) {
     if (target_ws < 0 || target_ws >= NUM_WORKSPACES) return;
     if (target_ws == (int)base.current_workspace) return;
 
-    for (auto &w : get_current_workspace(base).windows) {
-        XUnmapWindow(base.display, w.window);
+    // A workspace already shown elsewhere is reached by focusing its
+    // monitor; nothing is remapped or laid out.
+    Monitor *shown = workspace_monitor(base, target_ws);
+    if (shown) {
+        select_monitor(base, shown->id);
+        ipc_emit(base, IPC_EVENT_WORKSPACE, None, target_ws, base.current_monitor, 0);
+        report_focus(base);
+        return;
     }
 
-    base.current_workspace = target_ws;
-
     Monitor *mon = get_current_monitor(base);
-    if (mon) {
-        mon->current_workspace = target_ws;
+    if (!mon) return;
+
+    for (ClientHandle h : get_current_workspace(base).clients) {
+        hide_window(client_get(base, h), base);
     }
 
+    base.current_workspace = target_ws;
+    mon->current_workspace = target_ws;
     base.focused_window = get_current_workspace(base).focused_window;
 
-    for (auto &w : get_current_workspace(base).windows) {
-        XMapWindow(base.display, w.window);
-        if (w.is_floating || w.is_fullscreen) {
-            XRaiseWindow(base.display, w.window);
-        }
-    }
+    // Laid out while still unmapped, so the clients appear in place.
+    tile_monitor(base, *mon);
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
+    for (ClientHandle h : get_current_workspace(base).clients) {
+        ManagedWindow *w = client_get(base, h);
+        base.backend->map(base, w->window);
+        if (w->is_floating || w->is_fullscreen) {
+            base.backend->raise(base, w->window);
+        }
     }
 
     if (base.focused_window) {
         focus_window(base.focused_window, base);
     }
 
-    bar_update_workspaces(base);
+    bar_link_publish(base);
+
+    ipc_emit(base, IPC_EVENT_WORKSPACE, None, target_ws, base.current_monitor, 0);
+    report_focus(base);
+}
+
+// Moves w from its workspace to target_ws, fixing up focus on the one it
+// leaves. Mapping and layout are left to the caller.
+static void transfer_client(nwm::Base &base, nwm::ManagedWindow *w, int target_ws) {
+    nwm::Workspace &from = base.workspaces[w->workspace];
+    int idx = nwm::workspace_position(from, w->handle);
+    if (idx < 0) return;
+
+    from.clients.erase(from.clients.begin() + idx);
+    base.workspaces[target_ws].clients.push_back(w->handle);
+
+    w->workspace = target_ws;
+    w->is_focused = false;
+    if (from.focused_window == w) from.focused_window = nullptr;
+    if (base.focused_window == w) base.focused_window = nullptr;
+
+    Atom workspace_atom = nwm::atom(nwm::NWM_WORKSPACE);
+    long workspace_id = target_ws;
+    base.backend->change_property(base, w->window, workspace_atom, XA_CARDINAL, 32,
+                                  PropModeReplace, (unsigned char*)&workspace_id, 1);
+    nwm::ewmh_set_desktop(base, w->window, target_ws);
 }
 
 void nwm::move_to_workspace(void *arg, Base &base) {
@@ -660,88 +705,66 @@ void nwm::move_to_workspace(void *arg, Base &base) {
     int target_ws = *(int*)arg;
     if (target_ws < 0 || target_ws >= NUM_WORKSPACES) return;
 
-    auto &current_ws = get_current_workspace(base);
-
-    for (auto it = current_ws.windows.begin(); it != current_ws.windows.end(); ++it) {
-        if (it->window == base.focused_window->window) {
-            ManagedWindow w = *it;
-            w.workspace = target_ws;
-            current_ws.windows.erase(it);
-
-            base.workspaces[target_ws].windows.push_back(w);
-
-            Atom workspace_atom = XInternAtom(base.display, "_NWM_WORKSPACE", False);
-            long workspace_id = target_ws;
-            XChangeProperty(base.display, w.window, workspace_atom,
-                          XA_CARDINAL, 32, PropModeReplace,
-                          (unsigned char*)&workspace_id, 1);
+    if (target_ws == (int)base.current_workspace) return;
 
-            XUnmapWindow(base.display, w.window);
+    auto &current_ws = get_current_workspace(base);
+    ManagedWindow *w = base.focused_window;
+    if (workspace_position(current_ws, w->handle) < 0) return;
 
-            if (current_ws.focused_window && current_ws.focused_window->window == w.window) {
-                current_ws.focused_window = nullptr;
-            }
-            base.focused_window = nullptr;
+    transfer_client(base, w, target_ws);
 
-            if (!current_ws.windows.empty()) {
-                focus_window(&current_ws.windows[0], base);
-            }
+    // Onto a workspace another monitor shows, the window stays mapped and
+    // both monitors are laid out again.
+    Monitor *shown = workspace_monitor(base, target_ws);
+    if (shown) {
+        base.backend->set_border(base, w->window, base.border_color);
+    } else {
+        hide_window(w, base);
+    }
 
-            break;
-        }
+    if (!current_ws.clients.empty()) {
+        focus_window(client_get(base, current_ws.clients[0]), base);
     }
+    report_focus(base);
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
+    tile_current(base);
+    if (shown) {
+        tile_monitor(base, *shown);
     }
 }
 
 void nwm::setup_keys(nwm::Base &base) {
-    XUngrabKey(base.display, AnyKey, AnyModifier, base.root);
-
-    for (auto &k : keys) {
-        KeyCode code = XKeysymToKeycode(base.display, k.keysym);
-        if (!code) continue;
-
-        unsigned int modifiers[] = {0, LockMask, Mod2Mask, Mod2Mask | LockMask};
-        for (unsigned int mod : modifiers) {
-            XGrabKey(
-                base.display,
-                code,
-                k.mod | mod,
-                base.root,
-                False,
-                GrabModeAsync,
-                GrabModeAsync
-            );
-        }
-    }
+    key_table_build(base, base.display, keys);
+
+    unsigned int modkey = base.settings.modkey;
+    XUngrabButton(base.display, AnyButton, AnyModifier, base.root);
 
-    XGrabButton(base.display, Button1, MODKEY, base.root, False,
+    XGrabButton(base.display, Button1, modkey, base.root, False,
                 ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
                 GrabModeAsync, GrabModeAsync, None, None);
 
-    XGrabButton(base.display, Button3, MODKEY, base.root, False,
+    XGrabButton(base.display, Button3, modkey, base.root, False,
                 ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
                 GrabModeAsync, GrabModeAsync, None, None);
 
-    unsigned int modifiers[] = {0, LockMask, Mod2Mask, Mod2Mask | LockMask};
-    for (unsigned int mod : modifiers) {
-        XGrabButton(base.display, Button4, MODKEY | mod, base.root, False,
+    unsigned int numlock = base.key_table.numlock_mask;
+    unsigned int modifiers[] = {0, LockMask, numlock, numlock | LockMask};
+    int modifier_count = numlock ? 4 : 2;
+    for (int i = 0; i < modifier_count; ++i) {
+        XGrabButton(base.display, Button4, modkey | modifiers[i], base.root, False,
                     ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
 
-        XGrabButton(base.display, Button5, MODKEY | mod, base.root, False,
+        XGrabButton(base.display, Button5, modkey | modifiers[i], base.root, False,
                     ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
     }
-
-    XSync(base.display, False);
 }
 
 void nwm::spawn(void *arg, nwm::Base &base) {
     const char **cmd = (const char **)arg;
     if (fork() == 0) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
         setsid();
         execvp(cmd[0], (char **)cmd);
         perror("execvp failed");
@@ -754,141 +777,71 @@ void nwm::spawn(void *arg, nwm::Base &base) {
 void nwm::toggle_gap(void *arg, nwm::Base &base) {
     (void)arg;
     base.gaps_enabled = !base.gaps_enabled;
-    base.gaps = base.gaps_enabled ? GAP_SIZE : 0;
+    base.gaps = base.gaps_enabled ? base.settings.gap_size : 0;
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
-    }
+    tile_windows(base);
 }
 
 void nwm::toggle_bar(void *arg, Base &base) {
     (void)arg;
     base.bar_visible = !base.bar_visible;
 
-    if (base.bar_visible) {
-        XMapWindow(base.display, base.bar.window);
-    } else {
-        XUnmapWindow(base.display, base.bar.window);
-    }
-
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
-    }
+    tile_windows(base);
 
-    XFlush(base.display);
+    flush(base);
 }
 
 void nwm::toggle_float(void *arg, Base &base) {
     (void)arg;
     if (!base.focused_window) return;
 
-    auto &current_ws = get_current_workspace(base);
-    for (auto &w : current_ws.windows) {
-        if (w.window == base.focused_window->window) {
-            w.is_floating = !w.is_floating;
-
-            if (w.is_floating) {
-                Monitor *mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
-                if (!mon) mon = get_current_monitor(base);
-                if (!mon) return;
+    ManagedWindow &w = *base.focused_window;
+    w.is_floating = !w.is_floating;
 
-                w.width = mon->width / 2;
-                w.height = mon->height / 2;
-                w.x = mon->x + (mon->width - w.width) / 2;
-                w.y = mon->y + (mon->height - w.height) / 2;
+    if (w.is_floating) {
+        Monitor *mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
+        if (!mon) mon = get_current_monitor(base);
+        if (!mon) return;
 
-                XSetWindowBorderWidth(base.display, w.window, 2);
-                XSetWindowBorder(base.display, w.window, base.focus_color);
-                XMoveResizeWindow(base.display, w.window, w.x, w.y, w.width, w.height);
-                XRaiseWindow(base.display, w.window);
-                XSetInputFocus(base.display, w.window, RevertToPointerRoot, CurrentTime);
-            } else {
-                XSetWindowBorderWidth(base.display, w.window, base.border_width);
-                XSetWindowBorder(base.display, w.window, base.focus_color);
-            }
-            break;
-        }
-    }
+        w.width = mon->width / 2;
+        w.height = mon->height / 2;
+        w.x = mon->x + (mon->width - w.width) / 2;
+        w.y = mon->y + (mon->height - w.height) / 2;
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
+        commit_geometry(base, &w, w.x, w.y, w.width, w.height, 2);
+        base.backend->set_border(base, w.window, base.focus_color);
+        base.backend->raise(base, w.window);
+        base.backend->set_focus(base, w.window);
     } else {
-        tile_windows(base);
+        base.backend->set_border(base, w.window, base.focus_color);
     }
-}
 
-void nwm::manage_window(Window window, Base &base) {
-    XWindowAttributes attr;
+    tile_current(base);
+}
 
-    if (XGetWindowAttributes(base.display, window, &attr) == 0) {
-        return;
-    }
+void nwm::manage_window(const WindowTraits &traits, Base &base) {
+    Window window = traits.window;
 
     if (window == base.hint_check_window) {
         return;
     }
 
-    if (should_ignore_window(base.display, window)) {
+    if (traits.ignore) {
         return;
     }
 
-    int target_workspace = base.current_workspace;
-    bool saved_floating = false;
-    bool saved_fullscreen = false;
-
-    Atom workspace_atom = XInternAtom(base.display, "_NWM_WORKSPACE", False);
-    Atom floating_atom = XInternAtom(base.display, "_NWM_FLOATING", False);
-    Atom fullscreen_atom = XInternAtom(base.display, "_NWM_FULLSCREEN", False);
-    Atom actual_type;
-    int actual_format;
-    unsigned long nitems, bytes_after;
-    unsigned char *prop = nullptr;
+    int target_workspace = traits.saved_workspace >= 0 ? traits.saved_workspace
+                                                       : (int)base.current_workspace;
+    bool saved_floating = traits.saved_floating;
+    bool saved_fullscreen = traits.saved_fullscreen;
 
-    if (XGetWindowProperty(base.display, window, workspace_atom, 0, 1,
-                          True,
-                          XA_CARDINAL, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        long saved_workspace = *(long*)prop;
-        XFree(prop);
-
-        if (saved_workspace >= 0 && saved_workspace < NUM_WORKSPACES) {
-            target_workspace = saved_workspace;
-        }
-    }
+    auto &target_ws = base.workspaces[target_workspace];
 
-    prop = nullptr;
-    if (XGetWindowProperty(base.display, window, floating_atom, 0, 1,
-                          True,
-                          XA_CARDINAL, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        long is_floating = *(long*)prop;
-        saved_floating = (is_floating == 1);
-        XFree(prop);
+    if (base.window_index.count(window)) {
+        return;
     }
 
-    prop = nullptr;
-    if (XGetWindowProperty(base.display, window, fullscreen_atom, 0, 1,
-                          True,
-                          XA_CARDINAL, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        long is_fullscreen = *(long*)prop;
-        saved_fullscreen = (is_fullscreen == 1);
-        XFree(prop);
-    }
-
-    auto &target_ws = base.workspaces[target_workspace];
-
-    for (const auto &w : target_ws.windows) {
-        if (w.window == window) {
-            return;
-        }
-    }
-
-    bool is_float = saved_floating || should_float(base.display, window);
+    bool is_float = saved_floating || traits.floating;
 
     ManagedWindow w;
     w.window = window;
@@ -901,21 +854,23 @@ void nwm::manage_window(Window window, Base &base) {
     w.pre_fs_width = 0;
     w.pre_fs_height = 0;
     w.pre_fs_floating = false;
+    w.ignore_unmaps = 0;
 
-    Monitor *mon = get_current_monitor(base);
-    if (!mon && !base.monitors.empty()) mon = &base.monitors[0];
+    // A client on a workspace another monitor shows is placed there; one on
+    // a hidden workspace is placed on the current monitor.
+    Monitor *shown = workspace_monitor(base, target_workspace);
+    Monitor *mon = shown ? shown : get_current_monitor(base);
     w.monitor = mon ? mon->id : 0;
 
     if (is_float) {
-        XSizeHints hints;
-        long supplied;
-        if (XGetWMNormalHints(base.display, window, &hints, &supplied)) {
+        if (traits.has_hints) {
+            const XSizeHints &hints = traits.hints;
             if (hints.flags & (PSize | USSize)) {
                 w.width = hints.width;
                 w.height = hints.height;
             } else {
-                w.width = attr.width > 0 ? attr.width : 400;
-                w.height = attr.height > 0 ? attr.height : 300;
+                w.width = traits.width > 0 ? traits.width : 400;
+                w.height = traits.height > 0 ? traits.height : 300;
             }
 
             if (hints.flags & (PPosition | USPosition)) {
@@ -931,8 +886,8 @@ void nwm::manage_window(Window window, Base &base) {
                 }
             }
         } else {
-            w.width = attr.width > 0 ? attr.width : 400;
-            w.height = attr.height > 0 ? attr.height : 300;
+            w.width = traits.width > 0 ? traits.width : 400;
+            w.height = traits.height > 0 ? traits.height : 300;
             if (mon) {
                 w.x = mon->x + (mon->width - w.width) / 2;
                 w.y = mon->y + (mon->height - w.height) / 2;
@@ -941,103 +896,131 @@ void nwm::manage_window(Window window, Base &base) {
                 w.y = (HEIGHT(base.display, base.screen) - w.height) / 2;
             }
         }
-
-        if (w.x != attr.x || w.y != attr.y || w.width != attr.width || w.height != attr.height) {
-            XMoveResizeWindow(base.display, window, w.x, w.y, w.width, w.height);
-        }
     } else {
         w.x = base.gaps;
-        w.y = base.gaps + base.bar.height;
-        w.width = WIDTH(base.display, base.screen) / 2;
-        w.height = HEIGHT(base.display, base.screen) / 2;
+        w.y = base.gaps + base.bar_height;
+        w.width = (mon ? mon->width : WIDTH(base.display, base.screen)) / 2;
+        w.height = (mon ? mon->height : HEIGHT(base.display, base.screen)) / 2;
     }
 
-    target_ws.windows.push_back(w);
+    w.committed.x = traits.x;
+    w.committed.y = traits.y;
+    w.committed.width = traits.width;
+    w.committed.height = traits.height;
+    w.committed.border_width = traits.border_width;
 
-    XSetWindowAttributes attrs;
-    attrs.event_mask = EnterWindowMask | LeaveWindowMask | PropertyChangeMask |
-                       StructureNotifyMask | FocusChangeMask;
-    XChangeWindowAttributes(base.display, window, CWEventMask, &attrs);
+    ClientHandle handle = client_create(base, w);
+    if (handle == NO_CLIENT) return;
+    target_ws.clients.push_back(handle);
+    ManagedWindow *managed = client_get(base, handle);
+    ewmh_client_added(base, window, target_workspace);
 
-    XSetWindowBorder(base.display, window, base.border_color);
-    XSetWindowBorderWidth(base.display, window, is_float ? 1 : base.border_width);
+    base.backend->select_input(base, window, CLIENT_EVENT_MASK);
 
-    if (saved_fullscreen && mon) {
-        XSetWindowBorderWidth(base.display, window, 0);
-        XMoveResizeWindow(base.display, window, mon->x, mon->y, mon->width, mon->height);
+    base.backend->set_border(base, window, base.border_color);
 
-        Atom wm_state = XInternAtom(base.display, "_NET_WM_STATE", False);
-        Atom fullscreen = XInternAtom(base.display, "_NET_WM_STATE_FULLSCREEN", False);
-        XChangeProperty(base.display, window, wm_state, XA_ATOM, 32,
-                      PropModeReplace, (unsigned char*)&fullscreen, 1);
+    if (saved_fullscreen && mon) {
+        commit_geometry(base, managed, mon->x, mon->y, mon->width, mon->height, 0);
+
+        Atom wm_state = atom(NET_WM_STATE);
+        Atom fullscreen = atom(NET_WM_STATE_FULLSCREEN);
+        base.backend->change_property(base, window, wm_state, XA_ATOM, 32, PropModeReplace,
+                                      (unsigned char*)&fullscreen, 1);
+    } else if (is_float) {
+        commit_geometry(base, managed, w.x, w.y, w.width, w.height, 1);
+    } else {
+        const Geometry &c = managed->committed;
+        commit_geometry(base, managed, c.x, c.y, c.width, c.height, base.border_width);
     }
 
-    if (target_workspace == (int)base.current_workspace) {
-        XMapWindow(base.display, window);
+    if (shown) {
+        base.backend->map(base, window);
         if (is_float || saved_fullscreen) {
-            XRaiseWindow(base.display, window);
+            base.backend->raise(base, window);
         }
-    } else {
-        XUnmapWindow(base.display, window);
+    } else if (traits.map_state != IsUnmapped) {
+        hide_window(managed, base);
     }
 
-    XFlush(base.display);
+    ipc_emit(base, IPC_EVENT_MANAGE, window, target_workspace, managed->monitor, 0);
+    flush(base);
 }
 
 void nwm::unmanage_window(Window window, Base &base) {
-    auto &current_ws = get_current_workspace(base);
-
-    int closed_idx = -1;
-    for (size_t i = 0; i < current_ws.windows.size(); ++i) {
-        if (current_ws.windows[i].window == window) {
-            closed_idx = i;
-            break;
-        }
-    }
-
-    if (closed_idx == -1) return;
+    ManagedWindow *w = find_window(base, window);
+    if (!w) return;
 
-    bool was_focused = (current_ws.focused_window &&
-                       current_ws.focused_window->window == window);
+    int ws_idx = w->workspace;
+    int monitor = w->monitor;
+    auto &ws = base.workspaces[ws_idx];
+    bool is_current = (ws_idx == (int)base.current_workspace);
+    bool was_focused = (ws.focused_window == w);
 
-    current_ws.windows.erase(current_ws.windows.begin() + closed_idx);
+    int closed_idx = workspace_position(ws, w->handle);
+    if (closed_idx >= 0) {
+        ws.clients.erase(ws.clients.begin() + closed_idx);
+    }
 
     if (was_focused) {
-        current_ws.focused_window = nullptr;
+        ws.focused_window = nullptr;
+    }
+    if (base.focused_window == w) {
         base.focused_window = nullptr;
+    }
 
-        if (!current_ws.windows.empty()) {
-            int new_focus_idx = closed_idx > 0 ? closed_idx - 1 : 0;
-            if (new_focus_idx >= (int)current_ws.windows.size()) {
-                new_focus_idx = current_ws.windows.size() - 1;
-            }
-            focus_window(&current_ws.windows[new_focus_idx], base);
+    client_destroy(base, w->handle);
+    ewmh_client_removed(base, window);
+    ipc_emit(base, IPC_EVENT_UNMANAGE, window, ws_idx, monitor, 0);
+
+    if (was_focused && !ws.clients.empty()) {
+        int new_focus_idx = closed_idx > 0 ? closed_idx - 1 : 0;
+        if (new_focus_idx >= (int)ws.clients.size()) {
+            new_focus_idx = ws.clients.size() - 1;
+        }
+        // Another monitor's workspace only remembers its new focus.
+        if (is_current) {
+            focus_window(client_get(base, ws.clients[new_focus_idx]), base);
+        } else {
+            ws.focused_window = client_get(base, ws.clients[new_focus_idx]);
         }
     }
 
-    if (base.horizontal_mode) {
-        Monitor *mon = get_current_monitor(base);
-        if (mon) {
-            int window_width = mon->width / SCROLL_WINDOWS_VISIBLE;
-            int total_width = current_ws.windows.size() * window_width;
-            int max_scroll = std::max(0, total_width - mon->width);
-            current_ws.scroll_offset = std::min(current_ws.scroll_offset, max_scroll);
-        }
+    Monitor *mon = workspace_monitor(base, ws_idx);
+    if (mon && mon->horizontal_mode) {
+        int window_width = mon->width / mon->scroll_windows_visible;
+        int total_width = ws.clients.size() * window_width;
+        int max_scroll = std::max(0, total_width - mon->width);
+        ws.scroll_offset = std::min(ws.scroll_offset, max_scroll);
+    }
+
+    report_focus(base);
+}
+
+void nwm::hide_window(ManagedWindow *window, Base &base) {
+    window->ignore_unmaps++;
+    base.backend->unmap(base, window->window);
+}
+
+void nwm::flush(Base &base) {
+    if (base.batch_depth == 0) {
+        base.backend->flush(base);
     }
 }
 
 void nwm::focus_window(ManagedWindow *window, Base &base) {
     auto &current_ws = get_current_workspace(base);
 
-    for (auto &w : current_ws.windows) {
-        if (!w.is_floating && !w.is_fullscreen) {
-            XSetWindowBorder(base.display, w.window, base.border_color);
+    ManagedWindow *prev = current_ws.focused_window;
+    if (prev && prev != window) {
+        if (!prev->is_floating && !prev->is_fullscreen) {
+            base.backend->set_border(base, prev->window, base.border_color);
         }
-        w.is_focused = false;
+        prev->is_focused = false;
     }
 
     current_ws.focused_window = nullptr;
     base.focused_window = nullptr;
+    ewmh_restacked(base);
 
     if (window) {
         current_ws.focused_window = window;
@@ -1045,39 +1028,36 @@ void nwm::focus_window(ManagedWindow *window, Base &base) {
         window->is_focused = true;
 
         if (!window->is_floating && !window->is_fullscreen) {
-            XSetWindowBorder(base.display, window->window, base.focus_color);
+            base.backend->set_border(base, window->window, base.focus_color);
         }
 
         if (window->is_floating || window->is_fullscreen) {
-            XRaiseWindow(base.display, window->window);
+            base.backend->raise(base, window->window);
         }
 
-        XSetInputFocus(base.display, window->window, RevertToPointerRoot, CurrentTime);
-        XFlush(base.display);
+        base.backend->set_focus(base, window->window);
+        flush(base);
     } else {
-        XSetInputFocus(base.display, base.root, RevertToPointerRoot, CurrentTime);
-        XFlush(base.display);
+        base.backend->set_focus(base, None);
+        flush(base);
     }
+
+    report_focus(base);
 }
 
 void nwm::focus_next(void *arg, Base &base) {
     (void)arg;
     auto &current_ws = get_current_workspace(base);
-    if (current_ws.windows.empty()) return;
+    if (current_ws.clients.empty()) return;
 
     std::vector<ManagedWindow*> all_windows;
-    for (auto &w : current_ws.windows) {
-        all_windows.push_back(&w);
+    for (ClientHandle h : current_ws.clients) {
+        all_windows.push_back(client_get(base, h));
     }
 
-    if (all_windows.empty()) return;
-
     int current_idx = -1;
-    for (size_t i = 0; i < all_windows.size(); ++i) {
-        if (current_ws.focused_window && all_windows[i]->window == current_ws.focused_window->window) {
-            current_idx = i;
-            break;
-        }
+    if (current_ws.focused_window) {
+        current_idx = workspace_position(current_ws, current_ws.focused_window->handle);
     }
 
     int next_idx = (current_idx + 1) % all_windows.size();
@@ -1105,28 +1085,23 @@ void nwm::focus_next(void *arg, Base &base) {
             current_ws.scroll_offset = target_scroll + window_width - mon->width;
         }
 
-        tile_horizontal(base);
+        tile_current(base);
     }
 }
 
 void nwm::focus_prev(void *arg, Base &base) {
     (void)arg;
     auto &current_ws = get_current_workspace(base);
-    if (current_ws.windows.empty()) return;
+    if (current_ws.clients.empty()) return;
 
     std::vector<ManagedWindow*> all_windows;
-    for (auto &w : current_ws.windows) {
-        all_windows.push_back(&w);
+    for (ClientHandle h : current_ws.clients) {
+        all_windows.push_back(client_get(base, h));
     }
 
-    if (all_windows.empty()) return;
-
     int current_idx = -1;
-    for (size_t i = 0; i < all_windows.size(); ++i) {
-        if (current_ws.focused_window && all_windows[i]->window == current_ws.focused_window->window) {
-            current_idx = i;
-            break;
-        }
+    if (current_ws.focused_window) {
+        current_idx = workspace_position(current_ws, current_ws.focused_window->handle);
     }
 
     int prev_idx = (current_idx - 1 + all_windows.size()) % all_windows.size();
@@ -1154,7 +1129,7 @@ void nwm::focus_prev(void *arg, Base &base) {
             current_ws.scroll_offset = target_scroll + window_width - mon->width;
         }
 
-        tile_horizontal(base);
+        tile_current(base);
     }
 }
 
@@ -1162,7 +1137,8 @@ void nwm::move_window(ManagedWindow *window, int x, int y, Base &base) {
     if (window) {
         window->x = x;
         window->y = y;
-        XMoveWindow(base.display, window->window, x, y);
+        commit_geometry(base, window, x, y, window->committed.width,
+                        window->committed.height, window->committed.border_width);
     }
 }
 
@@ -1170,7 +1146,8 @@ void nwm::resize_window(ManagedWindow *window, int width, int height, Base &base
     if (window) {
         window->width = width;
         window->height = height;
-        XResizeWindow(base.display, window->window, width, height);
+        commit_geometry(base, window, window->committed.x, window->committed.y,
+                        width, height, window->committed.border_width);
     }
 }
 
@@ -1180,9 +1157,9 @@ void nwm::close_window(void *arg, Base &base) {
         XEvent ev;
         ev.type = ClientMessage;
         ev.xclient.window = base.focused_window->window;
-        ev.xclient.message_type = XInternAtom(base.display, "WM_PROTOCOLS", True);
+        ev.xclient.message_type = atom(WM_PROTOCOLS);
         ev.xclient.format = 32;
-        ev.xclient.data.l[0] = XInternAtom(base.display, "WM_DELETE_WINDOW", False);
+        ev.xclient.data.l[0] = atom(WM_DELETE_WINDOW);
         ev.xclient.data.l[1] = CurrentTime;
         XSendEvent(base.display, base.focused_window->window, False, NoEventMask, &ev);
     }
@@ -1196,19 +1173,19 @@ void nwm::quit_wm(void *arg, Base &base) {
 }
 
 void nwm::handle_map_request(XMapRequestEvent *e, Base &base) {
-    if (should_ignore_window(base.display, e->window)) {
+    WindowTraits traits = classify_window(base, e->window);
+    if (traits.ignore) {
         XMapWindow(base.display, e->window);
-        handle_special_window_map(base.display, e->window);
+        handle_special_window_map(base, traits);
         return;
     }
 
-    manage_window(e->window, base);
+    manage_window(traits, base);
 
     auto &current_ws = get_current_workspace(base);
+    ManagedWindow *new_window = find_window(base, e->window);
 
-    if (!current_ws.windows.empty()) {
-        ManagedWindow *new_window = &current_ws.windows.back();
-
+    if (new_window && new_window->workspace == (int)base.current_workspace) {
         bool had_floating_focus = (base.focused_window && (base.focused_window->is_floating || base.focused_window->is_fullscreen));
 
         if (!had_floating_focus) {
@@ -1222,8 +1199,9 @@ void nwm::handle_map_request(XMapRequestEvent *e, Base &base) {
                     int window_width = mon->width / 2;
 
                     int tiled_idx = 0;
-                    for (size_t i = 0; i < current_ws.windows.size() - 1; ++i) {
-                        if (!current_ws.windows[i].is_floating && !current_ws.windows[i].is_fullscreen) {
+                    for (size_t i = 0; i < current_ws.clients.size() - 1; ++i) {
+                        ManagedWindow *w = client_get(base, current_ws.clients[i]);
+                        if (!w->is_floating && !w->is_fullscreen) {
                             tiled_idx++;
                         }
                     }
@@ -1236,52 +1214,59 @@ void nwm::handle_map_request(XMapRequestEvent *e, Base &base) {
                 }
             }
 
-            if (base.horizontal_mode) {
-                tile_horizontal(base);
-            } else {
-                tile_windows(base);
-            }
+            tile_current(base);
         } else {
-            XRaiseWindow(base.display, new_window->window);
+            base.backend->raise(base, new_window->window);
         }
+    } else if (new_window) {
+        Monitor *shown = workspace_monitor(base, new_window->workspace);
+        if (shown) tile_monitor(base, *shown);
     }
 }
 
+// Lays out the monitor showing workspace, if any, after it lost a client.
+static void retile_workspace(nwm::Base &base, int workspace) {
+    nwm::Monitor *shown = nwm::workspace_monitor(base, workspace);
+    if (shown) nwm::tile_monitor(base, *shown);
+}
+
 void nwm::handle_unmap_notify(XUnmapEvent *e, Base &base) {
-    unmanage_window(e->window, base);
+    // Each unmap arrives twice: once on the client and once on the root.
+    if (e->event != base.root) return;
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
+    auto overlay = base.overlays.find(e->window);
+    if (overlay != base.overlays.end()) {
+        overlay->second.mapped = false;
+        return;
+    }
+
+    ManagedWindow *w = find_window(base, e->window);
+    if (!w) return;
+
+    if (w->ignore_unmaps > 0) {
+        w->ignore_unmaps--;
+        return;
     }
+
+    int workspace = w->workspace;
+    unmanage_window(e->window, base);
+    ewmh_client_withdrawn(base, e->window);
+
+    retile_workspace(base, workspace);
 }
 
 void nwm::handle_destroy_notify(XDestroyWindowEvent *e, Base &base) {
-    for (const auto &icon : base.systray.icons) {
-        if (icon.window == e->window) {
-            systray_handle_destroy(base, e->window);
-            return;
-        }
-    }
+    if (base.overlays.erase(e->window)) return;
+    ManagedWindow *w = find_window(base, e->window);
+    if (!w) return;
 
+    int workspace = w->workspace;
     unmanage_window(e->window, base);
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
-    }
+    retile_workspace(base, workspace);
 }
 
 void nwm::handle_configure_request(XConfigureRequestEvent *e, Base &base) {
-    for (const auto &icon : base.systray.icons) {
-        if (icon.window == e->window) {
-            systray_handle_configure_request(base, e);
-            return;
-        }
-    }
-
     XWindowChanges wc;
     wc.x = e->x;
     wc.y = e->y;
@@ -1291,151 +1276,237 @@ void nwm::handle_configure_request(XConfigureRequestEvent *e, Base &base) {
     wc.sibling = e->above;
     wc.stack_mode = e->detail;
 
-    auto &current_ws = get_current_workspace(base);
-    bool is_floating = false;
-    for (auto &w : current_ws.windows) {
-        if (w.window == e->window && (w.is_floating || w.is_fullscreen)) {
-            is_floating = true;
-            if (!w.is_fullscreen) {
-                w.x = e->x;
-                w.y = e->y;
-                w.width = e->width;
-                w.height = e->height;
-            }
-            break;
-        }
+    ManagedWindow *w = find_window(base, e->window);
+    bool is_floating = w && (w->is_floating || w->is_fullscreen);
+    if (w && w->is_floating && !w->is_fullscreen) {
+        w->x = e->x;
+        w->y = e->y;
+        w->width = e->width;
+        w->height = e->height;
     }
 
     if (is_floating) {
         XConfigureWindow(base.display, e->window, e->value_mask, &wc);
+
+        Geometry &c = w->committed;
+        if (e->value_mask & CWX) c.x = e->x;
+        if (e->value_mask & CWY) c.y = e->y;
+        if (e->value_mask & CWWidth) c.width = e->width;
+        if (e->value_mask & CWHeight) c.height = e->height;
+        if (e->value_mask & CWBorderWidth) c.border_width = e->border_width;
     } else {
         XConfigureWindow(base.display, e->window, e->value_mask & (CWSibling | CWStackMode), &wc);
+
+        // A tiled client keeps the geometry the layout gave it. ICCCM 4.1.5
+        // asks for a synthetic ConfigureNotify so it learns the request was
+        // refused instead of waiting for one that never comes.
+        if (w) {
+            const Geometry &c = w->committed;
+            XConfigureEvent ce;
+            memset(&ce, 0, sizeof(ce));
+            ce.type = ConfigureNotify;
+            ce.display = base.display;
+            ce.event = w->window;
+            ce.window = w->window;
+            ce.x = c.x;
+            ce.y = c.y;
+            ce.width = c.width;
+            ce.height = c.height;
+            ce.border_width = c.border_width;
+            ce.above = None;
+            ce.override_redirect = False;
+            XSendEvent(base.display, w->window, False, StructureNotifyMask, (XEvent*)&ce);
+        }
     }
 }
 
 void nwm::handle_client_message(XClientMessageEvent *e, Base &base) {
-    systray_handle_client_message(base, e);
+    if (e->message_type == atom(NET_CURRENT_DESKTOP)) {
+        // nwm-bar names the monitor it sits on, plus one, in l[2]; the
+        // workspace then opens there.
+        int mon = e->data.l[2] - 1;
+        if (mon >= 0 && mon < (int)base.monitors.size()) {
+            select_monitor(base, mon);
+        }
+
+        int ws = e->data.l[0];
+        if (ws >= 0 && ws < NUM_WORKSPACES && ws != (int)base.current_workspace) {
+            switch_workspace((void*)&ws, base);
+        }
+    }
 }
 
 void nwm::handle_key_press(XKeyEvent *e, Base &base) {
-    KeySym keysym = XLookupKeysym(e, 0);
-
-    unsigned int cleaned_state = e->state & ~(LockMask | Mod2Mask);
+    const KeyBinding *binding = key_table_find(base.key_table, e->keycode, e->state);
+    if (binding && binding->func) {
+        binding->func((void*)binding->arg, base);
+    }
+}
 
-    for (auto &k : keys) {
-        unsigned int cleaned_mod = k.mod & ~(LockMask | Mod2Mask);
-        if (keysym == k.keysym && cleaned_state == cleaned_mod) {
-            if (k.func) {
-                k.func((void*)k.arg, base);
-            }
-            break;
-        }
+// Keycodes and the NumLock modifier are resolved once per mapping, so a
+// layout change only needs the table rebuilt and the grabs redone.
+void nwm::handle_mapping_notify(XMappingEvent *e, Base &base) {
+    XRefreshKeyboardMapping(e);
+    if (e->request == MappingKeyboard || e->request == MappingModifier) {
+        setup_keys(base);
     }
 }
 
 void nwm::reload_config(void *arg, nwm::Base &base) {
     (void)arg;
-    setup_keys(base);
+    settings_reload(base);
+}
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void begin_drag(nwm::Base &base, nwm::ManagedWindow *w, XButtonEvent *e) {
+    base.drag_window = w->window;
+    base.drag_client = w->handle;
+    base.drag_start_x = e->x_root;
+    base.drag_start_y = e->y_root;
+    base.drag_x = e->x_root;
+    base.drag_y = e->y_root;
+    base.drag_pending = false;
+    base.drag_applied_ns = 0;
+}
+
+// The only raise of a move/resize. focus_window already raised floating and
+// fullscreen windows.
+static void raise_dragged(nwm::Base &base, nwm::ManagedWindow *w) {
+    if (!w->is_floating && !w->is_fullscreen) {
+        base.backend->raise(base, w->window);
     }
+}
 
-    XFlush(base.display);
+// Moves or resizes the dragged window to the latest pointer position.
+static void drag_apply(nwm::Base &base) {
+    base.drag_pending = false;
+    base.drag_applied_ns = monotonic_ns();
+
+    nwm::ManagedWindow *w = nwm::client_get(base, base.drag_client);
+    if (!w) return;
+
+    int delta_x = base.drag_x - base.drag_start_x;
+    int delta_y = base.drag_y - base.drag_start_y;
+
+    if (base.dragging) {
+        nwm::commit_geometry(base, w, base.drag_window_start_x + delta_x,
+                             base.drag_window_start_y + delta_y, w->committed.width,
+                             w->committed.height, w->committed.border_width);
+    } else if (base.resizing) {
+        int new_width = std::max(100, base.resize_start_width + delta_x);
+        int new_height = std::max(100, base.resize_start_height + delta_y);
+        nwm::commit_geometry(base, w, w->committed.x, w->committed.y,
+                             new_width, new_height, w->committed.border_width);
+    }
 }
 
-void nwm::handle_button_press(XButtonEvent *e, Base &base) {
-    if ((e->state & MODKEY) && (e->button == Button4 || e->button == Button5)) {
-        if (base.horizontal_mode) {
-            if (e->button == Button4) {
-                scroll_left(nullptr, base);
-            } else {
-                scroll_right(nullptr, base);
-            }
-            return;
-        }
+static uint64_t drag_frame_ns(nwm::Base &base) {
+    nwm::ManagedWindow *w = nwm::client_get(base, base.drag_client);
+    if (w && w->monitor >= 0 && w->monitor < (int)base.monitors.size()) {
+        return base.monitors[w->monitor].frame_ns;
     }
+    return DEFAULT_FRAME_NS;
+}
 
-    if (e->window == base.systray.window) {
-        return;
+int nwm::drag_service(Base &base) {
+    if (!base.drag_pending) return -1;
+
+    uint64_t now = monotonic_ns();
+    uint64_t due = base.drag_applied_ns + drag_frame_ns(base);
+    if (now >= due) {
+        drag_apply(base);
+        return -1;
     }
+    return (int)((due - now + 999999) / 1000000);
+}
+
+void nwm::monitors_schedule(Base &base, XEvent &e) {
+    XRRUpdateConfiguration(&e);
 
-    if (e->window == base.bar.window) {
-        if (e->button == Button1) {
-            bar_handle_click(base, e->x, e->y, e->button);
-        } else if (e->button == Button4) {
-            bar_handle_scroll(base, -1);
-        } else if (e->button == Button5) {
-            bar_handle_scroll(base, 1);
+    if (e.type == base.xrandr_event_base + RRNotify &&
+        ((XRRNotifyEvent*)&e)->subtype == RRNotify_CrtcChange) {
+        RRCrtc crtc = ((XRRCrtcChangeNotifyEvent*)&e)->crtc;
+        std::vector<RRCrtc> &changed = base.monitors_changed_crtcs;
+        if (std::find(changed.begin(), changed.end(), crtc) == changed.end()) {
+            changed.push_back(crtc);
         }
-        return;
     }
 
-    auto &current_ws = get_current_workspace(base);
-
-    Window target_window = (e->subwindow != None) ? e->subwindow : e->window;
+    base.monitors_due_ns = monotonic_ns() + MONITOR_SETTLE_NS;
+}
 
-    if (e->button == Button1 && (e->state & MODKEY)) {
-        for (auto &w : current_ws.windows) {
-            if (target_window == w.window) {
-                if (base.dragging || base.resizing) {
-                    XUngrabPointer(base.display, CurrentTime);
-                    XDefineCursor(base.display, base.root, base.cursor);
-                }
+int nwm::monitors_service(Base &base) {
+    if (!base.monitors_due_ns) return -1;
 
-                base.dragging = true;
-                base.resizing = false;
-                base.drag_window = target_window;
-                base.drag_start_x = e->x_root;
-                base.drag_start_y = e->y_root;
+    uint64_t now = monotonic_ns();
+    if (now < base.monitors_due_ns) {
+        return (int)((base.monitors_due_ns - now + 999999) / 1000000);
+    }
 
-                XDefineCursor(base.display, base.root, base.cursor_move);
+    base.monitors_due_ns = 0;
+    monitors_update(base);
+    bar_link_sync(base);
+    trace_monitors(base);
+    return -1;
+}
 
-                XWindowAttributes attr;
-                if (XGetWindowAttributes(base.display, target_window, &attr)) {
-                    base.drag_window_start_x = attr.x;
-                    base.drag_window_start_y = attr.y;
-                }
+void nwm::handle_button_press(XButtonEvent *e, Base &base) {
+    // A click selects the monitor it lands on, whether or not it hits a client.
+    Monitor *clicked = get_monitor_at_point(base, e->x_root, e->y_root);
+    if (clicked) {
+        select_monitor(base, clicked->id);
+    }
 
-                focus_window(&w, base);
-                return;
-            }
+    if ((e->state & base.settings.modkey) && (e->button == Button4 || e->button == Button5)) {
+        if (base.horizontal_mode) {
+            // The wheel scrolls by scroll_step pixels; the keys by a column.
+            scroll_by(base, e->button == Button4 ? -base.scroll_step : base.scroll_step);
+            return;
         }
-    } else if (e->button == Button3 && (e->state & MODKEY)) {
-        for (auto &w : current_ws.windows) {
-            if (target_window == w.window) {
-                if (base.dragging || base.resizing) {
-                    XUngrabPointer(base.display, CurrentTime);
-                    XDefineCursor(base.display, base.root, base.cursor);
-                }
+    }
 
-                base.resizing = true;
-                base.dragging = false;
-                base.drag_window = target_window;
-                base.drag_start_x = e->x_root;
-                base.drag_start_y = e->y_root;
+    Window target_window = (e->subwindow != None) ? e->subwindow : e->window;
 
-                XDefineCursor(base.display, base.root, base.cursor_resize);
+    ManagedWindow *w = find_window(base, target_window);
+    if (!w || w->workspace != (int)base.current_workspace) return;
 
-                XWindowAttributes attr;
-                if (XGetWindowAttributes(base.display, target_window, &attr)) {
-                    base.resize_start_width = attr.width;
-                    base.resize_start_height = attr.height;
-                }
+    if (e->button == Button1 && (e->state & base.settings.modkey)) {
+        if (base.dragging || base.resizing) {
+            XUngrabPointer(base.display, CurrentTime);
+            XDefineCursor(base.display, base.root, base.cursor);
+        }
 
-                focus_window(&w, base);
-                return;
-            }
+        base.dragging = true;
+        base.resizing = false;
+        begin_drag(base, w, e);
+        base.drag_window_start_x = w->committed.x;
+        base.drag_window_start_y = w->committed.y;
+
+        XDefineCursor(base.display, base.root, base.cursor_move);
+        focus_window(w, base);
+        raise_dragged(base, w);
+    } else if (e->button == Button3 && (e->state & base.settings.modkey)) {
+        if (base.dragging || base.resizing) {
+            XUngrabPointer(base.display, CurrentTime);
+            XDefineCursor(base.display, base.root, base.cursor);
         }
+
+        base.resizing = true;
+        base.dragging = false;
+        begin_drag(base, w, e);
+        base.resize_start_width = w->committed.width;
+        base.resize_start_height = w->committed.height;
+
+        XDefineCursor(base.display, base.root, base.cursor_resize);
+        focus_window(w, base);
+        raise_dragged(base, w);
     } else if (e->button == Button1) {
-        for (auto &w : current_ws.windows) {
-            if (target_window == w.window) {
-                focus_window(&w, base);
-                break;
-            }
-        }
+        focus_window(w, base);
     }
 }
 
@@ -1446,39 +1517,46 @@ void nwm::handle_button_release(XButtonEvent *e, Base &base) {
         XUngrabPointer(base.display, CurrentTime);
         XDefineCursor(base.display, base.root, base.cursor);
 
+        if (base.drag_pending) {
+            drag_apply(base);
+        }
+
         auto &current_ws = get_current_workspace(base);
 
+        ManagedWindow *dragged = client_get(base, base.drag_client);
+        int dragged_idx = -1;
+        if (dragged && dragged->workspace == (int)base.current_workspace) {
+            dragged_idx = workspace_position(current_ws, dragged->handle);
+        }
+
+        bool changed_monitor = false;
         if (base.dragging) {
             bool is_floating = false;
-            for (auto &w : current_ws.windows) {
-                if (w.window == base.drag_window) {
-                    is_floating = w.is_floating;
-                    if (is_floating) {
-                        XWindowAttributes attr;
-                        if (XGetWindowAttributes(base.display, base.drag_window, &attr)) {
-                            w.x = attr.x;
-                            w.y = attr.y;
-
-                            Monitor *new_mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
-                            if (new_mon) {
-                                w.monitor = new_mon->id;
-                            }
-                        }
+            if (dragged_idx != -1) {
+                ManagedWindow &w = *dragged;
+                is_floating = w.is_floating;
+                Monitor *new_mon = get_monitor_at_point(base, e->x_root, e->y_root);
+                if (is_floating) {
+                    w.x = w.committed.x;
+                    w.y = w.committed.y;
+
+                    new_mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
+                    if (new_mon) {
+                        w.monitor = new_mon->id;
                     }
-                    break;
                 }
-            }
-
-            if (!is_floating && current_ws.windows.size() > 1) {
-                int dragged_idx = -1;
 
-                for (size_t i = 0; i < current_ws.windows.size(); ++i) {
-                    if (current_ws.windows[i].window == base.drag_window) {
-                        dragged_idx = i;
-                        break;
-                    }
+                // Dropped on another monitor, the window joins the
+                // workspace shown there.
+                if (new_mon && new_mon->id != base.current_monitor) {
+                    transfer_client(base, dragged, new_mon->current_workspace);
+                    select_monitor(base, new_mon->id);
+                    focus_window(dragged, base);
+                    changed_monitor = true;
                 }
+            }
 
+            if (!changed_monitor && !is_floating && current_ws.clients.size() > 1) {
                 if (dragged_idx != -1) {
                     int target_idx = -1;
 
@@ -1494,11 +1572,12 @@ void nwm::handle_button_release(XButtonEvent *e, Base &base) {
                         if (!mon) mon = get_current_monitor(base);
                         if (!mon) return;
 
-                        int bar_height = base.bar_visible ? base.bar.height : 0;
+                        int bar_height = base.bar_visible ? base.bar_height : 0;
 
                         int tiled_count = 0;
-                        for (auto &w : current_ws.windows) {
-                            if (!w.is_floating && !w.is_fullscreen && w.monitor == mon->id) tiled_count++;
+                        for (ClientHandle h : current_ws.clients) {
+                            ManagedWindow *w = client_get(base, h);
+                            if (!w->is_floating && !w->is_fullscreen && w->monitor == mon->id) tiled_count++;
                         }
 
                         if (tiled_count == 1) {
@@ -1526,176 +1605,92 @@ void nwm::handle_button_release(XButtonEvent *e, Base &base) {
                     }
 
                     if (target_idx < 0) target_idx = 0;
-                    if (target_idx >= (int)current_ws.windows.size()) target_idx = current_ws.windows.size() - 1;
+                    if (target_idx >= (int)current_ws.clients.size()) target_idx = current_ws.clients.size() - 1;
 
                     if (target_idx != dragged_idx) {
-                        ManagedWindow dragged_window = current_ws.windows[dragged_idx];
-                        current_ws.windows.erase(current_ws.windows.begin() + dragged_idx);
-                        current_ws.windows.insert(current_ws.windows.begin() + target_idx, dragged_window);
+                        current_ws.clients.erase(current_ws.clients.begin() + dragged_idx);
+                        current_ws.clients.insert(current_ws.clients.begin() + target_idx, dragged->handle);
                     }
                 }
             }
-        } else if (base.resizing) {
-            bool is_floating = false;
-            for (auto &w : current_ws.windows) {
-                if (w.window == base.drag_window) {
-                    is_floating = w.is_floating;
-                    if (is_floating) {
-                        XWindowAttributes attr;
-                        if (XGetWindowAttributes(base.display, base.drag_window, &attr)) {
-                            w.width = attr.width;
-                            w.height = attr.height;
-                        }
-                    }
-                    break;
-                }
+        } else if (base.resizing && dragged_idx != -1) {
+            ManagedWindow &w = *dragged;
+            bool is_floating = w.is_floating;
+            if (is_floating) {
+                w.width = w.committed.width;
+                w.height = w.committed.height;
             }
 
-            if (!is_floating && !base.horizontal_mode && current_ws.windows.size() >= 2) {
-                for (size_t i = 0; i < current_ws.windows.size(); ++i) {
-                    if (current_ws.windows[i].window == base.drag_window && i == 0) {
-                        Monitor *mon = get_monitor_at_point(base,
-                            current_ws.windows[i].x + current_ws.windows[i].width / 2,
-                            current_ws.windows[i].y + current_ws.windows[i].height / 2);
-                        if (!mon) mon = get_current_monitor(base);
-                        if (!mon) break;
+            if (!is_floating && !base.horizontal_mode && current_ws.clients.size() >= 2 && dragged_idx == 0) {
+                Monitor *mon = get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
+                if (!mon) mon = get_current_monitor(base);
 
-                        XWindowAttributes attr;
-                        if (XGetWindowAttributes(base.display, base.drag_window, &attr)) {
-                            mon->master_factor = (float)attr.width / mon->width;
-                            if (mon->master_factor < 0.1f) mon->master_factor = 0.1f;
-                            if (mon->master_factor > 0.9f) mon->master_factor = 0.9f;
-                        }
-                        break;
-                    }
+                if (mon) {
+                    mon->master_factor = (float)w.committed.width / mon->width;
+                    if (mon->master_factor < 0.1f) mon->master_factor = 0.1f;
+                    if (mon->master_factor > 0.9f) mon->master_factor = 0.9f;
                 }
             }
         }
 
-        if (base.horizontal_mode) {
-            tile_horizontal(base);
-        } else {
+        if (changed_monitor) {
             tile_windows(base);
+        } else {
+            tile_current(base);
         }
 
         base.dragging = false;
         base.resizing = false;
         base.drag_window = None;
+        base.drag_client = NO_CLIENT;
 
-        if (base.focused_window) {
-            XRaiseWindow(base.display, base.focused_window->window);
-        }
-
-        XFlush(base.display);
+        flush(base);
     }
 }
 
+// Only the latest pointer position matters: it is stored here and applied
+// at most once per refresh interval of the window's monitor, either right
+// away or from the event loop via drag_service.
 void nwm::handle_motion_notify(XMotionEvent *e, Base &base) {
-    if (e->window == base.systray.window) {
-        return;
-    }
-
-    if (e->window == base.bar.window) {
-        bar_handle_motion(base, e->x, e->y);
+    if (!base.dragging && !base.resizing) {
+        // Over the bare root, focus follows the pointer between monitors.
+        if (e->window == base.root && e->subwindow == None) {
+            Monitor *mon = get_monitor_at_point(base, e->x_root, e->y_root);
+            if (mon) select_monitor(base, mon->id);
+        }
         return;
     }
+    if (base.drag_client == NO_CLIENT) return;
 
-    if (!base.dragging && !base.resizing) return;
-    if (base.drag_window == None) return;
-
-    auto &current_ws = get_current_workspace(base);
-
-    if (base.dragging) {
-        for (auto &w : current_ws.windows) {
-            if (w.window == base.drag_window) {
-                int delta_x = e->x_root - base.drag_start_x;
-                int delta_y = e->y_root - base.drag_start_y;
-
-                int new_x = base.drag_window_start_x + delta_x;
-                int new_y = base.drag_window_start_y + delta_y;
-
-                XMoveWindow(base.display, w.window, new_x, new_y);
-                XRaiseWindow(base.display, w.window);
-                break;
-            }
-        }
-    } else if (base.resizing) {
-        for (auto &w : current_ws.windows) {
-            if (w.window == base.drag_window) {
-                int delta_x = e->x_root - base.drag_start_x;
-                int delta_y = e->y_root - base.drag_start_y;
-
-                int new_width = base.resize_start_width + delta_x;
-                int new_height = base.resize_start_height + delta_y;
-
-                if (new_width < 100) new_width = 100;
-                if (new_height < 100) new_height = 100;
-
-                XResizeWindow(base.display, w.window, new_width, new_height);
-                XRaiseWindow(base.display, w.window);
-                break;
-            }
-        }
-    }
+    base.drag_x = e->x_root;
+    base.drag_y = e->y_root;
+    base.drag_pending = true;
+    drag_service(base);
 }
 
 void nwm::handle_enter_notify(XCrossingEvent *e, Base &base) {
-    if (e->window == base.bar.window) {
-        return;
-    }
-
     if (base.dragging || base.resizing) {
         return;
     }
 
-    XWindowAttributes attr;
-    if (XGetWindowAttributes(base.display, e->window, &attr)) {
-        if (attr.override_redirect) {
-            return;
-        }
-    }
-
-    Atom actual_type;
-    int actual_format;
-    unsigned long nitems, bytes_after;
-    unsigned char *prop = nullptr;
-
-    Atom window_type_atom = XInternAtom(base.display, "_NET_WM_WINDOW_TYPE", False);
-    if (XGetWindowProperty(base.display, e->window, window_type_atom, 0, 1,
-                          False, XA_ATOM, &actual_type, &actual_format,
-                          &nitems, &bytes_after, &prop) == Success && prop) {
-        Atom type = *(Atom*)prop;
-        XFree(prop);
-
-        Atom dropdown = XInternAtom(base.display, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", False);
-        Atom popup = XInternAtom(base.display, "_NET_WM_WINDOW_TYPE_POPUP_MENU", False);
-        Atom combo = XInternAtom(base.display, "_NET_WM_WINDOW_TYPE_COMBO", False);
+    // Override-redirect and popup windows are never managed, so the index
+    // lookup alone filters them out without asking the server.
+    ManagedWindow *w = find_window(base, e->window);
+    if (!w) return;
 
-        if (type == dropdown || type == popup || type == combo) {
-            return;
-        }
-    }
-
-    auto &current_ws = get_current_workspace(base);
-    for (auto &w : current_ws.windows) {
-        if (e->window == w.window) {
-            focus_window(&w, base);
-            break;
-        }
-    }
-}
-
-void nwm::handle_expose(XExposeEvent *e, Base &base) {
-    if (e->window == base.bar.window) {
-        bar_draw(base);
+    if (w->workspace != (int)base.current_workspace) {
+        Monitor *shown = workspace_monitor(base, w->workspace);
+        if (!shown) return;
+        select_monitor(base, shown->id);
     }
+    focus_window(w, base);
 }
 
 void nwm::setup_ewmh(Base &base) {
-    Atom net_supporting_wm_check = XInternAtom(base.display, "_NET_SUPPORTING_WM_CHECK", False);
-    Atom net_wm_name = XInternAtom(base.display, "_NET_WM_NAME", False);
-    Atom utf8_string = XInternAtom(base.display, "UTF8_STRING", False);
-    Atom net_supported = XInternAtom(base.display, "_NET_SUPPORTED", False);
+    Atom net_supporting_wm_check = atom(NET_SUPPORTING_WM_CHECK);
+    Atom net_wm_name = atom(NET_WM_NAME);
+    Atom utf8_string = atom(UTF8_STRING);
+    Atom net_supported = atom(NET_SUPPORTED);
 
     Window check_win = XCreateSimpleWindow(base.display, base.root, 0, 0, 1, 1, 0, 0, 0);
 
@@ -1712,45 +1707,160 @@ void nwm::setup_ewmh(Base &base) {
     Atom supported[] = {
         net_supporting_wm_check,
         net_wm_name,
-        XInternAtom(base.display, "_NET_WM_STATE", False),
-        XInternAtom(base.display, "_NET_WM_STATE_FULLSCREEN", False),
-        XInternAtom(base.display, "_NET_WM_STATE_MODAL", False),
-        XInternAtom(base.display, "_NET_WM_WINDOW_TYPE", False),
-        XInternAtom(base.display, "_NET_WM_WINDOW_TYPE_DIALOG", False),
-        XInternAtom(base.display, "_NET_WM_WINDOW_TYPE_UTILITY", False),
-        XInternAtom(base.display, "_NET_WM_WINDOW_TYPE_SPLASH", False),
-        XInternAtom(base.display, "_NET_ACTIVE_WINDOW", False),
-        XInternAtom(base.display, "_NET_CLIENT_LIST", False),
-        XInternAtom(base.display, "_NET_NUMBER_OF_DESKTOPS", False),
-        XInternAtom(base.display, "_NET_CURRENT_DESKTOP", False),
+        atom(NET_WM_STATE),
+        atom(NET_WM_STATE_FULLSCREEN),
+        atom(NET_WM_STATE_MODAL),
+        atom(NET_WM_WINDOW_TYPE),
+        atom(NET_WM_WINDOW_TYPE_DIALOG),
+        atom(NET_WM_WINDOW_TYPE_UTILITY),
+        atom(NET_WM_WINDOW_TYPE_SPLASH),
+        atom(NET_ACTIVE_WINDOW),
+        atom(NET_CLIENT_LIST),
+        atom(NET_CLIENT_LIST_STACKING),
+        atom(NET_NUMBER_OF_DESKTOPS),
+        atom(NET_CURRENT_DESKTOP),
+        atom(NET_WM_DESKTOP),
     };
 
     XChangeProperty(base.display, base.root, net_supported, XA_ATOM, 32,
                    PropModeReplace, (unsigned char *)supported, sizeof(supported) / sizeof(Atom));
 
     long num_desktops = NUM_WORKSPACES;
-    Atom net_number_of_desktops = XInternAtom(base.display, "_NET_NUMBER_OF_DESKTOPS", False);
+    Atom net_number_of_desktops = atom(NET_NUMBER_OF_DESKTOPS);
     XChangeProperty(base.display, base.root, net_number_of_desktops, XA_CARDINAL, 32,
                    PropModeReplace, (unsigned char *)&num_desktops, 1);
 
-    long current_desktop = 0;
-    Atom net_current_desktop = XInternAtom(base.display, "_NET_CURRENT_DESKTOP", False);
-    XChangeProperty(base.display, base.root, net_current_desktop, XA_CARDINAL, 32,
-                   PropModeReplace, (unsigned char *)&current_desktop, 1);
-
+    // _NET_CURRENT_DESKTOP, _NET_ACTIVE_WINDOW and the client lists are
+    // written by ewmh_flush.
     XSync(base.display, False);
 
     base.hint_check_window = check_win;
 }
 
+void nwm::adopt_windows(Base &base, const std::vector<Window> &windows) {
+    for (const WindowTraits &t : classify_windows(base, windows)) {
+        if (!t.valid) continue;
+        bool viewable = (t.map_state == IsViewable);
+
+        if (t.override_redirect) {
+            track_overlay(base, t.window, t.width, t.height, true, false, viewable);
+        } else if (viewable && t.ignore) {
+            if (t.special) {
+                track_overlay(base, t.window, t.width, t.height, false, true, true);
+            }
+        } else if (viewable) {
+            manage_window(t, base);
+        }
+    }
+}
+
+// Everything init sets that does not come from the X server.
+static void init_state(nwm::Base &base) {
+    base.backend = &nwm::xlib_backend;
+    base.fake = nullptr;
+    base.epoll_fd = -1;
+    base.signal_fd = -1;
+    base.ipc.listen_fd = -1;
+    base.batch_depth = 0;
+    base.layout_pending = false;
+    base.trace.file = nullptr;
+    base.trace.records = 0;
+    nwm::profile_init(base);
+    base.bar_link.bars.clear();
+    base.bar_link.exiting.clear();
+    base.bar_link.feed = nullptr;
+    base.bar_link.feed_fd = -1;
+    base.monitors_due_ns = 0;
+    base.monitors_changed_crtcs.clear();
+
+    nwm::Settings &defaults = base.default_settings;
+    defaults.border_width = BORDER_WIDTH;
+    defaults.border_color = BORDER_COLOR;
+    defaults.focus_color = FOCUS_COLOR;
+    defaults.gap_size = GAP_SIZE;
+    defaults.bar_position = BAR_POSITION;
+    defaults.scroll_windows_visible = SCROLL_WINDOWS_VISIBLE;
+    defaults.resize_step = RESIZE_STEP;
+    defaults.scroll_step = SCROLL_STEP;
+    defaults.modkey = MODKEY;
+    defaults.font = FONT;
+    defaults.workspace_labels = WIDGET;
+    defaults.bindings.clear();
+    base.settings = defaults;
+    base.settings_watch.fd = -1;
+    base.settings_watch.watch = -1;
+
+    base.gaps_enabled = true;
+    base.focused_window = nullptr;
+    base.running = false;
+    base.restart = false;
+    base.master_factor = 0.5f;
+    base.horizontal_mode = false;
+    base.bar_visible = true;
+    base.bar_height = BAR_HEIGHT;
+    nwm::settings_store(base);
+    base.hint_check_window = None;
+    base.key_table.slots.clear();
+    base.key_table.mask = 0;
+    base.key_table.count = 0;
+    base.key_table.numlock_mask = 0;
+    base.overlay_order = 0;
+
+    nwm::workspace_init(base);
+    nwm::ewmh_init(base);
+}
+
+void nwm::init_headless(Base &base, FakeDisplay &fake, int monitor_count, int width, int height) {
+    init_state(base);
+    base.backend = &fake_backend;
+    base.fake = &fake;
+    fake_display_reset(fake);
+    fake.record_ops = false;
+
+    base.display = nullptr;
+    base.screen = 0;
+    base.root = 1;
+    base.cursor = None;
+    base.cursor_move = None;
+    base.cursor_resize = None;
+    base.xrandr_event_base = 0;
+
+    base.monitors.clear();
+    base.current_monitor = 0;
+    for (int i = 0; i < monitor_count; ++i) {
+        Monitor mon;
+        mon.id = i;
+        mon.x = i * width;
+        mon.y = 0;
+        mon.width = width;
+        mon.height = height;
+        mon.current_workspace = i % NUM_WORKSPACES;
+        mon.master_factor = 0.5f;
+        mon.horizontal_mode = false;
+        mon.scroll_windows_visible = base.settings.scroll_windows_visible;
+        mon.crtc = 0;
+        mon.frame_ns = DEFAULT_FRAME_NS;
+        base.monitors.push_back(mon);
+    }
+}
+
 void nwm::init(Base &base) {
-    struct sigaction sa;
-    sa.sa_handler = [](int) {
-        while (waitpid(-1, NULL, WNOHANG) > 0);
-    };
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa, NULL);
+    init_state(base);
+
+    // SIGCHLD and SIGUSR1 (profile dump) are delivered through a signalfd so
+    // the event loop can block in epoll_wait instead of relying on an async
+    // handler.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    base.signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (base.signal_fd < 0) {
+        std::cerr << "Error: Failed to create signalfd\n";
+        std::exit(1);
+    }
+    while (waitpid(-1, NULL, WNOHANG) > 0);
 
     base.display = XOpenDisplay(NULL);
     if (!base.display) {
@@ -1759,56 +1869,24 @@ void nwm::init(Base &base) {
     }
 
     XSetErrorHandler(x_error_handler);
+    atoms_init(base.display);
 
-    base.gaps_enabled = true;
-    base.gaps = GAP_SIZE;
     base.screen = DefaultScreen(base.display);
     base.root = RootWindow(base.display, base.screen);
-    base.focused_window = nullptr;
-    base.running = false;
-    base.restart = false;
-    base.master_factor = 0.5f;
-    base.horizontal_mode = false;
-    base.widget = WIDGET;
-    base.bar_visible = true;
-    base.bar_position = BAR_POSITION;
-    base.border_width = BORDER_WIDTH;
-    base.border_color = BORDER_COLOR;
-    base.focus_color = FOCUS_COLOR;
-    base.resize_step = RESIZE_STEP;
-    base.scroll_step = SCROLL_STEP;
 
     base.cursor = XCreateFontCursor(base.display, XC_left_ptr);
     base.cursor_move = XCreateFontCursor(base.display, XC_fleur);
     base.cursor_resize = XCreateFontCursor(base.display, XC_bottom_right_corner);
     XDefineCursor(base.display, base.root, base.cursor);
 
-    base.xft_draw = XftDrawCreate(base.display, base.root,
-                                 DefaultVisual(base.display, base.screen),
-                                 DefaultColormap(base.display, base.screen));
-    if (!base.xft_draw) {
-        std::cerr << "Error: Failed to create XftDraw\n";
-        std::exit(1);
-    }
-
-    base.xft_font = XftFontOpenName(base.display, base.screen, FONT);
-    if (!base.xft_font) {
-        base.xft_font = XftFontOpenName(base.display, base.screen, "monospace:size=10");
-    }
-    if (!base.xft_font) {
-        base.xft_font = XftFontOpenName(base.display, base.screen, "fixed");
-    }
-    if (!base.xft_font) {
-        std::cerr << "Error: Failed to load any Xft font\n";
-        std::exit(1);
+    // A replay runs on the compiled defaults so it matches the recording
+    // regardless of the local config file.
+    if (!base.replaying) {
+        settings_init(base);
     }
 
-    workspace_init(base);
     monitors_init(base);
 
-    bar_init(base);
-    systray_init(base);
-
     XSelectInput(base.display, base.root,
                  SubstructureRedirectMask | SubstructureNotifyMask |
                  ButtonPressMask | EnterWindowMask | KeyPressMask | PropertyChangeMask);
@@ -1817,25 +1895,25 @@ void nwm::init(Base &base) {
     Window *children;
     unsigned int nchildren;
 
-    if (XQueryTree(base.display, base.root, &root_return, &parent_return, &children, &nchildren)) {
-        for (unsigned int i = 0; i < nchildren; ++i) {
-            XWindowAttributes attr;
-            if (XGetWindowAttributes(base.display, children[i], &attr)) {
-                bool should_manage = (attr.map_state == IsViewable) &&
-                                   !should_ignore_window(base.display, children[i]);
-
-                if (should_manage) {
-                    nwm::manage_window(children[i], base);
-                }
-            }
-        }
+    // After a restart the previous instance's snapshot is restored instead.
+    // Either way this happens before the bar is spawned, so the bar never
+    // inherits the snapshot.
+    if (!base.replaying && !snapshot_restore(base) &&
+        XQueryTree(base.display, base.root, &root_return, &parent_return, &children, &nchildren)) {
+        std::vector<Window> windows(children, children + nchildren);
         if (children) XFree(children);
+        adopt_windows(base, windows);
+    }
+
+    if (!base.replaying) {
+        bar_link_start(base, base.settings.font.c_str());
+        ipc_init(base);
     }
 
     setup_ewmh(base);
     nwm::tile_windows(base);
     nwm::setup_keys(base);
-    bar_draw(base);
+    bar_link_publish(base);
 }
 
 void nwm::cleanup(Base &base) {
@@ -1852,25 +1930,17 @@ void nwm::cleanup(Base &base) {
     }
 
     if (!base.restart) {
-        for (auto &ws : base.workspaces) {
-            for (auto &w : ws.windows) {
-                XUnmapWindow(base.display, w.window);
+        for (auto &slot : base.client_store.slots) {
+            if (slot.live) {
+                XUnmapWindow(base.display, slot.client.window);
             }
         }
     }
 
-    systray_cleanup(base);
-    bar_cleanup(base);
-
-    if (base.xft_font) {
-        XftFontClose(base.display, base.xft_font);
-        base.xft_font = nullptr;
-    }
-
-    if (base.xft_draw) {
-        XftDrawDestroy(base.xft_draw);
-        base.xft_draw = nullptr;
-    }
+    bar_link_stop(base);
+    ipc_cleanup(base);
+    settings_cleanup(base);
+    trace_stop(base);
 
     if (base.cursor) {
         XFreeCursor(base.display, base.cursor);
@@ -1891,6 +1961,84 @@ void nwm::cleanup(Base &base) {
         XCloseDisplay(base.display);
         base.display = nullptr;
     }
+
+    if (base.signal_fd >= 0) {
+        close(base.signal_fd);
+        base.signal_fd = -1;
+    }
+
+    if (base.epoll_fd >= 0) {
+        close(base.epoll_fd);
+        base.epoll_fd = -1;
+    }
+}
+
+void nwm::dispatch_event(XEvent &e, Base &base) {
+    if (e.type == base.xrandr_event_base + RRScreenChangeNotify ||
+        e.type == base.xrandr_event_base + RRNotify) {
+        monitors_schedule(base, e);
+        return;
+    }
+
+    switch (e.type) {
+        case MapRequest:
+            handle_map_request(&e.xmaprequest, base);
+            break;
+        case UnmapNotify:
+            handle_unmap_notify(&e.xunmap, base);
+            break;
+        case DestroyNotify:
+            handle_destroy_notify(&e.xdestroywindow, base);
+            break;
+        case ConfigureRequest:
+            handle_configure_request(&e.xconfigurerequest, base);
+            break;
+        case KeyPress:
+            handle_key_press(&e.xkey, base);
+            break;
+        case ButtonPress:
+            handle_button_press(&e.xbutton, base);
+            break;
+        case ButtonRelease:
+            handle_button_release(&e.xbutton, base);
+            break;
+        case MotionNotify:
+            handle_motion_notify(&e.xmotion, base);
+            break;
+        case MappingNotify:
+            handle_mapping_notify(&e.xmapping, base);
+            break;
+        case EnterNotify:
+            handle_enter_notify(&e.xcrossing, base);
+            break;
+        case CreateNotify:
+            handle_create_notify(&e.xcreatewindow, base);
+            break;
+        case MapNotify:
+            handle_map_notify(&e.xmap, base);
+            break;
+        case ConfigureNotify:
+            handle_configure_notify(&e.xconfigure, base);
+            break;
+        case ReparentNotify:
+            handle_reparent_notify(&e.xreparent, base);
+            break;
+        case ClientMessage:
+            handle_client_message(&e.xclient, base);
+            break;
+        default:
+            break;
+    }
+}
+
+static void epoll_watch(nwm::Base &base, int fd) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(base.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+    }
 }
 
 void nwm::run(Base &base) {
@@ -1901,85 +2049,87 @@ void nwm::run(Base &base) {
                  ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
                  EnterWindowMask | KeyPressMask | PropertyChangeMask);
 
-    XSelectInput(base.display, base.bar.window,
-                 ExposureMask | ButtonPressMask | ButtonReleaseMask |
-                 PointerMotionMask | Button4Mask | Button5Mask);
-
     XSetErrorHandler(x_error_handler);
 
-    time_t last_bar_update = time(nullptr);
+    int x_fd = ConnectionNumber(base.display);
+
+    base.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (base.epoll_fd < 0) {
+        std::cerr << "Error: Failed to create epoll instance\n";
+        return;
+    }
+
+    epoll_watch(base, x_fd);
+    epoll_watch(base, base.signal_fd);
+    if (base.ipc.listen_fd >= 0) {
+        epoll_watch(base, base.ipc.listen_fd);
+    }
+    if (base.settings_watch.fd >= 0) {
+        epoll_watch(base, base.settings_watch.fd);
+    }
+
+    struct epoll_event events[8];
 
     while (base.running) {
-        while (XPending(base.display)) {
+        // Xlib may already hold events read off the socket while servicing
+        // a reply, so the queue has to be drained before blocking on the fd.
+        while (base.running && XPending(base.display)) {
             XEvent e;
             XNextEvent(base.display, &e);
-
-            if (e.type == base.xrandr_event_base + RRScreenChangeNotify ||
-                e.type == base.xrandr_event_base + RRNotify) {
-                monitors_update(base);
-                bar_draw(base);
-                continue;
-            }
-
-            switch (e.type) {
-                case MapRequest:
-                    handle_map_request(&e.xmaprequest, base);
-                    break;
-                case UnmapNotify:
-                    handle_unmap_notify(&e.xunmap, base);
-                    break;
-                case DestroyNotify:
-                    handle_destroy_notify(&e.xdestroywindow, base);
-                    break;
-                case ConfigureRequest:
-                    handle_configure_request(&e.xconfigurerequest, base);
-                    break;
-                case KeyPress:
-                    handle_key_press(&e.xkey, base);
-                    break;
-                case ButtonPress:
-                    handle_button_press(&e.xbutton, base);
-                    break;
-                case ButtonRelease:
-                    handle_button_release(&e.xbutton, base);
-                    break;
-                case MotionNotify:
-                    handle_motion_notify(&e.xmotion, base);
-                    break;
-                case EnterNotify:
-                    handle_enter_notify(&e.xcrossing, base);
-                    break;
-                case Expose:
-                    handle_expose(&e.xexpose, base);
-                    break;
-                case ClientMessage:
-                    handle_client_message(&e.xclient, base);
-                    break;
-                default:
-                    break;
-            }
+            trace_event(base, e);
+            PROFILE_BEGIN(base, sample);
+            dispatch_event(e, base);
+            PROFILE_END(base, sample, profile_slot(e));
         }
 
-        time_t now = time(nullptr);
-        if (now - last_bar_update >= 10) {
-            base.bar.systray_width = systray_get_width(base);
-            bar_update_time(base);
-            last_bar_update = now;
+        if (!base.running) break;
+        int timeout = drag_service(base);
+        int monitors_timeout = monitors_service(base);
+        if (monitors_timeout >= 0 && (timeout < 0 || monitors_timeout < timeout)) {
+            timeout = monitors_timeout;
+        }
+        int bar_timeout = bar_link_service(base);
+        if (bar_timeout >= 0 && (timeout < 0 || bar_timeout < timeout)) {
+            timeout = bar_timeout;
+        }
+        ewmh_flush(base);
+        XFlush(base.display);
+        ipc_flush_pending(base);
+        trace_flush(base);
+
+        // The services above make round trips (monitors_update queries every
+        // changed CRTC), and Xlib queues whatever events arrive meanwhile.
+        // The socket is empty by then, so blocking here would strand them.
+        if (XEventsQueued(base.display, QueuedAlready)) continue;
+
+        int n = epoll_wait(base.epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
         }
 
-        usleep(16666);
-    }
-}
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
 
-int main(int argc, char **argv) {
-    (void)argc;
-    nwm::Base wm;
-    nwm::init(wm);
-    nwm::run(wm);
-    nwm::cleanup(wm);
-    if (wm.restart == true) {
-        execv(*argv, argv);
-        perror("Failed to execv");
+            if (fd == base.signal_fd) {
+                struct signalfd_siginfo si;
+                while (read(base.signal_fd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1) {
+                        profile_dump(base, stderr);
+                    }
+                }
+                pid_t pid;
+                while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+                    bar_link_child_exited(base, pid);
+                }
+            } else if (settings_owns(base, fd)) {
+                settings_handle(base);
+            } else if (ipc_owns(base, fd)) {
+                PROFILE_BEGIN(base, sample);
+                ipc_handle(base, fd, events[i].events);
+                PROFILE_END(base, sample, PROFILE_SLOT_IPC);
+            }
+        }
     }
-    return 0;
 }
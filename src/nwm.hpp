@@ -3,19 +3,49 @@
 
 #include <X11/Xlib.h>
 #include <X11/cursorfont.h>
-#include <X11/Xft/Xft.h>
 #include <X11/extensions/Xrandr.h>
 #include <vector>
-#include "bar.hpp"
-#include "systray.hpp"
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include "backend.hpp"
+#include "barlink.hpp"
+#include "ewmh.hpp"
+#include "ipc.hpp"
+#include "keys.hpp"
+#include "profile.hpp"
+#include "settings.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include "traits.hpp"
 
 #define WIDTH(display, screen_number) XDisplayWidth((display), (screen_number))
 #define HEIGHT(display, screen_number) XDisplayHeight((display), (screen_number))
 #define NUM_WORKSPACES 9
+// Refresh interval assumed when XRandR cannot tell: 60 Hz.
+#define DEFAULT_FRAME_NS 16666667ull
+// Quiet time after the last XRandR event before monitors are re-read.
+// Docking or undocking sends a burst of events within a few frames.
+#define MONITOR_SETTLE_NS 150000000ull
+// Events selected on every managed window.
+#define CLIENT_EVENT_MASK (EnterWindowMask | LeaveWindowMask | PropertyChangeMask | \
+                           StructureNotifyMask | FocusChangeMask)
 
 namespace nwm {
 
+// Low 16 bits select a slot in the ClientStore, high 16 bits carry the slot's
+// generation so a handle to a destroyed client never resolves to its successor.
+typedef uint32_t ClientHandle;
+#define NO_CLIENT 0
+
+struct Geometry {
+    int x, y;
+    int width, height;
+    int border_width;
+};
+
 struct ManagedWindow {
+    ClientHandle handle;
     Window window;
     int x, y;
     int width, height;
@@ -28,6 +58,23 @@ struct ManagedWindow {
     int pre_fs_x, pre_fs_y;
     int pre_fs_width, pre_fs_height;
     bool pre_fs_floating;
+
+    // What the X server was last told; commit_geometry diffs against this.
+    Geometry committed;
+
+    // UnmapNotify events still expected from our own XUnmapWindow calls.
+    int ignore_unmaps;
+};
+
+// Top-level windows the WM keeps above the tiled layer without managing them:
+// override-redirect windows and popup/notification typed clients.
+struct OverlayWindow {
+    Window window;
+    int width, height;
+    bool override_redirect;
+    bool special;
+    bool mapped;
+    unsigned long order;
 };
 
 struct Monitor {
@@ -39,10 +86,27 @@ struct Monitor {
     bool horizontal_mode;
     int scroll_windows_visible;
     RRCrtc crtc;
+    // Nanoseconds between refreshes of the CRTC's current mode; interactive
+    // move/resize applies geometry at most once per frame.
+    uint64_t frame_ns;
+    std::vector<Window> committed_stack;
+};
+
+struct ClientSlot {
+    ManagedWindow client;
+    uint16_t generation;
+    bool live;
+};
+
+// Slots live in a deque so growing the store never moves an existing client;
+// ManagedWindow pointers stay valid until the client is destroyed.
+struct ClientStore {
+    std::deque<ClientSlot> slots;
+    std::vector<uint16_t> free_slots;
 };
 
 struct Workspace {
-    std::vector<ManagedWindow> windows;
+    std::vector<ClientHandle> clients;
     ManagedWindow* focused_window;
     int scroll_offset;
     bool scroll_maximized;
@@ -54,7 +118,6 @@ struct Base {
     bool gaps_enabled;
     Window root;
     Display *display;
-    std::vector<ManagedWindow> windows;
     ManagedWindow* focused_window;
     bool running;
     bool restart;
@@ -69,12 +132,13 @@ struct Base {
     int resize_start_width;
     int resize_start_height;
 
-    XftFont* xft_font;
-    XftDraw* xft_draw;
-
-    StatusBar bar;
-    SystemTray systray;
+    int bar_height;
+    BarLink bar_link;
     std::vector<Workspace> workspaces;
+    ClientStore client_store;
+    std::unordered_map<Window, ClientHandle> window_index;
+    std::unordered_map<Window, OverlayWindow> overlays;
+    unsigned long overlay_order;
     size_t current_workspace;
     bool overview_mode;
 
@@ -82,10 +146,16 @@ struct Base {
 
     bool dragging;
     Window drag_window;
+    ClientHandle drag_client;
     int drag_start_x;
     int drag_start_y;
     int drag_window_start_x;
     int drag_window_start_y;
+    // Latest pointer position of a move/resize, applied on the next frame.
+    int drag_x;
+    int drag_y;
+    bool drag_pending;
+    uint64_t drag_applied_ns;
 
     int border_width;
     unsigned long border_color;
@@ -94,18 +164,54 @@ struct Base {
     int scroll_step;
 
     Window hint_check_window;
+    KeyTable key_table;
+
+    // config.hpp's values, and those values with the config file applied.
+    Settings default_settings;
+    Settings settings;
+    SettingsWatch settings_watch;
+
+    // Every window operation of the layout and focus code goes through
+    // backend; fake is only set when it is fake_backend.
+    const DisplayBackend *backend;
+    FakeDisplay *fake;
 
     std::vector<Monitor> monitors;
     int current_monitor;
     int xrandr_event_base;
+    // XRandR changes waiting for MONITOR_SETTLE_NS of quiet: when they are
+    // due (0 if none) and the CRTCs the RRCrtcChangeNotify events named.
+    uint64_t monitors_due_ns;
+    std::vector<RRCrtc> monitors_changed_crtcs;
+
+    int epoll_fd;
+    int signal_fd;
+
+    Ewmh ewmh;
+    IpcServer ipc;
+    // Non-zero while an IPC batch runs; layout passes and flushes requested
+    // meanwhile are collapsed into one at the end of the batch.
+    int batch_depth;
+    bool layout_pending;
+
+#ifdef NWM_PROFILE
+    Profile profile;
+#endif
+
+    Trace trace;
+    // Set before init by trace_replay: no bar, no IPC socket and no adoption
+    // of windows already on the display.
+    bool replaying;
 };
 
-void manage_window(Window window, Base &base);
+void manage_window(const WindowTraits &traits, Base &base);
 void unmanage_window(Window window, Base &base);
 void focus_window(ManagedWindow* window, Base &base);
 void move_window(ManagedWindow* window, int x, int y, Base &base);
 void resize_window(ManagedWindow* window, int width, int height, Base &base);
-void raise_override_redirect_windows(Display *display);
+void raise_override_redirect_windows(Base &base, bool large_only);
+void hide_window(ManagedWindow *window, Base &base);
+void flush(Base &base);
 void close_window(void *arg, Base &base);
 void focus_next(void *arg, Base &base);
 void focus_prev(void *arg, Base &base);
@@ -122,40 +228,75 @@ void swap_next(void *arg, Base &base);
 void resize_master(void *arg, Base &base);
 void scroll_left(void *arg, Base &base);
 void scroll_right(void *arg, Base &base);
+// Scrolls the current workspace's horizontal layout by delta pixels.
+void scroll_by(Base &base, int delta);
 
 void switch_workspace(void *arg, Base &base);
 void move_to_workspace(void *arg, Base &base);
 void workspace_init(Base &base);
 Workspace& get_current_workspace(Base &base);
+ClientHandle client_create(Base &base, const ManagedWindow &window);
+void client_destroy(Base &base, ClientHandle handle);
+ManagedWindow* client_get(Base &base, ClientHandle handle);
+ManagedWindow* find_window(Base &base, Window window);
+int workspace_position(const Workspace &ws, ClientHandle handle);
 void toggle_scroll_maximize(void *arg, Base &base);
 
 void handle_key_press(XKeyEvent *e, Base &base);
 void handle_button_press(XButtonEvent *e, Base &base);
 void handle_button_release(XButtonEvent *e, Base &base);
 void handle_motion_notify(XMotionEvent *e, Base &base);
+void handle_mapping_notify(XMappingEvent *e, Base &base);
+// Applies a pending move/resize once its frame is due. Returns the epoll
+// timeout in milliseconds until the next one, or -1 if none is pending.
+int drag_service(Base &base);
+// Re-reads the monitors once pending XRandR changes have settled. Returns
+// the epoll timeout in milliseconds until then, or -1 if none is pending.
+int monitors_service(Base &base);
 void handle_configure_request(XConfigureRequestEvent *e, Base &base);
 void handle_map_request(XMapRequestEvent *e, Base &base);
 void handle_unmap_notify(XUnmapEvent *e, Base &base);
 void handle_enter_notify(XCrossingEvent *e, Base &base);
+void handle_create_notify(XCreateWindowEvent *e, Base &base);
+void handle_map_notify(XMapEvent *e, Base &base);
+void handle_configure_notify(XConfigureEvent *e, Base &base);
+void handle_reparent_notify(XReparentEvent *e, Base &base);
 void handle_destroy_notify(XDestroyWindowEvent *e, Base &base);
-void handle_expose(XExposeEvent *e, Base &base);
 void handle_client_message(XClientMessageEvent *e, Base &base);
 
 void setup_ewmh(Base &base);
 void reload_config(void *arg, Base &base);
 void spawn(void *arg, Base &base);
 void setup_keys(Base &base);
+void dispatch_event(XEvent &e, Base &base);
 void run(Base &base);
 void init(Base &base);
+// Sets up base without an X connection, on fake_backend with monitor_count
+// side-by-side monitors of width x height. Only the layout, focus and
+// workspace code may be driven from here; event handlers still need X.
+void init_headless(Base &base, FakeDisplay &fake, int monitor_count, int width, int height);
 void cleanup(Base &base);
+// Manages or tracks the given top-level windows the way init treats the
+// windows it finds already mapped.
+void adopt_windows(Base &base, const std::vector<Window> &windows);
 
-void handle_special_window_map(Display *display, Window window);
-void raise_special_windows(Display *display);
+void handle_special_window_map(Base &base, const WindowTraits &traits);
+void raise_special_windows(Base &base);
 
 void monitors_init(Base &base);
+// Records an XRandR event; monitors_service applies the changes later.
+void monitors_schedule(Base &base, XEvent &e);
 void monitors_update(Base &base);
+// Clamps the current monitor, gives every monitor its own workspace, maps
+// and unmaps whatever became shown or hidden relative to old_monitors and
+// retiles only the monitors that changed.
+void monitors_changed(Base &base, const std::vector<Monitor> &old_monitors);
 Monitor* get_monitor_at_point(Base &base, int x, int y);
 Monitor* get_current_monitor(Base &base);
+// The monitor showing workspace, or nullptr when it is hidden.
+Monitor* workspace_monitor(Base &base, int workspace);
+// Makes monitor id current and moves focus to the workspace it shows.
+void select_monitor(Base &base, int id);
 void focus_monitor(void *arg, Base &base);
 void set_scroll_visible(void *arg, Base &base);
 
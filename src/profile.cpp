@@ -0,0 +1,156 @@
+#include "profile.hpp"
+#include "nwm.hpp"
+#include <ctime>
+#include <cstring>
+
+#ifdef NWM_PROFILE
+
+static const char *const event_names[PROFILE_SLOTS] = {
+    "", "", "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease",
+    "MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+    "KeymapNotify", "Expose", "GraphicsExpose", "NoExpose", "VisibilityNotify",
+    "CreateNotify", "DestroyNotify", "UnmapNotify", "MapNotify", "MapRequest",
+    "ReparentNotify", "ConfigureNotify", "ConfigureRequest", "GravityNotify",
+    "ResizeRequest", "CirculateNotify", "CirculateRequest", "PropertyNotify",
+    "SelectionClear", "SelectionRequest", "SelectionNotify", "ColormapNotify",
+    "ClientMessage", "MappingNotify", "GenericEvent",
+    "Extension", "IPC",
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int bucket_index(uint64_t ns) {
+    const uint64_t sub = 1u << PROFILE_SUB_BITS;
+    if (ns < sub) return ns;
+
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - PROFILE_SUB_BITS;
+    int index = ((msb - PROFILE_SUB_BITS + 1) << PROFILE_SUB_BITS) + ((ns >> shift) & (sub - 1));
+    return index < PROFILE_BUCKETS ? index : PROFILE_BUCKETS - 1;
+}
+
+// Upper edge of a bucket, so reported percentiles never understate.
+static uint64_t bucket_limit(int index) {
+    const uint64_t sub = 1u << PROFILE_SUB_BITS;
+    if (index < (int)sub) return index;
+
+    int msb = (index >> PROFILE_SUB_BITS) + PROFILE_SUB_BITS - 1;
+    uint64_t mantissa = sub + (index & (sub - 1));
+    return ((mantissa + 1) << (msb - PROFILE_SUB_BITS)) - 1;
+}
+
+static uint64_t percentile(const nwm::ProfileHistogram &h, double p) {
+    uint64_t rank = (uint64_t)(p * h.count);
+    if (rank >= h.count) rank = h.count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < PROFILE_BUCKETS; ++i) {
+        seen += h.buckets[i];
+        if (seen > rank) {
+            uint64_t limit = bucket_limit(i);
+            return limit < h.max_ns ? limit : h.max_ns;
+        }
+    }
+    return h.max_ns;
+}
+
+void nwm::profile_init(Base &base) {
+    memset(&base.profile, 0, sizeof(base.profile));
+    base.profile.started_ns = now_ns();
+}
+
+void nwm::profile_begin(Base &base, ProfileSample &sample) {
+    sample.next_request = XNextRequest(base.display);
+    sample.start_ns = now_ns();
+}
+
+void nwm::profile_end(Base &base, const ProfileSample &sample, int slot) {
+    uint64_t elapsed = now_ns() - sample.start_ns;
+    ProfileHistogram &h = base.profile.slots[slot];
+
+    h.count++;
+    h.total_ns += elapsed;
+    if (elapsed > h.max_ns) h.max_ns = elapsed;
+    h.buckets[bucket_index(elapsed)]++;
+
+    h.requests += XNextRequest(base.display) - sample.next_request;
+    if (LastKnownRequestProcessed(base.display) >= sample.next_request) {
+        h.blocking++;
+    }
+}
+
+void nwm::profile_dump(Base &base, FILE *out) {
+    double uptime = (now_ns() - base.profile.started_ns) / 1e9;
+    fprintf(out, "nwm profile after %.1fs (latencies in us)\n", uptime);
+    fprintf(out, "%-18s %9s %9s %9s %9s %9s %9s %10s %9s\n",
+            "event", "count", "mean", "p50", "p90", "p99", "max", "requests", "blocking");
+
+    for (int i = 0; i < PROFILE_SLOTS; ++i) {
+        const ProfileHistogram &h = base.profile.slots[i];
+        if (!h.count) continue;
+        fprintf(out, "%-18s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f %10llu %9llu\n",
+                event_names[i], (unsigned long long)h.count,
+                h.total_ns / 1e3 / h.count,
+                percentile(h, 0.50) / 1e3, percentile(h, 0.90) / 1e3,
+                percentile(h, 0.99) / 1e3, h.max_ns / 1e3,
+                (unsigned long long)h.requests, (unsigned long long)h.blocking);
+    }
+    fflush(out);
+}
+
+std::string nwm::profile_json(Base &base) {
+    std::string out = "{\"success\":true,\"events\":[";
+    char buf[512];
+    bool first = true;
+
+    for (int i = 0; i < PROFILE_SLOTS; ++i) {
+        const ProfileHistogram &h = base.profile.slots[i];
+        if (!h.count) continue;
+        snprintf(buf, sizeof(buf),
+                 "%s{\"event\":\"%s\",\"count\":%llu,\"total_ns\":%llu,"
+                 "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+                 "\"requests\":%llu,\"blocking\":%llu}",
+                 first ? "" : ",", event_names[i], (unsigned long long)h.count,
+                 (unsigned long long)h.total_ns,
+                 (unsigned long long)percentile(h, 0.50),
+                 (unsigned long long)percentile(h, 0.90),
+                 (unsigned long long)percentile(h, 0.99),
+                 (unsigned long long)h.max_ns, (unsigned long long)h.requests,
+                 (unsigned long long)h.blocking);
+        out += buf;
+        first = false;
+    }
+
+    snprintf(buf, sizeof(buf), "],\"uptime_ns\":%llu}",
+             (unsigned long long)(now_ns() - base.profile.started_ns));
+    out += buf;
+    return out;
+}
+
+#else
+
+void nwm::profile_init(Base &base) {
+    (void)base;
+}
+
+void nwm::profile_dump(Base &base, FILE *out) {
+    (void)base;
+    fprintf(out, "nwm: profiling not compiled in, rebuild with make PROFILE=1\n");
+    fflush(out);
+}
+
+std::string nwm::profile_json(Base &base) {
+    (void)base;
+    return "{\"success\":false,\"error\":\"profiling not compiled in, rebuild with make PROFILE=1\"}";
+}
+
+#endif
+
+int nwm::profile_slot(const XEvent &e) {
+    if (e.type >= 0 && e.type < LASTEvent) return e.type;
+    return PROFILE_SLOT_EXTENSION;
+}
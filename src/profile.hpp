@@ -0,0 +1,71 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <X11/Xlib.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Per-event-type handler timing and X request accounting, compiled in with
+// `make PROFILE=1` (-DNWM_PROFILE). Without it the PROFILE_* macros expand to
+// nothing and no state is kept.
+
+// Latencies go into log-linear buckets: 8 per power of two, so any recorded
+// value is within 12.5% of the bucket it lands in.
+#define PROFILE_SUB_BITS 3
+#define PROFILE_BUCKETS (38 << PROFILE_SUB_BITS)
+
+// Slots past the core X event types; XRandR is the only extension whose
+// events the WM selects.
+#define PROFILE_SLOT_EXTENSION LASTEvent
+#define PROFILE_SLOT_IPC (LASTEvent + 1)
+#define PROFILE_SLOTS (LASTEvent + 2)
+
+namespace nwm {
+
+struct Base;
+
+struct ProfileHistogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    // X requests the handlers issued, from XNextRequest deltas.
+    uint64_t requests;
+    // Handler runs that waited for at least one reply: the server reported
+    // a request of theirs processed (LastKnownRequestProcessed) before they
+    // returned.
+    uint64_t blocking;
+    uint32_t buckets[PROFILE_BUCKETS];
+};
+
+struct Profile {
+    ProfileHistogram slots[PROFILE_SLOTS];
+    uint64_t started_ns;
+};
+
+struct ProfileSample {
+    uint64_t start_ns;
+    unsigned long next_request;
+};
+
+#ifdef NWM_PROFILE
+#define PROFILE_BEGIN(base, sample) \
+    nwm::ProfileSample sample; nwm::profile_begin((base), sample)
+#define PROFILE_END(base, sample, slot) nwm::profile_end((base), sample, (slot))
+#else
+#define PROFILE_BEGIN(base, sample) do {} while (0)
+#define PROFILE_END(base, sample, slot) do {} while (0)
+#endif
+
+void profile_init(Base &base);
+void profile_begin(Base &base, ProfileSample &sample);
+void profile_end(Base &base, const ProfileSample &sample, int slot);
+int profile_slot(const XEvent &e);
+
+// Both report "not compiled in" when built without NWM_PROFILE.
+void profile_dump(Base &base, FILE *out);
+std::string profile_json(Base &base);
+
+}
+
+#endif // PROFILE_HPP
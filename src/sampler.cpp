@@ -0,0 +1,372 @@
+#include "sampler.hpp"
+#include <sys/statvfs.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#define SAMPLE_INTERVAL_MS 2000
+#define READ_BUFFER_SIZE 8192
+#define SLOT_FRESH 4
+
+static int open_readonly(const char *path) {
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void close_fd(int &fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Re-reads a whole procfs/sysfs file from offset 0. Returns the length read,
+// or -1. The buffer is always NUL-terminated.
+static ssize_t read_file(int fd, char *buf, size_t size) {
+    if (fd < 0) return -1;
+    ssize_t len = pread(fd, buf, size - 1, 0);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+// Skips to the next decimal number and parses it. Returns the position just
+// past the digits.
+static const char* scan_u64(const char *p, const char *end, unsigned long long &value) {
+    while (p < end && (*p < '0' || *p > '9')) ++p;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return p;
+}
+
+static const char* next_line(const char *p, const char *end) {
+    const char *nl = (const char*)memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+// Finds the line starting with key and returns the position right after it,
+// or nullptr.
+static const char* find_key(const char *p, const char *end, const char *key, size_t key_len) {
+    while (p < end) {
+        if ((size_t)(end - p) >= key_len && memcmp(p, key, key_len) == 0) {
+            return p + key_len;
+        }
+        p = next_line(p, end);
+    }
+    return nullptr;
+}
+
+static bool read_key(const char *p, const char *end, const char *key, size_t key_len,
+                     unsigned long long &value) {
+    const char *at = find_key(p, end, key, key_len);
+    if (!at) return false;
+    scan_u64(at, next_line(at, end), value);
+    return true;
+}
+
+static float sample_cpu(nwm::Metrics &m) {
+    char buf[512];
+    ssize_t len = read_file(m.stat_fd, buf, sizeof(buf));
+    if (len <= 0) return 0.0f;
+
+    const char *p = buf;
+    const char *end = next_line(buf, buf + len);
+
+    // user nice system idle iowait irq softirq steal
+    unsigned long long fields[8];
+    for (int i = 0; i < 8; ++i) {
+        p = scan_u64(p, end, fields[i]);
+    }
+
+    unsigned long long total = 0;
+    for (int i = 0; i < 8; ++i) total += fields[i];
+    unsigned long long idle = fields[3];
+
+    unsigned long long total_diff = total - m.last_cpu_total;
+    unsigned long long idle_diff = idle - m.last_cpu_idle;
+
+    m.last_cpu_total = total;
+    m.last_cpu_idle = idle;
+
+    if (total_diff == 0) return 0.0f;
+    return 100.0f * (total_diff - idle_diff) / total_diff;
+}
+
+static float sample_memory(nwm::Metrics &m) {
+    char buf[READ_BUFFER_SIZE];
+    ssize_t len = read_file(m.meminfo_fd, buf, sizeof(buf));
+    if (len <= 0) return 0.0f;
+
+    const char *end = buf + len;
+    unsigned long long mem_total = 0;
+    if (!read_key(buf, end, "MemTotal:", 9, mem_total) || mem_total == 0) return 0.0f;
+
+    unsigned long long available = 0;
+    if (!read_key(buf, end, "MemAvailable:", 13, available)) {
+        // Kernels before 3.14 have no MemAvailable.
+        unsigned long long mem_free = 0, buffers = 0, cached = 0;
+        read_key(buf, end, "MemFree:", 8, mem_free);
+        read_key(buf, end, "Buffers:", 8, buffers);
+        read_key(buf, end, "Cached:", 7, cached);
+        available = mem_free + buffers + cached;
+    }
+
+    if (available > mem_total) return 0.0f;
+    return 100.0f * (mem_total - available) / mem_total;
+}
+
+static float sample_disk(const char *path) {
+    struct statvfs stat;
+    if (statvfs(path, &stat) != 0) return 0.0f;
+
+    unsigned long total = stat.f_blocks * stat.f_frsize;
+    unsigned long available = stat.f_bavail * stat.f_frsize;
+    unsigned long used = total - available;
+
+    if (total == 0) return 0.0f;
+    return 100.0f * used / total;
+}
+
+static void format_rate(double rate, char *out, size_t size) {
+    if (rate < 1024) {
+        snprintf(out, size, "%.0f B/s", rate);
+    } else if (rate < 1024 * 1024) {
+        snprintf(out, size, "%.1f KB/s", rate / 1024);
+    } else {
+        snprintf(out, size, "%.1f MB/s", rate / (1024 * 1024));
+    }
+}
+
+// Adds one /proc/net/dev interface line to the totals; loopback is skipped.
+static void add_interface(const char *line, const char *line_end,
+                          unsigned long long &total_rx, unsigned long long &total_tx) {
+    const char *colon = (const char*)memchr(line, ':', line_end - line);
+    if (!colon) return;
+
+    const char *name = line;
+    while (name < colon && *name == ' ') ++name;
+    if (colon - name == 2 && name[0] == 'l' && name[1] == 'o') return;
+
+    // rx bytes is the first column, tx bytes the ninth.
+    unsigned long long value, rx_bytes, tx_bytes;
+    const char *p = scan_u64(colon + 1, line_end, rx_bytes);
+    for (int i = 0; i < 7; ++i) p = scan_u64(p, line_end, value);
+    scan_u64(p, line_end, tx_bytes);
+
+    total_rx += rx_bytes;
+    total_tx += tx_bytes;
+}
+
+// Interface counters drop when an interface goes away or is reset; that
+// interval shows as zero rather than wrapping around.
+static unsigned long long counter_delta(unsigned long long now, unsigned long long last) {
+    return now >= last ? now - last : 0;
+}
+
+static void sample_network(nwm::Metrics &m, nwm::SystemInfo &info) {
+    // /proc/net/dev takes about 130 bytes per interface, so hosts with many
+    // veth or bridge interfaces outgrow any fixed buffer. It is read in
+    // chunks, with a partial last line carried over to the next read.
+    char buf[READ_BUFFER_SIZE];
+    unsigned long long total_rx = 0, total_tx = 0;
+    off_t offset = 0;
+    size_t kept = 0;
+    int line_no = 0;
+    bool failed = m.net_dev_fd < 0;
+
+    while (!failed) {
+        ssize_t len = pread(m.net_dev_fd, buf + kept, sizeof(buf) - kept, offset);
+        if (len < 0) failed = true;
+        if (len <= 0) break;
+        offset += len;
+
+        const char *end = buf + kept + len;
+        const char *line = buf;
+        const char *nl;
+        while ((nl = (const char*)memchr(line, '\n', end - line))) {
+            // The first two lines are column headers.
+            if (++line_no > 2) add_interface(line, nl, total_rx, total_tx);
+            line = nl + 1;
+        }
+
+        kept = end - line;
+        if (kept == sizeof(buf)) kept = 0;
+        memmove(buf, line, kept);
+    }
+    if (kept && ++line_no > 2) add_interface(buf, buf + kept, total_rx, total_tx);
+
+    if (failed || offset == 0) {
+        snprintf(info.network_rx, sizeof(info.network_rx), "0 KB/s");
+        snprintf(info.network_tx, sizeof(info.network_tx), "0 KB/s");
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - m.last_net_time).count();
+
+    if (duration > 0 && m.last_rx_bytes > 0) {
+        format_rate(counter_delta(total_rx, m.last_rx_bytes) / (duration / 1000.0),
+                    info.network_rx, sizeof(info.network_rx));
+        format_rate(counter_delta(total_tx, m.last_tx_bytes) / (duration / 1000.0),
+                    info.network_tx, sizeof(info.network_tx));
+    } else {
+        snprintf(info.network_rx, sizeof(info.network_rx), "0 B/s");
+        snprintf(info.network_tx, sizeof(info.network_tx), "0 B/s");
+    }
+
+    m.last_rx_bytes = total_rx;
+    m.last_tx_bytes = total_tx;
+    m.last_net_time = now;
+}
+
+static void sample_battery(nwm::Metrics &m, nwm::SystemInfo &info) {
+    char buf[64];
+
+    info.battery_percent = -1;
+    snprintf(info.battery_status, sizeof(info.battery_status), "N/A");
+
+    ssize_t len = read_file(m.capacity_fd, buf, sizeof(buf));
+    if (len > 0) {
+        unsigned long long percent;
+        scan_u64(buf, buf + len, percent);
+        info.battery_percent = (int)percent;
+    }
+
+    len = read_file(m.status_fd, buf, sizeof(buf));
+    if (len > 0) {
+        size_t n = strcspn(buf, " \n");
+        if (n >= sizeof(info.battery_status)) n = sizeof(info.battery_status) - 1;
+        memcpy(info.battery_status, buf, n);
+        info.battery_status[n] = '\0';
+    }
+}
+
+static void format_system_info(nwm::SystemInfo &info) {
+    int len = snprintf(info.summary, sizeof(info.summary),
+                       "CPU %.0f%%  RAM %.0f%%  DISK %.0f%%  DOWN %s UP %s",
+                       info.cpu_usage, info.memory_usage, info.disk_usage,
+                       info.network_rx, info.network_tx);
+
+    if (info.battery_percent >= 0 && len > 0 && (size_t)len < sizeof(info.summary)) {
+        const char *bat_icon = strcmp(info.battery_status, "Charging") == 0 ? "CHG" : "BAT";
+        snprintf(info.summary + len, sizeof(info.summary) - len,
+                 "  %s %d%%", bat_icon, info.battery_percent);
+    }
+
+    info.level = 0;
+    if (info.cpu_usage > 90 || info.memory_usage > 90) {
+        info.level = 2;
+    } else if (info.cpu_usage > 75 || info.memory_usage > 75) {
+        info.level = 1;
+    }
+}
+
+void nwm::metrics_open(Metrics &metrics) {
+    metrics.stat_fd = open_readonly("/proc/stat");
+    metrics.meminfo_fd = open_readonly("/proc/meminfo");
+    metrics.net_dev_fd = open_readonly("/proc/net/dev");
+    metrics.capacity_fd = open_readonly("/sys/class/power_supply/BAT0/capacity");
+    metrics.status_fd = open_readonly("/sys/class/power_supply/BAT0/status");
+
+    metrics.last_cpu_total = 0;
+    metrics.last_cpu_idle = 0;
+    metrics.last_rx_bytes = 0;
+    metrics.last_tx_bytes = 0;
+    metrics.last_net_time = std::chrono::steady_clock::now();
+}
+
+void nwm::metrics_close(Metrics &metrics) {
+    close_fd(metrics.stat_fd);
+    close_fd(metrics.meminfo_fd);
+    close_fd(metrics.net_dev_fd);
+    close_fd(metrics.capacity_fd);
+    close_fd(metrics.status_fd);
+}
+
+void nwm::metrics_sample(Metrics &metrics, SystemInfo &info) {
+    info.cpu_usage = sample_cpu(metrics);
+    info.memory_usage = sample_memory(metrics);
+    info.disk_usage = sample_disk("/");
+    sample_network(metrics, info);
+    sample_battery(metrics, info);
+    format_system_info(info);
+}
+
+static void sampler_loop(nwm::Sampler &sampler) {
+    char last_summary[SYSINFO_SUMMARY_MAX] = "";
+    int last_level = -1;
+
+    while (sampler.running.load()) {
+        nwm::SystemInfo &info = sampler.slots[sampler.back];
+        nwm::metrics_sample(sampler.metrics, info);
+
+        if (strcmp(info.summary, last_summary) != 0 || info.level != last_level) {
+            memcpy(last_summary, info.summary, sizeof(last_summary));
+            last_level = info.level;
+
+            // A snapshot the X thread has not picked up yet is simply
+            // overwritten next time; only the newest one is ever drawn.
+            sampler.back = sampler.ready.exchange(sampler.back | SLOT_FRESH) & ~SLOT_FRESH;
+            uint64_t one = 1;
+            if (write(sampler.event_fd, &one, sizeof(one)) < 0) {
+                perror("sampler: eventfd write");
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(sampler.mutex);
+        sampler.wake.wait_for(lock, std::chrono::milliseconds(SAMPLE_INTERVAL_MS),
+                              [&] { return !sampler.running.load(); });
+    }
+}
+
+void nwm::sampler_start(Sampler &sampler) {
+    memset(sampler.slots, 0, sizeof(sampler.slots));
+    sampler.back = 0;
+    sampler.ready.store(1);
+    sampler.front = 2;
+    sampler.running.store(true);
+
+    sampler.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sampler.event_fd < 0) {
+        perror("eventfd");
+        sampler.running.store(false);
+        return;
+    }
+
+    metrics_open(sampler.metrics);
+    sampler.thread = std::thread(sampler_loop, std::ref(sampler));
+}
+
+void nwm::sampler_stop(Sampler &sampler) {
+    {
+        std::lock_guard<std::mutex> lock(sampler.mutex);
+        sampler.running.store(false);
+    }
+    sampler.wake.notify_all();
+
+    if (sampler.thread.joinable()) {
+        sampler.thread.join();
+        metrics_close(sampler.metrics);
+    }
+
+    if (sampler.event_fd >= 0) {
+        close(sampler.event_fd);
+        sampler.event_fd = -1;
+    }
+}
+
+bool nwm::sampler_take(Sampler &sampler, SystemInfo &out) {
+    uint64_t count;
+    while (read(sampler.event_fd, &count, sizeof(count)) == sizeof(count));
+
+    if (!(sampler.ready.load() & SLOT_FRESH)) return false;
+
+    sampler.front = sampler.ready.exchange(sampler.front) & ~SLOT_FRESH;
+    out = sampler.slots[sampler.front];
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace nwm {
+
+#define SYSINFO_RATE_MAX 16
+#define SYSINFO_STATUS_MAX 16
+#define SYSINFO_SUMMARY_MAX 128
+
+// Plain data only, so a snapshot can be filled and copied without touching
+// the heap.
+struct SystemInfo {
+    float cpu_usage;
+    float memory_usage;
+    float disk_usage;
+    char network_rx[SYSINFO_RATE_MAX];
+    char network_tx[SYSINFO_RATE_MAX];
+    char battery_status[SYSINFO_STATUS_MAX];
+    int battery_percent;
+
+    // The bar text built from the fields above, and its severity
+    // (0 normal, 1 warning, 2 critical).
+    char summary[SYSINFO_SUMMARY_MAX];
+    int level;
+};
+
+// procfs/sysfs files are opened once and re-read with pread, so a sample
+// costs a handful of syscalls and no allocations.
+struct Metrics {
+    int stat_fd;
+    int meminfo_fd;
+    int net_dev_fd;
+    int capacity_fd;
+    int status_fd;
+
+    unsigned long long last_cpu_total;
+    unsigned long long last_cpu_idle;
+    unsigned long long last_rx_bytes;
+    unsigned long long last_tx_bytes;
+    std::chrono::steady_clock::time_point last_net_time;
+};
+
+void metrics_open(Metrics &metrics);
+void metrics_close(Metrics &metrics);
+void metrics_sample(Metrics &metrics, SystemInfo &info);
+
+// Samples system metrics on its own thread so slow procfs/statvfs reads
+// never stall the X event loop. Snapshots are handed over through a triple
+// buffer: the sampler fills its back slot and swaps it into `ready`, the X
+// thread swaps `ready` with its front slot. event_fd announces a swap.
+struct Sampler {
+    std::thread thread;
+    Metrics metrics;
+    SystemInfo slots[3];
+    int back;
+    int front;
+    std::atomic<int> ready;
+    std::atomic<bool> running;
+    std::mutex mutex;
+    std::condition_variable wake;
+    int event_fd;
+};
+
+void sampler_start(Sampler &sampler);
+void sampler_stop(Sampler &sampler);
+// Drains event_fd and copies the latest snapshot into out. Returns false if
+// nothing new was published.
+bool sampler_take(Sampler &sampler, SystemInfo &out);
+
+}
+
+#endif // SAMPLER_HPP
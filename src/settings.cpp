@@ -0,0 +1,535 @@
+#include "settings.hpp"
+#include "nwm.hpp"
+#include "tiling.hpp"
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+enum ArgKind {
+    ARG_NONE,
+    ARG_INT,      // passed as a pointer to int
+    ARG_DELTA,    // passed as the pointer value itself, like resize_master
+    ARG_COMMAND,  // argv for spawn
+};
+
+struct Action {
+    const char *name;
+    void (*func)(void*, nwm::Base&);
+    ArgKind kind;
+};
+
+// Names match nwm-msg commands where both exist. Workspace and monitor
+// numbers count from 0.
+static const Action actions[] = {
+    { "spawn",                    nwm::spawn,                    ARG_COMMAND },
+    { "close_window",             nwm::close_window,             ARG_NONE },
+    { "quit",                     nwm::quit_wm,                  ARG_NONE },
+    { "reload_config",            nwm::reload_config,            ARG_NONE },
+    { "toggle_bar",               nwm::toggle_bar,               ARG_NONE },
+    { "toggle_gap",               nwm::toggle_gap,               ARG_NONE },
+    { "toggle_layout",            nwm::toggle_layout,            ARG_NONE },
+    { "toggle_fullscreen",        nwm::toggle_fullscreen,        ARG_NONE },
+    { "toggle_scroll_maximize",   nwm::toggle_scroll_maximize,   ARG_NONE },
+    { "toggle_float",             nwm::toggle_float,             ARG_NONE },
+    { "focus_next",               nwm::focus_next,               ARG_NONE },
+    { "focus_prev",               nwm::focus_prev,               ARG_NONE },
+    { "swap_next",                nwm::swap_next,                ARG_NONE },
+    { "swap_prev",                nwm::swap_prev,                ARG_NONE },
+    { "resize_master",            nwm::resize_master,            ARG_DELTA },
+    { "scroll_left",              nwm::scroll_left,              ARG_NONE },
+    { "scroll_right",             nwm::scroll_right,             ARG_NONE },
+    { "focus_monitor",            nwm::focus_monitor,            ARG_INT },
+    { "set_scroll_visible",       nwm::set_scroll_visible,       ARG_INT },
+    { "increment_scroll_visible", nwm::increment_scroll_visible, ARG_NONE },
+    { "decrement_scroll_visible", nwm::decrement_scroll_visible, ARG_NONE },
+    { "workspace",                nwm::switch_workspace,         ARG_INT },
+    { "move_to_workspace",        nwm::move_to_workspace,        ARG_INT },
+};
+
+static const Action* find_action(const std::string &name) {
+    for (const Action &a : actions) {
+        if (name == a.name) return &a;
+    }
+    return nullptr;
+}
+
+static std::string trim(const std::string &s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return std::string();
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Drops a trailing comment: a # standing as its own word, so colours such
+// as #005577 are left alone.
+static std::string strip_comment(const std::string &s) {
+    for (size_t i = 1; i < s.size(); ++i) {
+        if (s[i] != '#' || (s[i - 1] != ' ' && s[i - 1] != '\t')) continue;
+        if (i + 1 == s.size() || s[i + 1] == ' ' || s[i + 1] == '\t') return s.substr(0, i);
+    }
+    return s;
+}
+
+static std::vector<std::string> split_words(const std::string &s) {
+    std::vector<std::string> words;
+    std::istringstream in(s);
+    std::string word;
+    while (in >> word) words.push_back(word);
+    return words;
+}
+
+static bool parse_int(const std::string &s, int &out) {
+    if (s.empty()) return false;
+    char *end;
+    errno = 0;
+    long v = strtol(s.c_str(), &end, 10);
+    if (*end || errno || v < INT_MIN || v > INT_MAX) return false;
+    out = (int)v;
+    return true;
+}
+
+static bool parse_color(const std::string &s, unsigned long &out) {
+    std::string digits = s;
+    if (!digits.empty() && digits[0] == '#') {
+        digits = digits.substr(1);
+    } else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        digits = digits.substr(2);
+    }
+    if (digits.empty() || digits.size() > 6) return false;
+
+    char *end;
+    unsigned long v = strtoul(digits.c_str(), &end, 16);
+    if (*end) return false;
+    out = v;
+    return true;
+}
+
+static bool parse_modifier(const std::string &name, unsigned int modkey, unsigned int &out) {
+    if (name == "Mod") out = modkey;
+    else if (name == "Shift") out = ShiftMask;
+    else if (name == "Control" || name == "Ctrl") out = ControlMask;
+    else if (name == "Mod1" || name == "Alt") out = Mod1Mask;
+    else if (name == "Mod2") out = Mod2Mask;
+    else if (name == "Mod3") out = Mod3Mask;
+    else if (name == "Mod4" || name == "Super") out = Mod4Mask;
+    else if (name == "Mod5") out = Mod5Mask;
+    else return false;
+    return true;
+}
+
+// "Mod+Shift+Return": modifiers joined with '+', keysym last. "Mod" is only
+// noted in uses_modkey, since a later modkey line may still change it.
+static bool parse_combo(const std::string &text, unsigned int &mod, bool &uses_modkey,
+                        KeySym &keysym, std::string &error) {
+    mod = 0;
+    uses_modkey = false;
+    size_t start = 0;
+    for (;;) {
+        size_t plus = text.find('+', start);
+        if (plus == std::string::npos || plus + 1 == text.size()) break;
+
+        unsigned int m;
+        std::string name = text.substr(start, plus - start);
+        if (name == "Mod") {
+            uses_modkey = true;
+        } else if (parse_modifier(name, 0, m)) {
+            mod |= m;
+        } else {
+            error = "unknown modifier '" + name + "'";
+            return false;
+        }
+        start = plus + 1;
+    }
+
+    std::string key = text.substr(start);
+    keysym = XStringToKeysym(key.c_str());
+    if (keysym == NoSymbol) {
+        error = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool parse_binding(const std::string &value, bool unbind,
+                          nwm::SettingsBinding &b, std::string &error) {
+    size_t space = value.find_first_of(" \t");
+    std::string combo = value.substr(0, space);
+    std::string rest = space == std::string::npos ? std::string() : trim(value.substr(space));
+
+    if (!parse_combo(combo, b.mod, b.uses_modkey, b.keysym, error)) return false;
+
+    b.func = nullptr;
+    b.arg_ptr = nullptr;
+    b.int_arg = 0;
+    if (unbind) {
+        if (!rest.empty()) {
+            error = "unbind takes only a key";
+            return false;
+        }
+        return true;
+    }
+
+    space = rest.find_first_of(" \t");
+    b.action = rest.substr(0, space);
+    b.arg = space == std::string::npos ? std::string() : trim(rest.substr(space));
+
+    const Action *action = find_action(b.action);
+    if (!action) {
+        error = "unknown action '" + b.action + "'";
+        return false;
+    }
+
+    int n;
+    switch (action->kind) {
+        case ARG_NONE:
+            if (!b.arg.empty()) {
+                error = b.action + " takes no argument";
+                return false;
+            }
+            break;
+        case ARG_INT:
+        case ARG_DELTA:
+            if (!parse_int(b.arg, n)) {
+                error = b.action + " expects a number";
+                return false;
+            }
+            break;
+        case ARG_COMMAND:
+            if (b.arg.empty()) {
+                error = b.action + " expects a command";
+                return false;
+            }
+            break;
+    }
+    return true;
+}
+
+// Points each binding's argument at storage inside the binding. Must run
+// again whenever the bindings vector is copied or reallocated.
+static void bind_args(nwm::Settings &settings) {
+    for (nwm::SettingsBinding &b : settings.bindings) {
+        b.func = nullptr;
+        b.arg_ptr = nullptr;
+        b.argv.clear();
+        b.argv_ptrs.clear();
+
+        const Action *action = b.action.empty() ? nullptr : find_action(b.action);
+        if (!action) continue;
+
+        b.func = action->func;
+        switch (action->kind) {
+            case ARG_NONE:
+                break;
+            case ARG_INT:
+                parse_int(b.arg, b.int_arg);
+                b.arg_ptr = &b.int_arg;
+                break;
+            case ARG_DELTA:
+                parse_int(b.arg, b.int_arg);
+                b.arg_ptr = (const void*)(long)b.int_arg;
+                break;
+            case ARG_COMMAND:
+                b.argv = split_words(b.arg);
+                for (const std::string &word : b.argv) b.argv_ptrs.push_back(word.c_str());
+                b.argv_ptrs.push_back(nullptr);
+                b.arg_ptr = b.argv_ptrs.data();
+                break;
+        }
+    }
+}
+
+// Parses `path` on top of the defaults. A missing file yields the defaults;
+// a bad line is reported and skipped.
+static nwm::Settings parse_file(const std::string &path, const nwm::Settings &defaults) {
+    nwm::Settings s = defaults;
+    std::ifstream in(path);
+    if (!in) return s;
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        line = trim(strip_comment(line));
+
+        size_t space = line.find_first_of(" \t");
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? std::string() : trim(line.substr(space));
+        std::string error;
+        int n;
+
+        if (key == "border_width" || key == "gap_size" || key == "scroll_windows_visible" ||
+            key == "resize_step" || key == "scroll_step") {
+            if (!parse_int(value, n) || n < 0) {
+                error = key + " expects a non-negative number";
+            } else if (key == "border_width") {
+                s.border_width = n;
+            } else if (key == "gap_size") {
+                s.gap_size = n;
+            } else if (key == "scroll_windows_visible") {
+                if (n < 1) error = key + " must be at least 1";
+                else s.scroll_windows_visible = n;
+            } else if (key == "resize_step") {
+                s.resize_step = n;
+            } else {
+                s.scroll_step = n;
+            }
+        } else if (key == "border_color" || key == "focus_color") {
+            unsigned long color;
+            if (!parse_color(value, color)) {
+                error = key + " expects a colour like #005577";
+            } else if (key == "border_color") {
+                s.border_color = color;
+            } else {
+                s.focus_color = color;
+            }
+        } else if (key == "bar_position") {
+            if (value == "top" || value == "0") s.bar_position = 0;
+            else if (value == "bottom" || value == "1") s.bar_position = 1;
+            else error = "bar_position expects top or bottom";
+        } else if (key == "modkey") {
+            unsigned int mod;
+            if (!parse_modifier(value, s.modkey, mod) || value == "Mod") {
+                error = "modkey expects Mod1-Mod5, Alt, Super, Shift or Control";
+            } else {
+                s.modkey = mod;
+            }
+        } else if (key == "font") {
+            if (value.empty()) error = "font expects a fontconfig pattern";
+            else s.font = value;
+        } else if (key == "workspaces") {
+            std::vector<std::string> labels = split_words(value);
+            if (labels.empty()) error = "workspaces expects at least one label";
+            else s.workspace_labels = labels;
+        } else if (key == "bind" || key == "unbind") {
+            nwm::SettingsBinding b;
+            if (parse_binding(value, key == "unbind", b, error)) {
+                s.bindings.push_back(b);
+            }
+        } else {
+            error = "unknown setting '" + key + "'";
+        }
+
+        if (!error.empty()) {
+            fprintf(stderr, "nwm: %s:%d: %s\n", path.c_str(), line_no, error.c_str());
+        }
+    }
+
+    // "Mod" means the modkey the whole file settles on, wherever the
+    // modkey line sits relative to the binds.
+    for (nwm::SettingsBinding &b : s.bindings) {
+        if (b.uses_modkey) b.mod |= s.modkey;
+    }
+    return s;
+}
+
+static std::string config_path() {
+    const char *env = getenv(SETTINGS_PATH_ENV);
+    if (env && *env) return env;
+
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    if (xdg && *xdg) return std::string(xdg) + "/nwm/config";
+
+    const char *home = getenv("HOME");
+    return std::string(home ? home : "") + "/.config/nwm/config";
+}
+
+static std::string parent_dir(const std::string &path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) return ".";
+    if (slash == 0) return "/";
+    return path.substr(0, slash);
+}
+
+// Editors usually write a new file and rename it over the old one, so the
+// directory is watched rather than the file. Until that directory exists,
+// as on a first run, the nearest existing ancestor is watched instead and
+// the watch moves down as the missing directories are created.
+static void watch_config_dir(nwm::SettingsWatch &watch) {
+    if (watch.watch >= 0) {
+        inotify_rm_watch(watch.fd, watch.watch);
+        watch.watch = -1;
+    }
+
+    std::string dir = parent_dir(watch.path);
+    for (;;) {
+        watch.watch = inotify_add_watch(watch.fd, dir.c_str(),
+                                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                        IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (watch.watch >= 0) {
+            watch.dir = dir;
+            return;
+        }
+        if (errno != ENOENT || dir == "/" || dir == ".") break;
+        dir = parent_dir(dir);
+    }
+
+    fprintf(stderr, "nwm: cannot watch %s: %s; use reload_config after editing %s\n",
+            dir.c_str(), strerror(errno), watch.path.c_str());
+    watch.dir.clear();
+}
+
+// The modkey counts as part of the bindings: keys[] and the mouse grabs
+// are built from it.
+static bool same_bindings(const nwm::Settings &a, const nwm::Settings &b) {
+    if (a.modkey != b.modkey || a.bindings.size() != b.bindings.size()) return false;
+    for (size_t i = 0; i < a.bindings.size(); ++i) {
+        const nwm::SettingsBinding &x = a.bindings[i];
+        const nwm::SettingsBinding &y = b.bindings[i];
+        if (x.mod != y.mod || x.keysym != y.keysym || x.action != y.action || x.arg != y.arg) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void nwm::settings_store(Base &base) {
+    const Settings &s = base.settings;
+    base.border_width = s.border_width;
+    base.border_color = s.border_color;
+    base.focus_color = s.focus_color;
+    base.gaps = base.gaps_enabled ? s.gap_size : 0;
+    base.bar_position = s.bar_position;
+    base.resize_step = s.resize_step;
+    base.scroll_step = s.scroll_step;
+    base.widget = s.workspace_labels;
+}
+
+void nwm::settings_init(Base &base) {
+    SettingsWatch &watch = base.settings_watch;
+    watch.path = config_path();
+    watch.fd = -1;
+    watch.watch = -1;
+
+    base.settings = parse_file(watch.path, base.default_settings);
+    bind_args(base.settings);
+    settings_store(base);
+
+    watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch.fd < 0) {
+        perror("inotify_init1");
+        return;
+    }
+
+    watch_config_dir(watch);
+}
+
+void nwm::settings_cleanup(Base &base) {
+    SettingsWatch &watch = base.settings_watch;
+    if (watch.fd >= 0) {
+        close(watch.fd);
+        watch.fd = -1;
+    }
+}
+
+bool nwm::settings_owns(const Base &base, int fd) {
+    return fd >= 0 && fd == base.settings_watch.fd;
+}
+
+void nwm::settings_handle(Base &base) {
+    SettingsWatch &watch = base.settings_watch;
+    std::string name = watch.path.substr(watch.path.rfind('/') + 1);
+    bool on_config_dir = watch.dir == parent_dir(watch.path);
+    bool changed = false;
+    bool rewatch = false;
+
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(watch.fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            if (ev->wd != watch.watch) {
+                // Left over from a watch already replaced.
+            } else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                rewatch = true;
+            } else if (!on_config_dir) {
+                // Something appeared in an ancestor; it may be the next
+                // directory down towards the config file.
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) rewatch = true;
+            } else if (ev->len && name == ev->name) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    if (rewatch) {
+        watch_config_dir(watch);
+        // The file may have been written before the watch reached its
+        // directory, or gone with the directory.
+        changed = true;
+    }
+
+    if (changed) {
+        settings_reload(base);
+    }
+}
+
+void nwm::settings_reload(Base &base) {
+    SettingsWatch &watch = base.settings_watch;
+    if (watch.fd >= 0 && watch.dir != parent_dir(watch.path)) {
+        watch_config_dir(watch);
+    }
+
+    Settings next = parse_file(base.settings_watch.path, base.default_settings);
+    Settings &cur = base.settings;
+
+    bool relayout = next.border_width != cur.border_width ||
+                    next.gap_size != cur.gap_size ||
+                    next.bar_position != cur.bar_position ||
+                    next.scroll_windows_visible != cur.scroll_windows_visible;
+    bool recolor = next.border_color != cur.border_color ||
+                   next.focus_color != cur.focus_color;
+    bool rebind = !same_bindings(next, cur);
+    bool refont = next.font != cur.font;
+
+    // Monitors still at the old default follow the new one; those changed
+    // with set_scroll_visible keep their value.
+    for (Monitor &mon : base.monitors) {
+        if (mon.scroll_windows_visible == cur.scroll_windows_visible) {
+            mon.scroll_windows_visible = next.scroll_windows_visible;
+        }
+    }
+
+    // The key table points at each binding's resolved argument. Unchanged
+    // bindings keep the running vector so those pointers stay valid; changed
+    // ones are resolved afresh and the table is rebuilt from them below.
+    if (!rebind) {
+        next.bindings.swap(cur.bindings);
+    }
+    cur = std::move(next);
+    if (rebind) {
+        bind_args(cur);
+    }
+    settings_store(base);
+
+    if (rebind) {
+        setup_keys(base);
+    }
+
+    if (recolor) {
+        for (auto &slot : base.client_store.slots) {
+            if (!slot.live) continue;
+            const ManagedWindow &w = slot.client;
+            base.backend->set_border(base, w.window, w.is_focused ? base.focus_color : base.border_color);
+        }
+    }
+
+    if (refont) {
+        bar_link_set_font(base, cur.font);
+    }
+
+    if (relayout) {
+        tile_windows(base);
+    }
+
+    bar_link_publish(base);
+    flush(base);
+}
@@ -0,0 +1,75 @@
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <X11/Xlib.h>
+#include <string>
+#include <vector>
+
+// Overrides the config file location; otherwise $XDG_CONFIG_HOME/nwm/config
+// or ~/.config/nwm/config.
+#define SETTINGS_PATH_ENV "NWM_CONFIG"
+
+namespace nwm {
+
+struct Base;
+
+// A `bind` or `unbind` line. Bindings from the file take precedence over
+// keys[] in config.hpp; an unbound key is not grabbed at all.
+struct SettingsBinding {
+    unsigned int mod;
+    bool uses_modkey;   // written as "Mod"; the file's final modkey is in mod
+    KeySym keysym;
+    std::string action;
+    std::string arg;
+
+    // Resolved by settings_bind_args once the binding has its final address.
+    void (*func)(void*, Base&);
+    int int_arg;
+    std::vector<std::string> argv;
+    std::vector<const char*> argv_ptrs;
+    const void *arg_ptr;
+};
+
+// Everything config.hpp sets with a #define, overridable at runtime from the
+// config file. The file is always parsed on top of the compiled defaults, so
+// deleting a line reverts that setting.
+struct Settings {
+    int border_width;
+    unsigned long border_color;
+    unsigned long focus_color;
+    int gap_size;
+    int bar_position;
+    int scroll_windows_visible;
+    int resize_step;
+    int scroll_step;
+    unsigned int modkey;
+    std::string font;
+    std::vector<std::string> workspace_labels;
+    std::vector<SettingsBinding> bindings;
+};
+
+struct SettingsWatch {
+    std::string path;
+    std::string dir;    // watched directory: the file's, or its nearest existing ancestor
+    int fd;
+    int watch;
+};
+
+// Loads the config file into base before the first layout, and starts
+// watching its directory so edits are picked up without a restart.
+void settings_init(Base &base);
+// Copies base.settings into the Base fields the rest of the WM reads.
+void settings_store(Base &base);
+void settings_cleanup(Base &base);
+bool settings_owns(const Base &base, int fd);
+// Drains inotify events and reloads if the config file was written,
+// replaced or removed.
+void settings_handle(Base &base);
+// Re-reads the config file and applies only what changed: key grabs when
+// bindings differ, border colours, layout when geometry settings differ and
+// the bar when its font or labels differ.
+void settings_reload(Base &base);
+
+}
+
+#endif // SETTINGS_HPP
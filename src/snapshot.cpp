@@ -0,0 +1,322 @@
+#include "snapshot.hpp"
+#include "nwm.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+template <typename T>
+static void append(std::string &out, const T &value) {
+    out.append((const char*)&value, sizeof(value));
+}
+
+struct SnapshotReader {
+    const std::string &data;
+    size_t pos;
+};
+
+template <typename T>
+static bool take(SnapshotReader &in, T &value) {
+    if (in.data.size() - in.pos < sizeof(value)) return false;
+    memcpy(&value, in.data.data() + in.pos, sizeof(value));
+    in.pos += sizeof(value);
+    return true;
+}
+
+static bool write_all(int fd, const std::string &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, std::string &out) {
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+        out.append(buf, n);
+    }
+}
+
+static void save_client(std::string &out, const nwm::ManagedWindow &w) {
+    nwm::SnapshotClient c;
+    memset(&c, 0, sizeof(c));
+    c.window = w.window;
+    c.x = w.x;
+    c.y = w.y;
+    c.width = w.width;
+    c.height = w.height;
+    c.monitor = w.monitor;
+    c.pre_fs_x = w.pre_fs_x;
+    c.pre_fs_y = w.pre_fs_y;
+    c.pre_fs_width = w.pre_fs_width;
+    c.pre_fs_height = w.pre_fs_height;
+    c.committed_x = w.committed.x;
+    c.committed_y = w.committed.y;
+    c.committed_width = w.committed.width;
+    c.committed_height = w.committed.height;
+    c.committed_border_width = w.committed.border_width;
+    c.is_floating = w.is_floating;
+    c.is_fullscreen = w.is_fullscreen;
+    c.pre_fs_floating = w.pre_fs_floating;
+    append(out, c);
+}
+
+bool nwm::snapshot_save(Base &base) {
+    std::string out;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.root = base.root;
+    header.monitor_count = base.monitors.size();
+    header.workspace_count = base.workspaces.size();
+    header.current_workspace = base.current_workspace;
+    header.current_monitor = base.current_monitor;
+    header.master_factor = base.master_factor;
+    header.horizontal_mode = base.horizontal_mode;
+    header.gaps_enabled = base.gaps_enabled;
+    header.bar_visible = base.bar_visible;
+    append(out, header);
+
+    for (const Monitor &mon : base.monitors) {
+        SnapshotMonitor m;
+        memset(&m, 0, sizeof(m));
+        m.crtc = mon.crtc;
+        m.x = mon.x;
+        m.y = mon.y;
+        m.width = mon.width;
+        m.height = mon.height;
+        m.current_workspace = mon.current_workspace;
+        m.master_factor = mon.master_factor;
+        m.scroll_windows_visible = mon.scroll_windows_visible;
+        m.horizontal_mode = mon.horizontal_mode;
+        append(out, m);
+    }
+
+    for (const Workspace &ws : base.workspaces) {
+        SnapshotWorkspace s;
+        memset(&s, 0, sizeof(s));
+        s.client_count = ws.clients.size();
+        s.focused = ws.focused_window ? ws.focused_window->window : None;
+        s.scroll_offset = ws.scroll_offset;
+        s.scroll_maximized = ws.scroll_maximized;
+        append(out, s);
+
+        for (ClientHandle h : ws.clients) {
+            save_client(out, *client_get(base, h));
+        }
+    }
+
+    // Deliberately not close-on-exec: the restarted binary inherits it.
+    int fd = memfd_create("nwm-snapshot", 0);
+    if (fd < 0) {
+        perror("memfd_create");
+        return false;
+    }
+    if (!write_all(fd, out) || lseek(fd, 0, SEEK_SET) < 0) {
+        perror("snapshot");
+        close(fd);
+        return false;
+    }
+
+    setenv(SNAPSHOT_FD_ENV, std::to_string(fd).c_str(), 1);
+    return true;
+}
+
+struct SavedWorkspace {
+    nwm::SnapshotWorkspace workspace;
+    std::vector<nwm::SnapshotClient> clients;
+};
+
+// Takes the snapshot out of the environment so it is read only once and is
+// not inherited by anything this instance spawns.
+static bool load_snapshot(std::string &data) {
+    const char *env = getenv(SNAPSHOT_FD_ENV);
+    if (!env) return false;
+    int fd = atoi(env);
+    unsetenv(SNAPSHOT_FD_ENV);
+    if (fd < 0) return false;
+
+    bool ok = read_all(fd, data);
+    close(fd);
+    return ok;
+}
+
+// The live monitor on the same CRTC, or with the same geometry when XRandR
+// is not in use; -1 if the saved monitor is gone.
+static int match_monitor(const nwm::Base &base, const nwm::SnapshotMonitor &m) {
+    for (const nwm::Monitor &mon : base.monitors) {
+        if (m.crtc ? mon.crtc == m.crtc
+                   : (mon.x == m.x && mon.y == m.y &&
+                      mon.width == m.width && mon.height == m.height)) {
+            return mon.id;
+        }
+    }
+    return -1;
+}
+
+static void restore_client(nwm::Base &base, const nwm::SnapshotClient &c, int workspace,
+                           const std::vector<int> &monitor_map) {
+    nwm::ManagedWindow w;
+    w.window = c.window;
+    w.x = c.x;
+    w.y = c.y;
+    w.width = c.width;
+    w.height = c.height;
+    w.is_floating = c.is_floating;
+    w.is_focused = false;
+    w.is_fullscreen = c.is_fullscreen;
+    w.workspace = workspace;
+    w.pre_fs_x = c.pre_fs_x;
+    w.pre_fs_y = c.pre_fs_y;
+    w.pre_fs_width = c.pre_fs_width;
+    w.pre_fs_height = c.pre_fs_height;
+    w.pre_fs_floating = c.pre_fs_floating;
+    w.committed.x = c.committed_x;
+    w.committed.y = c.committed_y;
+    w.committed.width = c.committed_width;
+    w.committed.height = c.committed_height;
+    w.committed.border_width = c.committed_border_width;
+    w.ignore_unmaps = 0;
+
+    int monitor = c.monitor >= 0 && c.monitor < (int)monitor_map.size() ? monitor_map[c.monitor] : -1;
+    if (monitor < 0) {
+        nwm::Monitor *mon = nwm::get_monitor_at_point(base, w.x + w.width / 2, w.y + w.height / 2);
+        monitor = mon ? mon->id : 0;
+    }
+    w.monitor = monitor;
+
+    nwm::ClientHandle handle = nwm::client_create(base, w);
+    if (handle == NO_CLIENT) return;
+    base.workspaces[workspace].clients.push_back(handle);
+    nwm::ewmh_client_added(base, w.window, workspace);
+    base.backend->select_input(base, w.window, CLIENT_EVENT_MASK);
+}
+
+bool nwm::snapshot_restore(Base &base) {
+    std::string data;
+    if (!load_snapshot(data)) return false;
+
+    // Everything is parsed before any of it is applied, so a damaged
+    // snapshot falls back to plain adoption with nothing half-restored.
+    SnapshotReader in{data, 0};
+    SnapshotHeader header;
+    std::vector<SnapshotMonitor> monitors;
+    std::vector<SavedWorkspace> workspaces;
+
+    bool ok = take(in, header) &&
+              memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == SNAPSHOT_VERSION &&
+              header.root == base.root &&
+              header.workspace_count == base.workspaces.size() &&
+              header.monitor_count <= data.size() / sizeof(SnapshotMonitor);
+    if (ok) {
+        monitors.resize(header.monitor_count);
+        for (SnapshotMonitor &m : monitors) {
+            ok = ok && take(in, m);
+        }
+        workspaces.resize(header.workspace_count);
+        for (SavedWorkspace &ws : workspaces) {
+            ok = ok && take(in, ws.workspace);
+            if (!ok || ws.workspace.client_count > data.size() / sizeof(SnapshotClient)) {
+                ok = false;
+                break;
+            }
+            ws.clients.resize(ws.workspace.client_count);
+            for (SnapshotClient &c : ws.clients) {
+                ok = ok && take(in, c);
+            }
+        }
+    }
+    if (!ok) {
+        std::cerr << "Warning: ignoring unreadable restart snapshot\n";
+        return false;
+    }
+
+    std::vector<int> monitor_map(monitors.size());
+    for (size_t i = 0; i < monitors.size(); ++i) {
+        const SnapshotMonitor &m = monitors[i];
+        monitor_map[i] = match_monitor(base, m);
+        if (monitor_map[i] < 0) continue;
+
+        Monitor &mon = base.monitors[monitor_map[i]];
+        if (m.current_workspace >= 0 && m.current_workspace < NUM_WORKSPACES) {
+            mon.current_workspace = m.current_workspace;
+        }
+        mon.master_factor = m.master_factor;
+        mon.horizontal_mode = m.horizontal_mode;
+        if (m.scroll_windows_visible > 0) {
+            mon.scroll_windows_visible = m.scroll_windows_visible;
+        }
+    }
+
+    if (header.current_workspace >= 0 && header.current_workspace < NUM_WORKSPACES) {
+        base.current_workspace = header.current_workspace;
+    }
+    if (header.current_monitor >= 0 && header.current_monitor < (int)monitor_map.size() &&
+        monitor_map[header.current_monitor] >= 0) {
+        base.current_monitor = monitor_map[header.current_monitor];
+    }
+    base.master_factor = header.master_factor;
+    base.horizontal_mode = header.horizontal_mode;
+    Monitor *current = get_current_monitor(base);
+    if (current) {
+        base.current_workspace = current->current_workspace;
+        base.horizontal_mode = current->horizontal_mode;
+    }
+    base.gaps_enabled = header.gaps_enabled;
+    base.gaps = base.gaps_enabled ? base.settings.gap_size : 0;
+    base.bar_visible = header.bar_visible;
+
+    // The only round trip: which saved windows still exist. Their
+    // attributes, geometry and mapping are already known.
+    std::vector<Window> unknown;
+    base.backend->query_tree(base, unknown);
+    std::unordered_set<Window> present(unknown.begin(), unknown.end());
+
+    for (size_t i = 0; i < workspaces.size(); ++i) {
+        Workspace &ws = base.workspaces[i];
+        ws.scroll_offset = workspaces[i].workspace.scroll_offset;
+        ws.scroll_maximized = workspaces[i].workspace.scroll_maximized;
+
+        for (const SnapshotClient &c : workspaces[i].clients) {
+            if (present.count(c.window) && !base.window_index.count(c.window)) {
+                restore_client(base, c, i, monitor_map);
+            }
+        }
+
+        ws.focused_window = find_window(base, workspaces[i].workspace.focused);
+    }
+
+    // Windows that appeared during the restart, overlays and the bar are
+    // classified as on a fresh start.
+    unknown.erase(std::remove_if(unknown.begin(), unknown.end(),
+                                 [&](Window w) { return base.window_index.count(w) != 0; }),
+                  unknown.end());
+    if (!unknown.empty()) {
+        adopt_windows(base, unknown);
+    }
+
+    focus_window(get_current_workspace(base).focused_window, base);
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdint>
+
+// A snapshot is a SnapshotHeader, its SnapshotMonitors, then for each
+// workspace a SnapshotWorkspace followed by its SnapshotClients in layout
+// order. It is written to a memfd just before a restart execs the new
+// binary; the fd number is passed in SNAPSHOT_FD_ENV.
+#define SNAPSHOT_MAGIC "NWMSNAPS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_FD_ENV "NWM_SNAPSHOT_FD"
+
+namespace nwm {
+
+struct Base;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t root;
+    uint32_t monitor_count;
+    uint32_t workspace_count;
+    int32_t current_workspace;
+    int32_t current_monitor;
+    float master_factor;
+    uint8_t horizontal_mode;
+    uint8_t gaps_enabled;
+    uint8_t bar_visible;
+    uint8_t pad;
+};
+
+struct SnapshotMonitor {
+    uint32_t crtc;
+    int32_t x, y;
+    int32_t width, height;
+    int32_t current_workspace;
+    float master_factor;
+    int32_t scroll_windows_visible;
+    uint8_t horizontal_mode;
+    uint8_t pad[3];
+};
+
+struct SnapshotWorkspace {
+    uint32_t client_count;
+    uint32_t focused;
+    int32_t scroll_offset;
+    uint8_t scroll_maximized;
+    uint8_t pad[3];
+};
+
+struct SnapshotClient {
+    uint32_t window;
+    int32_t x, y;
+    int32_t width, height;
+    int32_t monitor;
+    int32_t pre_fs_x, pre_fs_y;
+    int32_t pre_fs_width, pre_fs_height;
+    // What the server was last told, so the first layout pass after the
+    // restart sends nothing for windows that stay put.
+    int32_t committed_x, committed_y;
+    int32_t committed_width, committed_height;
+    int32_t committed_border_width;
+    uint8_t is_floating;
+    uint8_t is_fullscreen;
+    uint8_t pre_fs_floating;
+    uint8_t pad;
+};
+
+// Writes the layout, workspace and focus state to an inheritable memfd and
+// exports its number in the environment. Returns false if it could not, in
+// which case the next instance adopts windows from scratch.
+bool snapshot_save(Base &base);
+// Rebuilds the state saved by the previous instance, if there is one, from
+// a single XQueryTree: saved windows still on the display are managed as
+// they were without querying them, anything else goes through
+// adopt_windows. Returns false if there was no usable snapshot.
+bool snapshot_restore(Base &base);
+
+}
+
+#endif // SNAPSHOT_HPP
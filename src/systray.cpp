@@ -1,6 +1,6 @@
 #include "systray.hpp"
-#include "nwm.hpp"
 #include "bar.hpp"
+#include "atoms.hpp"
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <iostream>
@@ -16,7 +16,7 @@ void nwm::systray_send_message(Display *display, Window window, long message,
     memset(&ev, 0, sizeof(ev));
     ev.xclient.type = ClientMessage;
     ev.xclient.window = window;
-    ev.xclient.message_type = XInternAtom(display, "_XEMBED", False);
+    ev.xclient.message_type = atom(XEMBED);
     ev.xclient.format = 32;
     ev.xclient.data.l[0] = CurrentTime;
     ev.xclient.data.l[1] = message;
@@ -27,16 +27,22 @@ void nwm::systray_send_message(Display *display, Window window, long message,
     XSync(display, False);
 }
 
-void nwm::systray_init(Base &base) {
+void nwm::systray_init(BarBase &base) {
+    base.systray.window = None;
     base.systray.icon_size = TRAY_ICON_SIZE;
     base.systray.padding = TRAY_PADDING;
 
     char tray_atom_name[32];
     snprintf(tray_atom_name, sizeof(tray_atom_name), "_NET_SYSTEM_TRAY_S%d", base.screen);
     base.systray.selection_atom = XInternAtom(base.display, tray_atom_name, False);
-    base.systray.opcode_atom = XInternAtom(base.display, "_NET_SYSTEM_TRAY_OPCODE", False);
-    base.systray.xembed_atom = XInternAtom(base.display, "_XEMBED", False);
-    base.systray.xembed_info_atom = XInternAtom(base.display, "_XEMBED_INFO", False);
+    base.systray.opcode_atom = atom(NET_SYSTEM_TRAY_OPCODE);
+    base.systray.xembed_atom = atom(XEMBED);
+    base.systray.xembed_info_atom = atom(XEMBED_INFO);
+
+    // There is one tray selection per screen; the first monitor's bar holds it.
+    if (base.monitor != 0) {
+        return;
+    }
 
     Window existing_tray = XGetSelectionOwner(base.display, base.systray.selection_atom);
     if (existing_tray != None) {
@@ -72,7 +78,7 @@ void nwm::systray_init(Base &base) {
     XEvent ev;
     memset(&ev, 0, sizeof(ev));
     ev.xclient.type = ClientMessage;
-    ev.xclient.message_type = XInternAtom(base.display, "MANAGER", False);
+    ev.xclient.message_type = atom(MANAGER);
     ev.xclient.display = base.display;
     ev.xclient.window = base.root;
     ev.xclient.format = 32;
@@ -84,13 +90,13 @@ void nwm::systray_init(Base &base) {
 
     XSendEvent(base.display, base.root, False, StructureNotifyMask, &ev);
 
-    Atom orientation_atom = XInternAtom(base.display, "_NET_SYSTEM_TRAY_ORIENTATION", False);
+    Atom orientation_atom = atom(NET_SYSTEM_TRAY_ORIENTATION);
     long orientation = 0;
     XChangeProperty(base.display, base.systray.window, orientation_atom,
                    XA_CARDINAL, 32, PropModeReplace,
                    (unsigned char *)&orientation, 1);
 
-    Atom visual_atom = XInternAtom(base.display, "_NET_SYSTEM_TRAY_VISUAL", False);
+    Atom visual_atom = atom(NET_SYSTEM_TRAY_VISUAL);
     XVisualInfo template_info;
     template_info.screen = base.screen;
     template_info.depth = 32;
@@ -112,7 +118,7 @@ void nwm::systray_init(Base &base) {
     XSync(base.display, False);
 }
 
-void nwm::systray_cleanup(Base &base) {
+void nwm::systray_cleanup(BarBase &base) {
     for (auto &icon : base.systray.icons) {
         XUnmapWindow(base.display, icon.window);
         XReparentWindow(base.display, icon.window, base.root, 0, 0);
@@ -126,7 +132,7 @@ void nwm::systray_cleanup(Base &base) {
     }
 }
 
-int nwm::systray_get_width(Base &base) {
+int nwm::systray_get_width(BarBase &base) {
     if (base.systray.icons.empty()) return 0;
 
     int width = 0;
@@ -138,7 +144,7 @@ int nwm::systray_get_width(Base &base) {
     return width + base.systray.padding;
 }
 
-void nwm::systray_update(Base &base) {
+void nwm::systray_update(BarBase &base) {
     int x_offset = 0;
     int tray_y = (base.bar.height - base.systray.icon_size) / 2;
 
@@ -158,14 +164,11 @@ void nwm::systray_update(Base &base) {
     }
 
     int total_width = x_offset + base.systray.padding;
-    if (total_width > 0) {
-        int bar_width = WIDTH(base.display, base.screen);
-        int tray_x = bar_width - total_width - 12;
-
-        int tray_window_y = base.bar_position == 0 ? 0 : HEIGHT(base.display, base.screen) - base.bar.height;
+    if (total_width > 0 && base.systray.window) {
+        int tray_x = base.bar.x + base.bar.width - total_width - 12;
 
         XMoveResizeWindow(base.display, base.systray.window,
-                         tray_x, tray_window_y,
+                         tray_x, base.bar.y,
                          total_width, base.bar.height);
 
         XSetWindowBackground(base.display, base.systray.window, 0x1A1A1A);
@@ -176,7 +179,7 @@ void nwm::systray_update(Base &base) {
     bar_draw(base);
 }
 
-void nwm::systray_add_icon(Base &base, Window icon) {
+void nwm::systray_add_icon(BarBase &base, Window icon) {
     for (const auto &existing : base.systray.icons) {
         if (existing.window == icon) {
             return;
@@ -213,7 +216,7 @@ void nwm::systray_add_icon(Base &base, Window icon) {
     systray_update(base);
 }
 
-void nwm::systray_remove_icon(Base &base, Window icon) {
+void nwm::systray_remove_icon(BarBase &base, Window icon) {
     auto it = std::find_if(base.systray.icons.begin(), base.systray.icons.end(),
                           [icon](const TrayIcon &ti) { return ti.window == icon; });
 
@@ -228,7 +231,7 @@ void nwm::systray_remove_icon(Base &base, Window icon) {
     }
 }
 
-void nwm::systray_handle_client_message(Base &base, XClientMessageEvent *e) {
+void nwm::systray_handle_client_message(BarBase &base, XClientMessageEvent *e) {
     if (e->message_type == base.systray.opcode_atom) {
         if (e->data.l[1] == SYSTEM_TRAY_REQUEST_DOCK) {
             Window icon = e->data.l[2];
@@ -239,11 +242,11 @@ void nwm::systray_handle_client_message(Base &base, XClientMessageEvent *e) {
     }
 }
 
-void nwm::systray_handle_destroy(Base &base, Window window) {
+void nwm::systray_handle_destroy(BarBase &base, Window window) {
     systray_remove_icon(base, window);
 }
 
-void nwm::systray_handle_configure_request(Base &base, XConfigureRequestEvent *e) {
+void nwm::systray_handle_configure_request(BarBase &base, XConfigureRequestEvent *e) {
     for (const auto &icon : base.systray.icons) {
         if (icon.window == e->window) {
             XWindowChanges wc;
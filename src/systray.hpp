@@ -6,7 +6,7 @@
 
 namespace nwm {
 
-struct Base;
+struct BarBase;
 
 #define XEMBED_EMBEDDED_NOTIFY 0
 #define XEMBED_WINDOW_ACTIVATE 1
@@ -48,17 +48,17 @@ struct SystemTray {
     int padding;
 };
 
-void systray_init(Base &base);
-void systray_cleanup(Base &base);
-void systray_update(Base &base);
-void systray_add_icon(Base &base, Window icon);
-void systray_remove_icon(Base &base, Window icon);
-void systray_handle_client_message(Base &base, XClientMessageEvent *e);
-void systray_handle_destroy(Base &base, Window window);
-void systray_handle_configure_request(Base &base, XConfigureRequestEvent *e);
+void systray_init(BarBase &base);
+void systray_cleanup(BarBase &base);
+void systray_update(BarBase &base);
+void systray_add_icon(BarBase &base, Window icon);
+void systray_remove_icon(BarBase &base, Window icon);
+void systray_handle_client_message(BarBase &base, XClientMessageEvent *e);
+void systray_handle_destroy(BarBase &base, Window window);
+void systray_handle_configure_request(BarBase &base, XConfigureRequestEvent *e);
 void systray_send_message(Display *display, Window window, long message,
                          long data1, long data2, long data3);
-int systray_get_width(Base &base);
+int systray_get_width(BarBase &base);
 
 }
 
@@ -0,0 +1,128 @@
+#include "text.hpp"
+
+// The clock string changes every minute, so the cache is bounded and simply
+// flushed when it fills up.
+#define TEXT_CACHE_MAX 64
+
+static void text_cache_reset(nwm::TextCache &cache, Display *display, XftFont *font) {
+    cache.font = font;
+    cache.runs.clear();
+    cache.digit_width = 0;
+
+    for (int c = 0; c < 128; ++c) {
+        cache.ascii_glyph[c] = XftCharIndex(display, font, c);
+
+        XGlyphInfo extents;
+        XftGlyphExtents(display, font, &cache.ascii_glyph[c], 1, &extents);
+        cache.ascii_advance[c] = extents.xOff;
+
+        if (c >= '0' && c <= '9' && extents.xOff > cache.digit_width) {
+            cache.digit_width = extents.xOff;
+        }
+    }
+}
+
+static void ensure_font(nwm::TextCache &cache, Display *display, XftFont *font) {
+    if (cache.font != font) {
+        text_cache_reset(cache, display, font);
+    }
+}
+
+void nwm::text_cache_trim(TextCache &cache) {
+    if (cache.runs.size() >= TEXT_CACHE_MAX) {
+        cache.runs.clear();
+    }
+}
+
+const nwm::TextRun& nwm::text_run(TextCache &cache, Display *display, XftFont *font,
+                                  const std::string &text) {
+    ensure_font(cache, display, font);
+
+    auto it = cache.runs.find(text);
+    if (it != cache.runs.end()) {
+        return it->second;
+    }
+
+    TextRun run;
+    XGlyphInfo extents;
+    XftTextExtentsUtf8(display, font, (const FcChar8*)text.c_str(), text.length(), &extents);
+    run.width = extents.width;
+
+    const FcChar8 *p = (const FcChar8*)text.c_str();
+    int remaining = text.length();
+    int pen = 0;
+    while (remaining > 0) {
+        FcChar32 ucs4;
+        int len = FcUtf8ToUcs4(p, &ucs4, remaining);
+        if (len <= 0) break;
+        p += len;
+        remaining -= len;
+
+        XftGlyphFontSpec spec;
+        spec.font = font;
+        spec.x = pen;
+        spec.y = 0;
+        if (ucs4 < 128) {
+            spec.glyph = cache.ascii_glyph[ucs4];
+            pen += cache.ascii_advance[ucs4];
+        } else {
+            spec.glyph = XftCharIndex(display, font, ucs4);
+            XGlyphInfo glyph_extents;
+            XftGlyphExtents(display, font, &spec.glyph, 1, &glyph_extents);
+            pen += glyph_extents.xOff;
+        }
+        run.glyphs.push_back(spec);
+    }
+
+    return cache.runs.emplace(text, std::move(run)).first->second;
+}
+
+void nwm::text_draw(TextCache &cache, XftDraw *draw, XftColor *color, const TextRun &run,
+                    int x, int y) {
+    text_draw_glyphs(cache, draw, color, run.glyphs, x, y);
+}
+
+int nwm::text_cells(TextCache &cache, Display *display, XftFont *font, const std::string &text,
+                    std::vector<XftGlyphFontSpec> &glyphs, std::vector<int> &bounds) {
+    ensure_font(cache, display, font);
+
+    glyphs.clear();
+    bounds.clear();
+
+    int pen = 0;
+    for (unsigned char c : text) {
+        bounds.push_back(pen);
+        if (c >= 128) c = '?';
+
+        int advance = cache.ascii_advance[c];
+        int cell = advance;
+        if (c >= '0' && c <= '9') {
+            cell = cache.digit_width;
+        }
+
+        XftGlyphFontSpec spec;
+        spec.font = font;
+        spec.glyph = cache.ascii_glyph[c];
+        spec.x = pen + (cell - advance) / 2;
+        spec.y = 0;
+        glyphs.push_back(spec);
+
+        pen += cell;
+    }
+    bounds.push_back(pen);
+
+    return pen;
+}
+
+void nwm::text_draw_glyphs(TextCache &cache, XftDraw *draw, XftColor *color,
+                           const std::vector<XftGlyphFontSpec> &glyphs, int x, int y) {
+    if (glyphs.empty()) return;
+
+    cache.scratch.assign(glyphs.begin(), glyphs.end());
+    for (XftGlyphFontSpec &spec : cache.scratch) {
+        spec.x += x;
+        spec.y += y;
+    }
+
+    XftDrawGlyphFontSpec(draw, color, cache.scratch.data(), cache.scratch.size());
+}
@@ -0,0 +1,48 @@
+#ifndef TEXT_HPP
+#define TEXT_HPP
+
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace nwm {
+
+// A string measured and shaped once. Glyph positions are relative to the
+// baseline origin, so the run can be drawn anywhere.
+struct TextRun {
+    int width;
+    std::vector<XftGlyphFontSpec> glyphs;
+};
+
+// Measured strings for one font, plus the glyph index and advance of every
+// ASCII character for cell layout.
+struct TextCache {
+    XftFont *font;
+    std::unordered_map<std::string, TextRun> runs;
+    FT_UInt ascii_glyph[128];
+    int ascii_advance[128];
+    int digit_width;
+    std::vector<XftGlyphFontSpec> scratch;
+};
+
+// Drops cached runs once the cache grows past its bound. Call it before a
+// frame so no run looked up during the frame is invalidated.
+void text_cache_trim(TextCache &cache);
+const TextRun& text_run(TextCache &cache, Display *display, XftFont *font,
+                        const std::string &text);
+void text_draw(TextCache &cache, XftDraw *draw, XftColor *color, const TextRun &run,
+               int x, int y);
+
+// Lays out ASCII text so every digit gets a cell of the same width. Numbers
+// that change value then keep their position. bounds receives
+// text.size() + 1 cell edges; returns the total width.
+int text_cells(TextCache &cache, Display *display, XftFont *font, const std::string &text,
+               std::vector<XftGlyphFontSpec> &glyphs, std::vector<int> &bounds);
+void text_draw_glyphs(TextCache &cache, XftDraw *draw, XftColor *color,
+                      const std::vector<XftGlyphFontSpec> &glyphs, int x, int y);
+
+}
+
+#endif // TEXT_HPP
@@ -1,257 +1,271 @@
 #include "tiling.hpp"
-#include "bar.hpp"
+#include "barlink.hpp"
 #include "config.hpp"
 #include <algorithm>
 #include <X11/Xlib.h>
 
-static void ensure_focused_floating_on_top(Display *display, nwm::Base &base) {
+static void ensure_focused_floating_on_top(nwm::Base &base) {
     if (base.focused_window &&
         (base.focused_window->is_floating || base.focused_window->is_fullscreen)) {
-        XRaiseWindow(display, base.focused_window->window);
+        base.backend->raise(base, base.focused_window->window);
     }
 }
 
-static void atomic_restack(Display *display, nwm::Base &base, std::vector<Window> &stack_order) {
-    (void)base;
-    if (stack_order.empty()) return;
-    XRestackWindows(display, stack_order.data(), stack_order.size());
+static void atomic_restack(nwm::Base &base, nwm::Monitor &mon, std::vector<Window> &stack_order) {
+    if (stack_order.empty() || stack_order == mon.committed_stack) return;
+    base.backend->restack(base, stack_order.data(), stack_order.size());
+    mon.committed_stack = stack_order;
 }
 
-static void raise_override_windows(Display *display, nwm::Base &base) {
-    Window root = DefaultRootWindow(display);
-    Window root_return, parent_return;
-    Window *children;
-    unsigned int nchildren;
-
-    if (!XQueryTree(display, root, &root_return, &parent_return, &children, &nchildren)) {
-        return;
-    }
+void nwm::commit_geometry(Base &base, ManagedWindow *window,
+                          int x, int y, int width, int height, int border_width) {
+    Geometry &c = window->committed;
+    XWindowChanges wc;
+    unsigned int mask = 0;
+
+    if (x != c.x) { wc.x = x; mask |= CWX; }
+    if (y != c.y) { wc.y = y; mask |= CWY; }
+    if (width != c.width) { wc.width = width; mask |= CWWidth; }
+    if (height != c.height) { wc.height = height; mask |= CWHeight; }
+    if (border_width != c.border_width) { wc.border_width = border_width; mask |= CWBorderWidth; }
+
+    if (!mask) return;
+
+    base.backend->configure(base, window->window, mask, &wc);
+    c.x = x;
+    c.y = y;
+    c.width = width;
+    c.height = height;
+    c.border_width = border_width;
+}
 
-    for (unsigned int i = 0; i < nchildren; ++i) {
-        XWindowAttributes attr;
-        if (XGetWindowAttributes(display, children[i], &attr)) {
-            if (attr.override_redirect && attr.map_state == IsViewable) {
-                if (children[i] != base.bar.window && children[i] != base.systray.window) {
-                    bool is_large = (attr.width > attr.screen->width / 4 && attr.height > attr.screen->height / 4);
-
-                    if (is_large) {
-                        XRaiseWindow(display, children[i]);
-                    }
-                }
-            }
+// Every tiled client of the workspace goes to the monitor showing it.
+static std::vector<nwm::ManagedWindow*> collect_tiled(nwm::Base &base, nwm::Workspace &ws, nwm::Monitor &mon) {
+    std::vector<nwm::ManagedWindow*> tiled_windows;
+    for (nwm::ClientHandle h : ws.clients) {
+        nwm::ManagedWindow *w = nwm::client_get(base, h);
+        if (!w->is_floating && !w->is_fullscreen) {
+            w->monitor = mon.id;
+            tiled_windows.push_back(w);
         }
     }
-
-    if (children) {
-        XFree(children);
-    }
+    return tiled_windows;
 }
 
-void nwm::tile_horizontal(Base &base) {
-    auto &current_ws = get_current_workspace(base);
+static bool contains_point(const nwm::Monitor &mon, int x, int y) {
+    return x >= mon.x && x < mon.x + mon.width && y >= mon.y && y < mon.y + mon.height;
+}
 
-    for (auto &mon : base.monitors) {
-        std::vector<ManagedWindow*> tiled_windows;
-        for (auto &w : current_ws.windows) {
-            if (!w.is_floating && !w.is_fullscreen && w.monitor == mon.id) {
-                tiled_windows.push_back(&w);
-            }
+// A workspace shown on another monitor than before takes its floating and
+// fullscreen windows along, keeping floating ones at the same offset.
+static void place_floating(nwm::Base &base, nwm::Workspace &ws, nwm::Monitor &mon) {
+    for (nwm::ClientHandle h : ws.clients) {
+        nwm::ManagedWindow *w = nwm::client_get(base, h);
+        if (w->is_fullscreen) {
+            w->monitor = mon.id;
+            nwm::commit_geometry(base, w, mon.x, mon.y, mon.width, mon.height, 0);
+            continue;
         }
+        if (!w->is_floating) continue;
 
-        if (tiled_windows.empty()) continue;
+        w->monitor = mon.id;
+        int cx = w->x + w->width / 2;
+        int cy = w->y + w->height / 2;
+        if (contains_point(mon, cx, cy)) continue;
 
-        int bar_height = base.bar_visible ? base.bar.height : 0;
-        int usable_height = mon.height - bar_height;
-        int y_start = mon.y + (base.bar_position == 0 ? bar_height : 0);
-
-        std::vector<Window> tiled_stack;
+        const nwm::Monitor *from = nullptr;
+        for (const nwm::Monitor &other : base.monitors) {
+            if (contains_point(other, cx, cy)) from = &other;
+        }
+        if (from) {
+            w->x += mon.x - from->x;
+            w->y += mon.y - from->y;
+        } else {
+            w->x = mon.x + (mon.width - w->width) / 2;
+            w->y = mon.y + (mon.height - w->height) / 2;
+        }
+        nwm::commit_geometry(base, w, w->x, w->y, w->width, w->height, w->committed.border_width);
+    }
+}
 
-        int scroll_visible = mon.scroll_windows_visible;
-        if (scroll_visible < 1) scroll_visible = 1;
+// Layout passes only compute target geometry into each window's x/y/width/height.
+static void layout_scroll(nwm::Base &base, nwm::Workspace &ws, nwm::Monitor &mon,
+                          std::vector<nwm::ManagedWindow*> &tiled_windows) {
+    int bar_height = base.bar_visible ? base.bar_height : 0;
+    int usable_height = mon.height - bar_height;
+    int y_start = mon.y + (base.bar_position == 0 ? bar_height : 0);
 
-        int window_width = current_ws.scroll_maximized ? mon.width : (mon.width / scroll_visible);
+    int scroll_visible = mon.scroll_windows_visible;
+    if (scroll_visible < 1) scroll_visible = 1;
 
-        int num_tiled = tiled_windows.size();
-        bool all_fit = (num_tiled <= scroll_visible);
-        if (all_fit && !current_ws.scroll_maximized) {
-            current_ws.scroll_offset = 0;
-            window_width = mon.width / num_tiled;
-        }
+    int window_width = ws.scroll_maximized ? mon.width : (mon.width / scroll_visible);
 
-        if (tiled_windows.size() == 1 || current_ws.scroll_maximized) {
-            for (size_t i = 0; i < tiled_windows.size(); ++i) {
-                int x_pos = mon.x + i * window_width - current_ws.scroll_offset + base.gaps;
-                int y_pos = base.gaps + y_start;
-                int win_width = window_width - 2 * base.gaps - 2 * base.border_width;
-                int win_height = usable_height - 2 * base.gaps - 2 * base.border_width;
+    int num_tiled = tiled_windows.size();
+    bool all_fit = (num_tiled <= scroll_visible);
+    if (all_fit && !ws.scroll_maximized) {
+        ws.scroll_offset = 0;
+        window_width = mon.width / num_tiled;
+    }
 
-                tiled_windows[i]->x = x_pos;
-                tiled_windows[i]->y = y_pos;
-                tiled_windows[i]->width = win_width;
-                tiled_windows[i]->height = win_height;
+    // Apply scroll offset only if windows don't all fit
+    bool use_offset = tiled_windows.size() == 1 || ws.scroll_maximized || !all_fit;
+    int scroll_offset = use_offset ? ws.scroll_offset : 0;
 
-                XMoveResizeWindow(base.display, tiled_windows[i]->window,
-                                 tiled_windows[i]->x, tiled_windows[i]->y,
-                                 tiled_windows[i]->width, tiled_windows[i]->height);
+    for (size_t i = 0; i < tiled_windows.size(); ++i) {
+        tiled_windows[i]->x = mon.x + i * window_width - scroll_offset + base.gaps;
+        tiled_windows[i]->y = base.gaps + y_start;
+        tiled_windows[i]->width = window_width - 2 * base.gaps - 2 * base.border_width;
+        tiled_windows[i]->height = usable_height - 2 * base.gaps - 2 * base.border_width;
+    }
+}
 
-                tiled_stack.push_back(tiled_windows[i]->window);
-            }
-        } else {
-            for (size_t i = 0; i < tiled_windows.size(); ++i) {
-                // Apply scroll offset only if windows don't all fit
-                int scroll_offset = all_fit ? 0 : current_ws.scroll_offset;
-                int x_pos = mon.x + i * window_width - scroll_offset + base.gaps;
-                int y_pos = base.gaps + y_start;
-                int win_width = window_width - 2 * base.gaps - 2 * base.border_width;
-                int win_height = usable_height - 2 * base.gaps - 2 * base.border_width;
-
-                tiled_windows[i]->x = x_pos;
-                tiled_windows[i]->y = y_pos;
-                tiled_windows[i]->width = win_width;
-                tiled_windows[i]->height = win_height;
-
-                XMoveResizeWindow(base.display, tiled_windows[i]->window,
-                                 tiled_windows[i]->x, tiled_windows[i]->y,
-                                 tiled_windows[i]->width, tiled_windows[i]->height);
-
-                tiled_stack.push_back(tiled_windows[i]->window);
-            }
-        }
+static void layout_master_stack(nwm::Base &base, nwm::Monitor &mon,
+                                std::vector<nwm::ManagedWindow*> &tiled_windows) {
+    int bar_height = base.bar_visible ? base.bar_height : 0;
+    int usable_height = mon.height - bar_height;
+    int y_start = mon.y + (base.bar_position == 0 ? bar_height : 0);
+
+    if (tiled_windows.size() == 1) {
+        tiled_windows[0]->x = mon.x + base.gaps;
+        tiled_windows[0]->y = base.gaps + y_start;
+        tiled_windows[0]->width = mon.width - 2 * base.gaps - 2 * base.border_width;
+        tiled_windows[0]->height = usable_height - 2 * base.gaps - 2 * base.border_width;
+        return;
+    }
 
-        if (!tiled_stack.empty()) {
-            atomic_restack(base.display, base, tiled_stack);
-        }
+    int master_width = (int)(mon.width * mon.master_factor) - base.gaps - base.gaps / 2 - 2 * base.border_width;
+    int stack_x = mon.x + (int)(mon.width * mon.master_factor) + base.gaps / 2;
+    int stack_width = mon.width - (int)(mon.width * mon.master_factor) - base.gaps - base.gaps / 2 - 2 * base.border_width;
+    int stack_height = (usable_height - base.gaps * tiled_windows.size()) / (tiled_windows.size() - 1) - 2 * base.border_width;
+
+    tiled_windows[0]->x = mon.x + base.gaps;
+    tiled_windows[0]->y = base.gaps + y_start;
+    tiled_windows[0]->width = master_width;
+    tiled_windows[0]->height = usable_height - 2 * base.gaps - 2 * base.border_width;
+
+    for (size_t i = 1; i < tiled_windows.size(); ++i) {
+        tiled_windows[i]->x = stack_x;
+        tiled_windows[i]->y = base.gaps + y_start + (i - 1) * (stack_height + base.gaps + 2 * base.border_width);
+        tiled_windows[i]->width = stack_width;
+        tiled_windows[i]->height = stack_height;
     }
+}
 
-    ensure_focused_floating_on_top(base.display, base);
-    raise_override_windows(base.display, base);
-    XFlush(base.display);
+// Pushes the computed layout to the server, skipping windows that are
+// already where they should be and restacks only if the order changed.
+static void commit_layout(nwm::Base &base, nwm::Monitor &mon,
+                          std::vector<nwm::ManagedWindow*> &tiled_windows) {
+    std::vector<Window> tiled_stack;
+    for (auto *w : tiled_windows) {
+        nwm::commit_geometry(base, w, w->x, w->y, w->width, w->height, base.border_width);
+        tiled_stack.push_back(w->window);
+    }
+    atomic_restack(base, mon, tiled_stack);
 }
 
-void nwm::tile_windows(Base &base) {
-    auto &current_ws = get_current_workspace(base);
+static void layout_monitor(nwm::Base &base, nwm::Monitor &mon) {
+    nwm::Workspace &ws = base.workspaces[mon.current_workspace];
+    place_floating(base, ws, mon);
 
-    for (auto &mon : base.monitors) {
-        std::vector<ManagedWindow*> tiled_windows;
-        for (auto &w : current_ws.windows) {
-            if (!w.is_floating && !w.is_fullscreen && w.monitor == mon.id) {
-                tiled_windows.push_back(&w);
-            }
-        }
+    std::vector<nwm::ManagedWindow*> tiled_windows = collect_tiled(base, ws, mon);
+    if (tiled_windows.empty()) return;
 
-        if (tiled_windows.empty()) continue;
+    if (mon.horizontal_mode) {
+        layout_scroll(base, ws, mon, tiled_windows);
+    } else {
+        layout_master_stack(base, mon, tiled_windows);
+    }
+    commit_layout(base, mon, tiled_windows);
+}
 
-        int bar_height = base.bar_visible ? base.bar.height : 0;
-        int usable_height = mon.height - bar_height;
-        int y_start = mon.y + (base.bar_position == 0 ? bar_height : 0);
+void nwm::tile_monitor(Base &base, Monitor &mon) {
+    if (base.batch_depth > 0) {
+        base.layout_pending = true;
+        return;
+    }
+    ewmh_restacked(base);
 
-        std::vector<Window> tiled_stack;
+    layout_monitor(base, mon);
 
-        if (tiled_windows.size() == 1) {
-            tiled_windows[0]->x = mon.x + base.gaps;
-            tiled_windows[0]->y = base.gaps + y_start;
-            tiled_windows[0]->width = mon.width - 2 * base.gaps - 2 * base.border_width;
-            tiled_windows[0]->height = usable_height - 2 * base.gaps - 2 * base.border_width;
+    ensure_focused_floating_on_top(base);
+    raise_override_redirect_windows(base, true);
+    base.backend->flush(base);
+}
 
-            XMoveResizeWindow(base.display, tiled_windows[0]->window,
-                             tiled_windows[0]->x, tiled_windows[0]->y,
-                             tiled_windows[0]->width, tiled_windows[0]->height);
+void nwm::tile_current(Base &base) {
+    Monitor *mon = get_current_monitor(base);
+    if (mon) tile_monitor(base, *mon);
+}
 
-            tiled_stack.push_back(tiled_windows[0]->window);
-        } else {
-            int master_width = (int)(mon.width * mon.master_factor) - base.gaps - base.gaps / 2 - 2 * base.border_width;
-            int stack_x = mon.x + (int)(mon.width * mon.master_factor) + base.gaps / 2;
-            int stack_width = mon.width - (int)(mon.width * mon.master_factor) - base.gaps - base.gaps / 2 - 2 * base.border_width;
-            int stack_height = (usable_height - base.gaps * tiled_windows.size()) / (tiled_windows.size() - 1) - 2 * base.border_width;
-
-            tiled_windows[0]->x = mon.x + base.gaps;
-            tiled_windows[0]->y = base.gaps + y_start;
-            tiled_windows[0]->width = master_width;
-            tiled_windows[0]->height = usable_height - 2 * base.gaps - 2 * base.border_width;
-
-            for (size_t i = 1; i < tiled_windows.size(); ++i) {
-                tiled_windows[i]->x = stack_x;
-                tiled_windows[i]->y = base.gaps + y_start + (i - 1) * (stack_height + base.gaps + 2 * base.border_width);
-                tiled_windows[i]->width = stack_width;
-                tiled_windows[i]->height = stack_height;
-            }
-
-            for (auto *w : tiled_windows) {
-                XMoveResizeWindow(base.display, w->window, w->x, w->y, w->width, w->height);
-                tiled_stack.push_back(w->window);
-            }
-        }
+void nwm::tile_windows(Base &base) {
+    if (base.batch_depth > 0) {
+        base.layout_pending = true;
+        return;
+    }
+    ewmh_restacked(base);
 
-        if (!tiled_stack.empty()) {
-            atomic_restack(base.display, base, tiled_stack);
-        }
+    for (auto &mon : base.monitors) {
+        layout_monitor(base, mon);
     }
 
-    ensure_focused_floating_on_top(base.display, base);
-    raise_override_windows(base.display, base);
-    XFlush(base.display);
+    ensure_focused_floating_on_top(base);
+    raise_override_redirect_windows(base, true);
+    base.backend->flush(base);
 }
 
 void nwm::resize_master(void *arg, Base &base) {
     auto &current_ws = get_current_workspace(base);
-    if (current_ws.windows.size() < 2 || base.horizontal_mode) return;
+    if (current_ws.clients.size() < 2 || base.horizontal_mode) return;
 
     Monitor *mon = get_current_monitor(base);
     if (!mon) return;
 
-    int delta = (int)(long)arg;
+    // The argument only gives the direction; resize_step gives the size.
+    int delta = (long)arg < 0 ? -base.resize_step : base.resize_step;
     float delta_factor = (float)delta / mon->width;
     mon->master_factor += delta_factor;
 
     if (mon->master_factor < 0.1f) mon->master_factor = 0.1f;
     if (mon->master_factor > 0.9f) mon->master_factor = 0.9f;
 
-    tile_windows(base);
+    tile_monitor(base, *mon);
 }
 
-void nwm::scroll_left(void *arg, Base &base) {
-    (void)arg;
+// Width of one column of the current workspace's horizontal layout.
+static int scroll_column_width(const nwm::Monitor &mon, const nwm::Workspace &ws) {
+    if (ws.scroll_maximized) return mon.width;
+    int scroll_visible = mon.scroll_windows_visible;
+    if (scroll_visible < 1) scroll_visible = 1;
+    return mon.width / scroll_visible;
+}
+
+void nwm::scroll_by(Base &base, int delta) {
     if (!base.horizontal_mode) return;
 
     Monitor *mon = get_current_monitor(base);
     if (!mon) return;
 
     auto &current_ws = get_current_workspace(base);
+    int total_width = current_ws.clients.size() * scroll_column_width(*mon, current_ws);
+    int max_scroll = std::max(0, total_width - mon->width);
 
-    int scroll_amount;
-    if (current_ws.scroll_maximized) {
-        scroll_amount = mon->width;
-    } else {
-        int scroll_visible = mon->scroll_windows_visible;
-        if (scroll_visible < 1) scroll_visible = 1;
-        scroll_amount = mon->width / scroll_visible;
-    }
+    current_ws.scroll_offset = std::max(0, std::min(max_scroll,
+                                                    current_ws.scroll_offset + delta));
+    tile_current(base);
+}
 
-    current_ws.scroll_offset = std::max(0, current_ws.scroll_offset - scroll_amount);
-    tile_horizontal(base);
+void nwm::scroll_left(void *arg, Base &base) {
+    (void)arg;
+    Monitor *mon = get_current_monitor(base);
+    if (!mon) return;
+    scroll_by(base, -scroll_column_width(*mon, get_current_workspace(base)));
 }
 
 void nwm::scroll_right(void *arg, Base &base) {
     (void)arg;
-    if (!base.horizontal_mode) return;
-
     Monitor *mon = get_current_monitor(base);
     if (!mon) return;
-
-    auto &current_ws = get_current_workspace(base);
-
-    int scroll_visible = mon->scroll_windows_visible;
-    if (scroll_visible < 1) scroll_visible = 1;
-
-    int window_width = current_ws.scroll_maximized ? mon->width : (mon->width / scroll_visible);
-    int scroll_amount = current_ws.scroll_maximized ? mon->width : window_width;
-
-    int total_width = current_ws.windows.size() * window_width;
-    int max_scroll = std::max(0, total_width - mon->width);
-
-    current_ws.scroll_offset = std::min(max_scroll,
-                                        current_ws.scroll_offset + scroll_amount);
-    tile_horizontal(base);
+    scroll_by(base, scroll_column_width(*mon, get_current_workspace(base)));
 }
 
 void nwm::toggle_layout(void *arg, Base &base) {
@@ -265,65 +279,43 @@ void nwm::toggle_layout(void *arg, Base &base) {
     auto &current_ws = get_current_workspace(base);
     current_ws.scroll_offset = 0;
 
-    if (mon->horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
-    }
+    tile_current(base);
 
-    bar_draw(base);
+    bar_link_publish(base);
+    ipc_emit(base, IPC_EVENT_LAYOUT, None, base.current_workspace,
+             base.current_monitor, mon->horizontal_mode ? 1 : 0);
 }
 
 void nwm::swap_next(void *arg, Base &base) {
     (void)arg;
     auto &current_ws = get_current_workspace(base);
-    if (current_ws.windows.size() < 2) return;
+    if (current_ws.clients.size() < 2) return;
 
-    int current_idx = -1;
-    for (size_t i = 0; i < current_ws.windows.size(); ++i) {
-        if (current_ws.focused_window && current_ws.windows[i].window == current_ws.focused_window->window) {
-            current_idx = i;
-            break;
-        }
-    }
-
-    if (current_idx == -1 || current_ws.windows[current_idx].is_floating) return;
+    if (!current_ws.focused_window || current_ws.focused_window->is_floating) return;
+    int current_idx = workspace_position(current_ws, current_ws.focused_window->handle);
+    if (current_idx == -1) return;
 
-    int next_idx = (current_idx + 1) % current_ws.windows.size();
-    std::swap(current_ws.windows[current_idx], current_ws.windows[next_idx]);
+    int next_idx = (current_idx + 1) % current_ws.clients.size();
+    std::swap(current_ws.clients[current_idx], current_ws.clients[next_idx]);
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
-    }
-    focus_window(&current_ws.windows[next_idx], base);
+    tile_current(base);
+    focus_window(client_get(base, current_ws.clients[next_idx]), base);
 }
 
 void nwm::swap_prev(void *arg, Base &base) {
     (void)arg;
     auto &current_ws = get_current_workspace(base);
-    if (current_ws.windows.size() < 2) return;
+    if (current_ws.clients.size() < 2) return;
 
-    int current_idx = -1;
-    for (size_t i = 0; i < current_ws.windows.size(); ++i) {
-        if (current_ws.focused_window && current_ws.windows[i].window == current_ws.focused_window->window) {
-            current_idx = i;
-            break;
-        }
-    }
-
-    if (current_idx == -1 || current_ws.windows[current_idx].is_floating) return;
+    if (!current_ws.focused_window || current_ws.focused_window->is_floating) return;
+    int current_idx = workspace_position(current_ws, current_ws.focused_window->handle);
+    if (current_idx == -1) return;
 
-    int prev_idx = (current_idx - 1 + current_ws.windows.size()) % current_ws.windows.size();
-    std::swap(current_ws.windows[current_idx], current_ws.windows[prev_idx]);
+    int prev_idx = (current_idx - 1 + current_ws.clients.size()) % current_ws.clients.size();
+    std::swap(current_ws.clients[current_idx], current_ws.clients[prev_idx]);
 
-    if (base.horizontal_mode) {
-        tile_horizontal(base);
-    } else {
-        tile_windows(base);
-    }
-    focus_window(&current_ws.windows[prev_idx], base);
+    tile_current(base);
+    focus_window(client_get(base, current_ws.clients[prev_idx]), base);
 }
 
 void nwm::increment_scroll_visible(void *arg, Base &base) {
@@ -338,10 +330,10 @@ void nwm::increment_scroll_visible(void *arg, Base &base) {
     current_ws.scroll_offset = 0;
 
     if (mon->horizontal_mode) {
-        tile_horizontal(base);
+        tile_current(base);
     }
 
-    bar_draw(base);
+    bar_link_publish(base);
 }
 
 void nwm::decrement_scroll_visible(void *arg, Base &base) {
@@ -356,8 +348,8 @@ void nwm::decrement_scroll_visible(void *arg, Base &base) {
     current_ws.scroll_offset = 0;
 
     if (mon->horizontal_mode) {
-        tile_horizontal(base);
+        tile_current(base);
     }
 
-    bar_draw(base);
+    bar_link_publish(base);
 }
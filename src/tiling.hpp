@@ -5,8 +5,15 @@
 
 namespace nwm {
 
+// Lays out the workspace shown on mon, in mon's layout mode.
+void tile_monitor(Base &base, Monitor &mon);
+// Lays out the focused monitor only.
+void tile_current(Base &base);
+// Lays out every monitor, for changes that affect all of them.
 void tile_windows(Base &base);
-void tile_horizontal(Base &base);
+
+void commit_geometry(Base &base, ManagedWindow *window,
+                     int x, int y, int width, int height, int border_width);
 
 void resize_master(void *arg, Base &base);
 
@@ -18,7 +25,7 @@ void toggle_layout(void *arg, Base &base);
 void swap_next(void *arg, Base &base);
 void swap_prev(void *arg, Base &base);
 
-void raise_special_windows(Display *display);
+void raise_special_windows(Base &base);
 
 void increment_scroll_visible(void *arg, Base &base);
 void decrement_scroll_visible(void *arg, Base &base);
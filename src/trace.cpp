@@ -0,0 +1,485 @@
+#include "trace.hpp"
+#include "nwm.hpp"
+#include "atoms.hpp"
+#include <X11/Xutil.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+static size_t event_size(int type) {
+    switch (type) {
+        case KeyPress:
+        case KeyRelease:        return sizeof(XKeyEvent);
+        case ButtonPress:
+        case ButtonRelease:     return sizeof(XButtonEvent);
+        case MotionNotify:      return sizeof(XMotionEvent);
+        case EnterNotify:
+        case LeaveNotify:       return sizeof(XCrossingEvent);
+        case CreateNotify:      return sizeof(XCreateWindowEvent);
+        case DestroyNotify:     return sizeof(XDestroyWindowEvent);
+        case UnmapNotify:       return sizeof(XUnmapEvent);
+        case MapNotify:         return sizeof(XMapEvent);
+        case MapRequest:        return sizeof(XMapRequestEvent);
+        case ReparentNotify:    return sizeof(XReparentEvent);
+        case ConfigureNotify:   return sizeof(XConfigureEvent);
+        case ConfigureRequest:  return sizeof(XConfigureRequestEvent);
+        case PropertyNotify:    return sizeof(XPropertyEvent);
+        case ClientMessage:     return sizeof(XClientMessageEvent);
+        default:                return sizeof(XEvent);
+    }
+}
+
+static void write_record(nwm::Trace &trace, nwm::TraceKind kind, const void *data, size_t length) {
+    nwm::TraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.kind = kind;
+    record.length = length;
+    fwrite(&record, sizeof(record), 1, trace.file);
+    fwrite(data, length, 1, trace.file);
+    trace.records++;
+}
+
+static void write_atom(nwm::Base &base, Atom a) {
+    nwm::Trace &trace = base.trace;
+    if (a == None || trace.atoms.count(a)) return;
+    trace.atoms.insert(a);
+
+    char *name = XGetAtomName(base.display, a);
+    if (!name) return;
+    std::string payload(sizeof(uint32_t), '\0');
+    uint32_t id = a;
+    memcpy(&payload[0], &id, sizeof(id));
+    payload += name;
+    XFree(name);
+    write_record(trace, nwm::TRACE_ATOM, payload.data(), payload.size());
+}
+
+static std::vector<nwm::TraceMonitor> snapshot_monitors(const nwm::Base &base) {
+    std::vector<nwm::TraceMonitor> list;
+    for (const auto &mon : base.monitors) {
+        nwm::TraceMonitor m;
+        m.x = mon.x;
+        m.y = mon.y;
+        m.width = mon.width;
+        m.height = mon.height;
+        list.push_back(m);
+    }
+    return list;
+}
+
+bool nwm::trace_start(Base &base, const char *path) {
+    Trace &trace = base.trace;
+    trace.file = fopen(path, "we");
+    if (!trace.file) {
+        perror(path);
+        return false;
+    }
+    trace.records = 0;
+    trace.atoms.clear();
+
+    std::vector<TraceWindow> windows;
+    Window root_return, parent_return;
+    Window *children;
+    unsigned int nchildren;
+    if (XQueryTree(base.display, base.root, &root_return, &parent_return, &children, &nchildren)) {
+        for (unsigned int i = 0; i < nchildren; ++i) {
+            XWindowAttributes wa;
+            if (!XGetWindowAttributes(base.display, children[i], &wa)) continue;
+            if (wa.c_class == InputOnly) continue;
+
+            TraceWindow w;
+            memset(&w, 0, sizeof(w));
+            w.window = children[i];
+            w.x = wa.x;
+            w.y = wa.y;
+            w.width = wa.width;
+            w.height = wa.height;
+            w.border_width = wa.border_width;
+            w.override_redirect = wa.override_redirect;
+            w.map_state = wa.map_state;
+            windows.push_back(w);
+        }
+        if (children) XFree(children);
+    }
+
+    std::vector<TraceMonitor> monitors = snapshot_monitors(base);
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.root = base.root;
+    header.monitor_count = monitors.size();
+    header.window_count = windows.size();
+
+    fwrite(&header, sizeof(header), 1, trace.file);
+    fwrite(monitors.data(), sizeof(TraceMonitor), monitors.size(), trace.file);
+    fwrite(windows.data(), sizeof(TraceWindow), windows.size(), trace.file);
+    fflush(trace.file);
+    return true;
+}
+
+void nwm::trace_stop(Base &base) {
+    Trace &trace = base.trace;
+    if (!trace.file) return;
+    fclose(trace.file);
+    trace.file = nullptr;
+}
+
+void nwm::trace_event(Base &base, const XEvent &e) {
+    if (!base.trace.file) return;
+
+    // Atom ids are only meaningful on the recording server; the names let
+    // the replay intern its own.
+    if (e.type == ClientMessage) {
+        write_atom(base, e.xclient.message_type);
+        if (e.xclient.message_type == atom(NET_WM_STATE)) {
+            write_atom(base, e.xclient.data.l[1]);
+            write_atom(base, e.xclient.data.l[2]);
+        }
+    }
+
+    write_record(base.trace, TRACE_EVENT, &e, event_size(e.type));
+}
+
+void nwm::trace_command(Base &base, const std::string &batch) {
+    if (!base.trace.file) return;
+    write_record(base.trace, TRACE_COMMAND, batch.data(), batch.size());
+}
+
+void nwm::trace_monitors(Base &base) {
+    if (!base.trace.file) return;
+    std::vector<TraceMonitor> monitors = snapshot_monitors(base);
+    std::string payload(sizeof(uint32_t), '\0');
+    uint32_t count = monitors.size();
+    memcpy(&payload[0], &count, sizeof(count));
+    payload.append((const char*)monitors.data(), monitors.size() * sizeof(TraceMonitor));
+    write_record(base.trace, TRACE_MONITORS, payload.data(), payload.size());
+}
+
+void nwm::trace_flush(Base &base) {
+    if (base.trace.file) fflush(base.trace.file);
+}
+
+// Replay
+
+#define REPLAY_SLOT_COMMAND LASTEvent
+#define REPLAY_SLOT_MONITORS (LASTEvent + 1)
+#define REPLAY_SLOTS (LASTEvent + 2)
+// Live events the stand-in windows generate are discarded this often.
+#define REPLAY_DISCARD_INTERVAL 256
+
+struct ReplayStats {
+    unsigned long count;
+    uint64_t ns;
+    unsigned long requests;
+};
+
+struct Replay {
+    nwm::Base *base;
+    Window recorded_root;
+    std::unordered_map<uint32_t, Window> windows;
+    std::unordered_map<uint32_t, Atom> atoms;
+    ReplayStats stats[REPLAY_SLOTS];
+    unsigned long errors;
+};
+
+static Replay *current_replay;
+
+static int replay_error_handler(Display *dpy, XErrorEvent *error) {
+    (void)dpy;
+    (void)error;
+    if (current_replay) current_replay->errors++;
+    return 0;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static Window create_stand_in(Replay &replay, uint32_t recorded, int x, int y,
+                              int width, int height, int border_width, bool override_redirect) {
+    nwm::Base &base = *replay.base;
+    XSetWindowAttributes attrs;
+    attrs.override_redirect = override_redirect;
+    Window w = XCreateWindow(base.display, base.root, x, y,
+                             std::max(width, 1), std::max(height, 1), border_width,
+                             CopyFromParent, InputOutput, CopyFromParent,
+                             CWOverrideRedirect, &attrs);
+    replay.windows[recorded] = w;
+    return w;
+}
+
+static Window translate_window(Replay &replay, Window w) {
+    if (w == None) return None;
+    if (w == replay.recorded_root) return replay.base->root;
+    auto it = replay.windows.find(w);
+    return it != replay.windows.end() ? it->second : w;
+}
+
+static Atom translate_atom(Replay &replay, Atom a) {
+    auto it = replay.atoms.find(a);
+    return it != replay.atoms.end() ? it->second : a;
+}
+
+static void translate_event(Replay &replay, XEvent &e) {
+    e.xany.display = replay.base->display;
+    e.xany.window = translate_window(replay, e.xany.window);
+
+    switch (e.type) {
+        case KeyPress:
+        case KeyRelease:
+        case ButtonPress:
+        case ButtonRelease:
+        case MotionNotify:
+            // XKeyEvent, XButtonEvent and XMotionEvent share this layout.
+            e.xbutton.root = replay.base->root;
+            e.xbutton.subwindow = translate_window(replay, e.xbutton.subwindow);
+            break;
+        case EnterNotify:
+        case LeaveNotify:
+            e.xcrossing.root = replay.base->root;
+            e.xcrossing.subwindow = translate_window(replay, e.xcrossing.subwindow);
+            break;
+        case CreateNotify:
+            e.xcreatewindow.window = translate_window(replay, e.xcreatewindow.window);
+            break;
+        case DestroyNotify:
+            e.xdestroywindow.window = translate_window(replay, e.xdestroywindow.window);
+            break;
+        case UnmapNotify:
+            e.xunmap.window = translate_window(replay, e.xunmap.window);
+            break;
+        case MapNotify:
+            e.xmap.window = translate_window(replay, e.xmap.window);
+            break;
+        case MapRequest:
+            e.xmaprequest.window = translate_window(replay, e.xmaprequest.window);
+            break;
+        case ReparentNotify:
+            e.xreparent.window = translate_window(replay, e.xreparent.window);
+            e.xreparent.parent = translate_window(replay, e.xreparent.parent);
+            break;
+        case ConfigureNotify:
+            e.xconfigure.window = translate_window(replay, e.xconfigure.window);
+            e.xconfigure.above = translate_window(replay, e.xconfigure.above);
+            break;
+        case ConfigureRequest:
+            e.xconfigurerequest.window = translate_window(replay, e.xconfigurerequest.window);
+            e.xconfigurerequest.above = translate_window(replay, e.xconfigurerequest.above);
+            break;
+        case ClientMessage:
+            e.xclient.message_type = translate_atom(replay, e.xclient.message_type);
+            if (e.xclient.message_type == nwm::atom(nwm::NET_WM_STATE)) {
+                e.xclient.data.l[1] = translate_atom(replay, e.xclient.data.l[1]);
+                e.xclient.data.l[2] = translate_atom(replay, e.xclient.data.l[2]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Recorded monitors replace whatever the replay server reports; per-monitor
+// layout state carries over by index.
+static void apply_monitors(nwm::Base &base, const nwm::TraceMonitor *list, uint32_t count) {
+    if (count == 0) return;
+
+    std::vector<nwm::Monitor> old = base.monitors;
+    base.monitors.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        nwm::Monitor mon = old[std::min<size_t>(i, old.size() - 1)];
+        if (i >= old.size()) {
+            mon.current_workspace = i % NUM_WORKSPACES;
+        }
+        mon.id = i;
+        mon.x = list[i].x;
+        mon.y = list[i].y;
+        mon.width = list[i].width;
+        mon.height = list[i].height;
+        mon.crtc = 0;
+        mon.frame_ns = DEFAULT_FRAME_NS;
+        mon.committed_stack.clear();
+        base.monitors.push_back(mon);
+    }
+    nwm::monitors_changed(base, old);
+}
+
+static void account(Replay &replay, int slot, uint64_t start, unsigned long next_request) {
+    ReplayStats &s = replay.stats[slot];
+    s.count++;
+    s.ns += now_ns() - start;
+    s.requests += XNextRequest(replay.base->display) - next_request;
+}
+
+static const char *slot_name(int slot) {
+    static const char *const names[LASTEvent] = {
+        "", "", "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease",
+        "MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+        "KeymapNotify", "Expose", "GraphicsExpose", "NoExpose", "VisibilityNotify",
+        "CreateNotify", "DestroyNotify", "UnmapNotify", "MapNotify", "MapRequest",
+        "ReparentNotify", "ConfigureNotify", "ConfigureRequest", "GravityNotify",
+        "ResizeRequest", "CirculateNotify", "CirculateRequest", "PropertyNotify",
+        "SelectionClear", "SelectionRequest", "SelectionNotify", "ColormapNotify",
+        "ClientMessage", "MappingNotify", "GenericEvent",
+    };
+    if (slot == REPLAY_SLOT_COMMAND) return "IPC command";
+    if (slot == REPLAY_SLOT_MONITORS) return "Monitors";
+    return names[slot];
+}
+
+int nwm::trace_replay(const char *path) {
+    FILE *file = fopen(path, "re");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    std::vector<char> data;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(file);
+
+    TraceHeader header;
+    size_t offset = sizeof(header);
+    if (data.size() < offset) {
+        std::cerr << path << ": not an nwm trace\n";
+        return 1;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    size_t tables = header.monitor_count * sizeof(TraceMonitor) +
+                    header.window_count * sizeof(TraceWindow);
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION || data.size() - offset < tables) {
+        std::cerr << path << ": not an nwm trace or unsupported version\n";
+        return 1;
+    }
+
+    std::vector<TraceMonitor> monitors(header.monitor_count);
+    memcpy(monitors.data(), data.data() + offset, monitors.size() * sizeof(TraceMonitor));
+    offset += monitors.size() * sizeof(TraceMonitor);
+    std::vector<TraceWindow> tree(header.window_count);
+    memcpy(tree.data(), data.data() + offset, tree.size() * sizeof(TraceWindow));
+    offset += tree.size() * sizeof(TraceWindow);
+
+    Base wm;
+    wm.replaying = true;
+    init(wm);
+
+    Replay replay;
+    replay.base = &wm;
+    replay.recorded_root = header.root;
+    memset(replay.stats, 0, sizeof(replay.stats));
+    replay.errors = 0;
+    current_replay = &replay;
+    XSetErrorHandler(replay_error_handler);
+
+    apply_monitors(wm, monitors.data(), monitors.size());
+
+    std::vector<Window> existing;
+    for (const TraceWindow &w : tree) {
+        Window stand_in = create_stand_in(replay, w.window, w.x, w.y, w.width, w.height,
+                                          w.border_width, w.override_redirect);
+        if (w.map_state == IsViewable) XMapWindow(wm.display, stand_in);
+        existing.push_back(stand_in);
+    }
+    adopt_windows(wm, existing);
+    XSync(wm.display, True);
+
+    unsigned long records = 0;
+    uint64_t started = now_ns();
+    unsigned long first_request = XNextRequest(wm.display);
+
+    while (data.size() - offset >= sizeof(TraceRecord)) {
+        TraceRecord record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+        offset += sizeof(record);
+        if (data.size() - offset < record.length) break;
+        const char *payload = data.data() + offset;
+        offset += record.length;
+        records++;
+
+        uint64_t start = now_ns();
+        unsigned long next_request = XNextRequest(wm.display);
+
+        if (record.kind == TRACE_EVENT) {
+            XEvent e;
+            memset(&e, 0, sizeof(e));
+            memcpy(&e, payload, std::min<size_t>(record.length, sizeof(e)));
+
+            if (e.type == CreateNotify) {
+                const XCreateWindowEvent &c = e.xcreatewindow;
+                if (!replay.windows.count(c.window)) {
+                    create_stand_in(replay, c.window, c.x, c.y, c.width, c.height,
+                                    c.border_width, c.override_redirect);
+                }
+                start = now_ns();
+                next_request = XNextRequest(wm.display);
+            }
+
+            uint32_t recorded = e.xany.type == DestroyNotify ? e.xdestroywindow.window : 0;
+            int slot = e.type >= 0 && e.type < LASTEvent ? e.type : REPLAY_SLOT_MONITORS;
+            if (slot == REPLAY_SLOT_MONITORS) {
+                // XRandR events are replaced by the TRACE_MONITORS record
+                // that follows them.
+                continue;
+            }
+
+            translate_event(replay, e);
+            dispatch_event(e, wm);
+            account(replay, slot, start, next_request);
+
+            if (recorded && replay.windows.count(recorded)) {
+                XDestroyWindow(wm.display, replay.windows[recorded]);
+                replay.windows.erase(recorded);
+            }
+        } else if (record.kind == TRACE_ATOM && record.length > sizeof(uint32_t)) {
+            uint32_t id;
+            memcpy(&id, payload, sizeof(id));
+            std::string name(payload + sizeof(id), record.length - sizeof(id));
+            replay.atoms[id] = XInternAtom(wm.display, name.c_str(), False);
+        } else if (record.kind == TRACE_COMMAND) {
+            std::string error;
+            ipc_run_batch(wm, std::string(payload, record.length), error);
+            account(replay, REPLAY_SLOT_COMMAND, start, next_request);
+        } else if (record.kind == TRACE_MONITORS && record.length >= sizeof(uint32_t)) {
+            uint32_t count;
+            memcpy(&count, payload, sizeof(count));
+            if (record.length - sizeof(count) >= count * sizeof(TraceMonitor)) {
+                apply_monitors(wm, (const TraceMonitor*)(payload + sizeof(count)), count);
+                account(replay, REPLAY_SLOT_MONITORS, start, next_request);
+            }
+        }
+
+        if (records % REPLAY_DISCARD_INTERVAL == 0) {
+            XSync(wm.display, True);
+        }
+    }
+
+    uint64_t elapsed = now_ns() - started;
+    unsigned long handler_requests = 0;
+    for (const ReplayStats &s : replay.stats) handler_requests += s.requests;
+
+    printf("replayed %lu records from %s in %.3f ms\n", records, path, elapsed / 1e6);
+    printf("X requests: %lu from handlers, %lu total; X errors: %lu\n",
+           handler_requests, XNextRequest(wm.display) - first_request, replay.errors);
+    printf("%-18s %9s %12s %10s %12s\n", "record", "count", "total us", "mean us", "requests");
+    for (int i = 0; i < REPLAY_SLOTS; ++i) {
+        const ReplayStats &s = replay.stats[i];
+        if (!s.count) continue;
+        printf("%-18s %9lu %12.1f %10.2f %12lu\n", slot_name(i), s.count,
+               s.ns / 1e3, s.ns / 1e3 / s.count, s.requests);
+    }
+    fflush(stdout);
+
+    cleanup(wm);
+    current_replay = nullptr;
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <X11/Xlib.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+
+// A trace is a TraceHeader, the monitors and top-level windows present when
+// recording started, then a sequence of TraceRecords. Records are written in
+// the order nwm::run handled them, so replaying them into the same handlers
+// reproduces the session's WM-side work.
+#define TRACE_MAGIC "NWMTRACE"
+#define TRACE_VERSION 1
+
+namespace nwm {
+
+struct Base;
+
+enum TraceKind : uint8_t {
+    TRACE_EVENT = 1,     // an XEvent, truncated to its type's struct
+    TRACE_ATOM = 2,      // uint32 atom id + name, before the first event using it
+    TRACE_COMMAND = 3,   // an IPC command batch
+    TRACE_MONITORS = 4,  // uint32 count + TraceMonitor[] after an XRandR change
+};
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t root;
+    uint32_t monitor_count;
+    uint32_t window_count;
+};
+
+struct TraceMonitor {
+    int32_t x, y;
+    int32_t width, height;
+};
+
+struct TraceWindow {
+    uint32_t window;
+    int32_t x, y;
+    int32_t width, height;
+    int32_t border_width;
+    uint8_t override_redirect;
+    uint8_t map_state;
+    uint8_t pad[2];
+};
+
+struct TraceRecord {
+    uint8_t kind;
+    uint8_t pad[3];
+    uint32_t length;
+};
+
+struct Trace {
+    FILE *file;
+    unsigned long records;
+    // Atoms whose names are already in the trace.
+    std::unordered_set<Atom> atoms;
+};
+
+// Starts recording to `path`, snapshotting the current monitors and window
+// tree. Returns false if the file cannot be written.
+bool trace_start(Base &base, const char *path);
+void trace_stop(Base &base);
+void trace_event(Base &base, const XEvent &e);
+void trace_command(Base &base, const std::string &batch);
+void trace_monitors(Base &base);
+// Writes buffered records; called once per event loop iteration.
+void trace_flush(Base &base);
+
+// Runs a fresh WM on the current display (meant to be an empty Xvfb), feeds
+// it the recorded session and prints the time and X requests spent per event
+// type. Returns the process exit status.
+int trace_replay(const char *path);
+
+}
+
+#endif // TRACE_HPP
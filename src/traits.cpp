@@ -0,0 +1,237 @@
+#include "traits.hpp"
+#include "nwm.hpp"
+#include "atoms.hpp"
+#include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+
+// Length of WM_NORMAL_HINTS in 32-bit units, and the pre-ICCCM minimum that
+// XGetWMNormalHints still accepts.
+#define SIZE_HINTS_ELEMENTS 18
+#define OLD_SIZE_HINTS_ELEMENTS 15
+
+namespace {
+
+struct TraitCookies {
+    xcb_get_window_attributes_cookie_t attributes;
+    xcb_get_geometry_cookie_t geometry;
+    xcb_get_property_cookie_t window_type;
+    xcb_get_property_cookie_t state;
+    xcb_get_property_cookie_t wm_class;
+    xcb_get_property_cookie_t transient_for;
+    xcb_get_property_cookie_t normal_hints;
+    xcb_get_property_cookie_t workspace;
+    xcb_get_property_cookie_t floating;
+    xcb_get_property_cookie_t fullscreen;
+};
+
+xcb_get_property_reply_t* property_reply(xcb_connection_t *conn, xcb_get_property_cookie_t cookie) {
+    xcb_generic_error_t *err = nullptr;
+    xcb_get_property_reply_t *reply = xcb_get_property_reply(conn, cookie, &err);
+    free(err);
+    if (reply && xcb_get_property_value_length(reply) == 0) {
+        free(reply);
+        return nullptr;
+    }
+    return reply;
+}
+
+bool contains_atom(const uint32_t *atoms, int count, Atom needle) {
+    for (int i = 0; i < count; ++i) {
+        if (atoms[i] == needle) return true;
+    }
+    return false;
+}
+
+bool read_cardinal(xcb_connection_t *conn, xcb_get_property_cookie_t cookie, long &value) {
+    xcb_get_property_reply_t *reply = property_reply(conn, cookie);
+    if (!reply) return false;
+    bool ok = reply->format == 32;
+    if (ok) value = *(const uint32_t*)xcb_get_property_value(reply);
+    free(reply);
+    return ok;
+}
+
+void collect(xcb_connection_t *conn, const TraitCookies &c, nwm::WindowTraits &t) {
+    using namespace nwm;
+
+    xcb_generic_error_t *err = nullptr;
+    xcb_get_window_attributes_reply_t *attr = xcb_get_window_attributes_reply(conn, c.attributes, &err);
+    free(err);
+    err = nullptr;
+    xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(conn, c.geometry, &err);
+    free(err);
+
+    t.valid = attr && geom;
+    if (attr) {
+        t.override_redirect = attr->override_redirect;
+        t.input_only = attr->_class == XCB_WINDOW_CLASS_INPUT_ONLY;
+        t.map_state = attr->map_state;
+    }
+    if (geom) {
+        t.x = geom->x;
+        t.y = geom->y;
+        t.width = geom->width;
+        t.height = geom->height;
+        t.border_width = geom->border_width;
+    }
+    free(attr);
+    free(geom);
+
+    // Replies must be drained even for windows we end up ignoring.
+    xcb_get_property_reply_t *type = property_reply(conn, c.window_type);
+    xcb_get_property_reply_t *state = property_reply(conn, c.state);
+    xcb_get_property_reply_t *wm_class = property_reply(conn, c.wm_class);
+    xcb_get_property_reply_t *transient = property_reply(conn, c.transient_for);
+    xcb_get_property_reply_t *hints = property_reply(conn, c.normal_hints);
+
+    long value;
+    if (read_cardinal(conn, c.workspace, value) && value >= 0 && value < NUM_WORKSPACES) {
+        t.saved_workspace = value;
+    }
+    if (read_cardinal(conn, c.floating, value)) t.saved_floating = (value == 1);
+    if (read_cardinal(conn, c.fullscreen, value)) t.saved_fullscreen = (value == 1);
+
+    if (!t.valid || t.override_redirect || t.input_only) {
+        t.ignore = true;
+    }
+
+    if (type && type->format == 32) {
+        const uint32_t *types = (const uint32_t*)xcb_get_property_value(type);
+        int count = xcb_get_property_value_length(type) / 4;
+
+        Atom dock = atom(NET_WM_WINDOW_TYPE_DOCK);
+        Atom desktop = atom(NET_WM_WINDOW_TYPE_DESKTOP);
+        Atom notification = atom(NET_WM_WINDOW_TYPE_NOTIFICATION);
+        Atom tooltip = atom(NET_WM_WINDOW_TYPE_TOOLTIP);
+        Atom combo = atom(NET_WM_WINDOW_TYPE_COMBO);
+        Atom dnd = atom(NET_WM_WINDOW_TYPE_DND);
+        Atom dropdown = atom(NET_WM_WINDOW_TYPE_DROPDOWN_MENU);
+        Atom popup = atom(NET_WM_WINDOW_TYPE_POPUP_MENU);
+
+        if (contains_atom(types, count, notification) || contains_atom(types, count, tooltip) ||
+            contains_atom(types, count, dropdown) || contains_atom(types, count, popup) ||
+            contains_atom(types, count, combo)) {
+            t.special = true;
+            t.ignore = true;
+        }
+        if (contains_atom(types, count, dock) || contains_atom(types, count, desktop) ||
+            contains_atom(types, count, dnd)) {
+            t.ignore = true;
+        }
+
+        if (count > 0 && (types[0] == atom(NET_WM_WINDOW_TYPE_DIALOG) ||
+                          types[0] == atom(NET_WM_WINDOW_TYPE_SPLASH) ||
+                          types[0] == atom(NET_WM_WINDOW_TYPE_UTILITY))) {
+            t.floating = true;
+        }
+    }
+
+    if (state && state->format == 32) {
+        const uint32_t *states = (const uint32_t*)xcb_get_property_value(state);
+        int count = xcb_get_property_value_length(state) / 4;
+
+        if (contains_atom(states, count, atom(NET_WM_STATE_SKIP_TASKBAR)) &&
+            contains_atom(states, count, atom(NET_WM_STATE_SKIP_PAGER))) {
+            t.ignore = true;
+        }
+        if (contains_atom(states, count, atom(NET_WM_STATE_MODAL)) ||
+            contains_atom(states, count, atom(NET_WM_STATE_ABOVE))) {
+            t.floating = true;
+        }
+    }
+
+    if (wm_class && wm_class->format == 8) {
+        const char *data = (const char*)xcb_get_property_value(wm_class);
+        int len = xcb_get_property_value_length(wm_class);
+        const char *instance_end = (const char*)memchr(data, '\0', len);
+        if (instance_end && instance_end + 1 < data + len) {
+            std::string class_name(instance_end + 1, strnlen(instance_end + 1, data + len - instance_end - 1));
+            if (class_name == "Dunst" ||
+                class_name == "Xfce4-notifyd" ||
+                class_name == "Notify-osd" ||
+                class_name == "notification" ||
+                class_name == "Notification") {
+                t.ignore = true;
+            }
+        }
+    }
+
+    if (transient && transient->format == 32) {
+        Window transient_for = *(const uint32_t*)xcb_get_property_value(transient);
+        if (transient_for != None && transient_for != t.window) {
+            t.floating = true;
+        }
+    }
+
+    if (hints && hints->format == 32 &&
+        xcb_get_property_value_length(hints) / 4 >= OLD_SIZE_HINTS_ELEMENTS) {
+        const uint32_t *v = (const uint32_t*)xcb_get_property_value(hints);
+        t.has_hints = true;
+        t.hints.flags = v[0];
+        t.hints.x = (int32_t)v[1];
+        t.hints.y = (int32_t)v[2];
+        t.hints.width = (int32_t)v[3];
+        t.hints.height = (int32_t)v[4];
+        t.hints.min_width = (int32_t)v[5];
+        t.hints.min_height = (int32_t)v[6];
+        t.hints.max_width = (int32_t)v[7];
+        t.hints.max_height = (int32_t)v[8];
+
+        if ((t.hints.flags & PMaxSize) && (t.hints.flags & PMinSize)) {
+            if (t.hints.max_width == t.hints.min_width &&
+                t.hints.max_height == t.hints.min_height &&
+                t.hints.max_width < 800 && t.hints.max_height < 600) {
+                t.floating = true;
+            }
+        }
+    }
+
+    free(type);
+    free(state);
+    free(wm_class);
+    free(transient);
+    free(hints);
+}
+
+}
+
+std::vector<nwm::WindowTraits> nwm::classify_windows(Base &base, const std::vector<Window> &windows) {
+    xcb_connection_t *conn = XGetXCBConnection(base.display);
+    std::vector<TraitCookies> cookies(windows.size());
+    std::vector<WindowTraits> traits(windows.size());
+
+    for (size_t i = 0; i < windows.size(); ++i) {
+        xcb_window_t w = windows[i];
+        TraitCookies &c = cookies[i];
+
+        c.attributes = xcb_get_window_attributes(conn, w);
+        c.geometry = xcb_get_geometry(conn, w);
+        c.window_type = xcb_get_property(conn, 0, w, atom(NET_WM_WINDOW_TYPE), XA_ATOM, 0, 64);
+        c.state = xcb_get_property(conn, 0, w, atom(NET_WM_STATE), XA_ATOM, 0, 64);
+        c.wm_class = xcb_get_property(conn, 0, w, XA_WM_CLASS, XA_STRING, 0, 64);
+        c.transient_for = xcb_get_property(conn, 0, w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+        c.normal_hints = xcb_get_property(conn, 0, w, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS,
+                                          0, SIZE_HINTS_ELEMENTS);
+        c.workspace = xcb_get_property(conn, 1, w, atom(NWM_WORKSPACE), XA_CARDINAL, 0, 1);
+        c.floating = xcb_get_property(conn, 1, w, atom(NWM_FLOATING), XA_CARDINAL, 0, 1);
+        c.fullscreen = xcb_get_property(conn, 1, w, atom(NWM_FULLSCREEN), XA_CARDINAL, 0, 1);
+    }
+
+    for (size_t i = 0; i < windows.size(); ++i) {
+        WindowTraits &t = traits[i];
+        memset(&t, 0, sizeof(t));
+        t.window = windows[i];
+        t.saved_workspace = -1;
+        collect(conn, cookies[i], t);
+    }
+
+    return traits;
+}
+
+nwm::WindowTraits nwm::classify_window(Base &base, Window window) {
+    return classify_windows(base, std::vector<Window>(1, window))[0];
+}
@@ -0,0 +1,45 @@
+#ifndef TRAITS_HPP
+#define TRAITS_HPP
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <vector>
+
+namespace nwm {
+
+struct Base;
+
+// Everything manage_window needs to know about a new window, gathered from a
+// single batch of requests.
+struct WindowTraits {
+    Window window;
+    bool valid;
+
+    bool override_redirect;
+    bool input_only;
+    int map_state;
+    int x, y;
+    int width, height;
+    int border_width;
+
+    bool ignore;
+    bool special;
+    bool floating;
+
+    bool has_hints;
+    XSizeHints hints;
+
+    int saved_workspace;
+    bool saved_floating;
+    bool saved_fullscreen;
+};
+
+// Issues the attribute, geometry and property requests for every window
+// through the XCB side of the connection, then collects the replies, so the
+// whole batch costs one round trip.
+std::vector<WindowTraits> classify_windows(Base &base, const std::vector<Window> &windows);
+WindowTraits classify_window(Base &base, Window window);
+
+}
+
+#endif // TRAITS_HPP